@@ -0,0 +1,169 @@
+#include "async.h"
+#include "pause.h"
+#include <pthread.h>
+
+#define ASYNC_BATCH 4096 // most records replayed from one ring before moving to the next
+
+struct AsyncSim {
+    Sweep *sweep;
+    unsigned long ring_records;
+    AsyncRing *rings[ASYNC_MAX_RINGS];
+    unsigned long num_rings; // atomic, released once rings[num_rings - 1] is set up
+    pthread_mutex_t lock;    // serializes ring registration
+    pthread_t drainer;
+    int stop;                // atomic
+};
+
+// Replays one contiguous run from each non-empty ring per round, so a busy ring cannot
+// starve the others. On stop, it exits after a round finds every ring empty.
+static void *drain_rings(void *arg) {
+    AsyncSim *sim = arg;
+    unsigned long polls = 0;
+    for (;;) {
+        int stop = __atomic_load_n(&sim->stop, __ATOMIC_ACQUIRE);
+        unsigned long replayed = 0;
+        unsigned long num_rings = __atomic_load_n(&sim->num_rings, __ATOMIC_ACQUIRE);
+        for (unsigned long i = 0; i < num_rings; i++) {
+            AsyncRing *ring = sim->rings[i];
+            unsigned long tail = ring->tail;
+            unsigned long available = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+            if (!available)
+                continue;
+            unsigned long start = tail & ring->mask;
+            unsigned long count = available < ring->capacity - start ? available : ring->capacity - start;
+            if (count > ASYNC_BATCH)
+                count = ASYNC_BATCH;
+            sweep_replay(sim->sweep, ring->records + start, count); // straight from the ring
+            __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+            replayed += count;
+        }
+        if (replayed) {
+            polls = 0;
+            continue;
+        }
+        if (stop)
+            break;
+        pause_briefly(polls++);
+    }
+    return NULL;
+}
+
+AsyncSim *async_create(SimContext **contexts, unsigned long num_contexts, unsigned long threads,
+                       unsigned long ring_records) {
+    AsyncSim *sim = calloc(1, sizeof(AsyncSim));
+    if (!sim) { perror("calloc"); exit(1); }
+    if (ring_records == 0)
+        ring_records = ASYNC_RING_RECORDS;
+    sim->ring_records = 1;
+    while (sim->ring_records < ring_records)
+        sim->ring_records *= 2;
+    sim->sweep = sweep_create(contexts, num_contexts, threads);
+    pthread_mutex_init(&sim->lock, NULL);
+    if (pthread_create(&sim->drainer, NULL, drain_rings, sim) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    return sim;
+}
+
+AsyncRing *async_ring(AsyncSim *sim) {
+    AsyncRing *ring = aligned_alloc(64, sizeof(AsyncRing));
+    if (!ring) { perror("aligned_alloc"); exit(1); }
+    memset(ring, 0, sizeof(*ring));
+    ring->capacity = sim->ring_records;
+    ring->mask = ring->capacity - 1;
+    ring->sim = sim;
+    ring->records = aligned_alloc(64, ring->capacity * sizeof(TraceRecord));
+    if (!ring->records) { perror("aligned_alloc"); exit(1); }
+
+    pthread_mutex_lock(&sim->lock);
+    unsigned long n = sim->num_rings;
+    if (n == ASYNC_MAX_RINGS) {
+        fprintf(stderr, "async: more than %d producer rings\n", ASYNC_MAX_RINGS);
+        exit(1);
+    }
+    ring->core = n;
+    sim->rings[n] = ring;
+    __atomic_store_n(&sim->num_rings, n + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&sim->lock);
+    return ring;
+}
+
+void async_wait(AsyncRing *ring) {
+    ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (ring->head - ring->cached_tail < ring->capacity)
+        return; // the cached tail was just stale
+    __atomic_store_n(&ring->stalls, ring->stalls + 1, __ATOMIC_RELAXED);
+    unsigned long polls = 0;
+    while (ring->head - ring->cached_tail == ring->capacity) {
+        pause_briefly(polls++);
+        ring->cached_tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    }
+}
+
+void async_drain(AsyncSim *sim) {
+    unsigned long num_rings = __atomic_load_n(&sim->num_rings, __ATOMIC_ACQUIRE);
+    for (unsigned long i = 0; i < num_rings; i++) {
+        AsyncRing *ring = sim->rings[i];
+        unsigned long target = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned long polls = 0;
+        while ((long)(target - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) > 0)
+            pause_briefly(polls++);
+    }
+}
+
+unsigned long async_stalls(AsyncSim *sim) {
+    unsigned long stalls = 0;
+    unsigned long num_rings = __atomic_load_n(&sim->num_rings, __ATOMIC_ACQUIRE);
+    for (unsigned long i = 0; i < num_rings; i++)
+        stalls += __atomic_load_n(&sim->rings[i]->stalls, __ATOMIC_RELAXED);
+    return stalls;
+}
+
+void async_destroy(AsyncSim *sim) {
+    if (!sim)
+        return;
+    __atomic_store_n(&sim->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(sim->drainer, NULL);
+    sweep_destroy(sim->sweep);
+    for (unsigned long i = 0; i < sim->num_rings; i++) {
+        free(sim->rings[i]->records);
+        free(sim->rings[i]);
+    }
+    pthread_mutex_destroy(&sim->lock);
+    free(sim);
+}
+
+
+// simulator API calls over g_sim
+static AsyncSim *g_async = NULL;
+static unsigned long g_async_generation = 0; // tells a thread's ring from an earlier start_async
+static __thread AsyncRing *t_ring;
+static __thread unsigned long t_ring_generation;
+
+void start_async(void) {
+    if (!g_sim || g_async)
+        return;
+    g_async = async_create(&g_sim, 1, 1, 0);
+    g_async_generation++;
+}
+
+void simulate_memory_access_async(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!g_async)
+        return;
+    if (t_ring_generation != g_async_generation) {
+        t_ring = async_ring(g_async);
+        t_ring_generation = g_async_generation;
+    }
+    async_access(t_ring, vaddr, paddr, access_type);
+}
+
+void drain(void) {
+    if (g_async)
+        async_drain(g_async);
+}
+
+void stop_async(void) {
+    async_destroy(g_async);
+    g_async = NULL;
+}
@@ -0,0 +1,83 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include "sweep.h"
+
+// Asynchronous ingestion: instrumented threads write records into their own lock-free
+// single-producer/single-consumer ring and carry on, and a drainer thread replays the
+// rings into one or more contexts (through a Sweep, so several contexts are simulated on
+// several threads). A producer only waits when its ring is full, which is the
+// backpressure that keeps memory bounded when the simulator falls behind.
+//
+// Records of one ring are replayed in order; rings are interleaved in batches. Latencies
+// are not returned in this mode, the contexts' statistics are the result. Before reading
+// them (sim_report, end()) call async_drain so everything written so far is simulated.
+
+#define ASYNC_RING_RECORDS 65536 // default ring size, records
+#define ASYNC_MAX_RINGS 1024
+
+typedef struct AsyncSim AsyncSim;
+
+typedef struct {
+    TraceRecord *records;
+    unsigned long capacity; // power of two
+    unsigned long mask;
+    AsyncSim *sim;
+    unsigned long core;     // core of every record written, rings count up from 0 as registered
+
+    // producer side
+    unsigned long head __attribute__((aligned(64))); // next record to write, released per record
+    unsigned long cached_tail;                       // last tail the producer saw
+    unsigned long stalls;                            // writes that found the ring full
+
+    // consumer side
+    unsigned long tail __attribute__((aligned(64))); // next record to replay, released after it is simulated
+} AsyncRing;
+
+// threads counts the drainer, as for sweep_create; ring_records 0 uses ASYNC_RING_RECORDS
+AsyncSim *async_create(SimContext **contexts, unsigned long num_contexts, unsigned long threads,
+                       unsigned long ring_records);
+
+// a new ring for the calling thread, which must be its only producer; on a multi-core
+// hierarchy each producer thread is its own core (modulo CORES)
+AsyncRing *async_ring(AsyncSim *sim);
+
+// waits for room in a full ring
+void async_wait(AsyncRing *ring);
+
+static inline void async_write(AsyncRing *ring, unsigned long vaddr, unsigned long paddr, unsigned long access_type,
+                               TraceOp op) {
+    unsigned long head = ring->head;
+    if (head - ring->cached_tail == ring->capacity)
+        async_wait(ring);
+    TraceRecord *r = &ring->records[head & ring->mask];
+    r->vaddr = vaddr;
+    r->paddr = paddr;
+    r->access_type = access_type;
+    r->core = ring->core;
+    r->op = op;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static inline void async_access(AsyncRing *ring, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    async_write(ring, vaddr, paddr, access_type, TRACE_ACCESS);
+}
+
+// returns once every record written to any ring before the call has been simulated
+void async_drain(AsyncSim *sim);
+
+// full-ring waits over all rings so far
+unsigned long async_stalls(AsyncSim *sim);
+
+// drains, stops the drainer and frees the rings; the contexts stay with the caller
+void async_destroy(AsyncSim *sim);
+
+// The same over the default context g_sim, for instrumentation tools using the simulator
+// API calls: start_async() after start(), simulate_memory_access_async() from any thread
+// (each gets its own ring on first use), drain() before end(), stop_async() before deinit().
+void start_async(void);
+void simulate_memory_access_async(unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+void drain(void);
+void stop_async(void);
+
+#endif
@@ -0,0 +1,109 @@
+// Throughput benchmark: per-access sim_access vs sim_access_batch.
+// build: gcc -O2 -o bench bench.c cache.c coherence.c waymatch.c kernels.c prefetch.c dram.c tlb.c interval.c -lpthread
+// usage: ./bench [num_accesses] [batch_size]
+#include "cache.h"
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long next_random(unsigned long *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void make_trace(MemoryAccess *trace, unsigned long n) {
+    unsigned long state = 88172645463325252UL;
+    for (unsigned long i = 0; i < n; i++) {
+        unsigned long r = next_random(&state);
+        unsigned long addr;
+        if ((r & 3) == 0)
+            addr = (r >> 8) % (256UL << 20);   // random over 256 MB
+        else if ((r & 3) == 1)
+            addr = (r >> 8) % (64UL << 10);    // 64 KB hot set
+        else
+            addr = (i * 64) % (4UL << 20);     // 4 MB stream
+        trace[i].vaddr = addr;
+        trace[i].paddr = addr;
+        unsigned long kind = (r >> 5) & 7;
+        trace[i].access_type = kind == 0 ? 1 : kind == 1 ? 2 : 0; // 1/8 fetches, 1/8 stores
+    }
+}
+
+typedef struct {
+    double seconds;
+    unsigned long latency_sum;
+    SimStats stats;
+} RunResult;
+
+static RunResult run(const MemoryAccess *trace, unsigned long n, unsigned long batch, unsigned long *latencies) {
+    RunResult r = {0};
+    SimContext *ctx = sim_create(CONFIG);
+    sim_seed(ctx, 1);
+    sim_start(ctx);
+    double t0 = now_seconds();
+    if (batch == 0) {
+        for (unsigned long i = 0; i < n; i++)
+            latencies[i] = sim_access(ctx, trace[i].vaddr, trace[i].paddr, trace[i].access_type);
+    } else {
+        for (unsigned long i = 0; i < n; i += batch)
+            sim_access_batch(ctx, &trace[i], (n - i < batch) ? n - i : batch, &latencies[i]);
+    }
+    r.seconds = now_seconds() - t0;
+    for (unsigned long i = 0; i < n; i++)
+        r.latency_sum += latencies[i];
+    sim_get_stats(ctx, &r.stats);
+    sim_destroy(ctx);
+    return r;
+}
+
+// the access kernel and way-match routine each level got; "generic" means no kernel
+// is specialized for its geometry and policy. Both kinds of kernel match ways
+// through match_ways.
+static void print_kernels(void) {
+    SimContext *ctx = sim_create(CONFIG);
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        int split = ctx->levels[n][1] != ctx->levels[n][0];
+        for (unsigned long side = 0; side < 2; side++) {
+            const CacheLevel *cache = ctx->levels[n][side];
+            if (!cache || (side && !split))
+                continue;
+            printf("L%lu%s: %s kernel, %s way match\n", n + 1, split ? (side ? " Instruction" : " Data") : "",
+                   cache->kernel_name, way_match_name(cache->match_ways));
+        }
+    }
+    sim_destroy(ctx);
+}
+
+int main(int argc, char **argv) {
+    unsigned long n = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000000;
+    unsigned long batch = argc > 2 ? strtoul(argv[2], NULL, 10) : 4096;
+    if (batch == 0)
+        batch = 1;
+
+    MemoryAccess *trace = malloc(sizeof(MemoryAccess) * n);
+    unsigned long *latencies = malloc(sizeof(unsigned long) * n);
+    if (!trace || !latencies) { perror("malloc"); exit(1); }
+    make_trace(trace, n);
+
+    RunResult single = run(trace, n, 0, latencies);
+    RunResult batched = run(trace, n, batch, latencies);
+
+    printf("config: %s, %lu accesses, batch size %lu\n", CONFIG, n, batch);
+    print_kernels();
+    printf("per-access: %.2f M accesses/sec\n", n / single.seconds / 1e6);
+    printf("batched:    %.2f M accesses/sec (%.2fx)\n", n / batched.seconds / 1e6, single.seconds / batched.seconds);
+
+    int identical = single.latency_sum == batched.latency_sum &&
+                    memcmp(&single.stats, &batched.stats, sizeof(SimStats)) == 0;
+    printf("statistics %s\n", identical ? "identical" : "DIFFER");
+
+    free(trace);
+    free(latencies);
+    return identical ? 0 : 1;
+}
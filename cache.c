@@ -1,42 +1,83 @@
 #include "cache.h"
 #include <errno.h>
 #include <stdlib.h>
+#include <sys/mman.h>
 #include <time.h>
 
-CacheConfig g_config;
+static void set_level_defaults(LevelConfig *level, unsigned long use, unsigned long size,
+                               unsigned long assoc, unsigned long latency) {
+    level->use = use;
+    level->size = size;
+    level->assoc = assoc;
+    level->line = 64;
+    level->latency = latency;
+    level->split = 0;
+    snprintf(level->policy_str, sizeof(level->policy_str), "LRU");
+    level->sample_sets = 0;
+    snprintf(level->sample_str, sizeof(level->sample_str), "HASH");
+    level->shared = 0;
+    snprintf(level->prefetcher_str, sizeof(level->prefetcher_str), "NONE");
+    level->prefetch_degree = 0;
+    level->write_through = 0;
+    level->write_allocate = 1;
+    level->inclusion = INCLUSION_NINE;
+    level->mshrs = 16;
+}
+
+// maps "USE_L<n>" and "L<n>_<FIELD>" keys to level n's config, *field gets "USE" or FIELD
+static LevelConfig *level_key(CacheConfig *config, char *key, const char **field) {
+    char *end;
+    unsigned long n;
+    if (strncmp(key, "USE_L", 5) == 0) {
+        n = strtoul(key + 5, &end, 10);
+        if (end == key + 5 || *end != '\0')
+            return NULL;
+        *field = "USE";
+    } else if (key[0] == 'L' && key[1] >= '0' && key[1] <= '9') {
+        n = strtoul(key + 1, &end, 10);
+        if (*end != '_')
+            return NULL;
+        *field = end + 1;
+    } else {
+        return NULL;
+    }
+    if (n < 1 || n > MAX_CACHE_LEVELS)
+        return NULL;
+    return &config->levels[n - 1];
+}
 
-void read_config(const char *filename) {
+void read_config(const char *filename, CacheConfig *config) {
     // default values
-    g_config.use_l1 = 1;
-    g_config.use_l2 = 1;
-    g_config.use_l3 = 1;
-    g_config.use_l4 = 0;
-
-    g_config.l1_size = 32 * 1024;
-    g_config.l1_assoc = 8;
-    g_config.l1_line = 64;
-    g_config.l1_latency = 1;
-    snprintf(g_config.l1_policy_str, sizeof(g_config.l1_policy_str), "LRU");
-
-    g_config.l2_size = 256 * 1024;
-    g_config.l2_assoc = 8;
-    g_config.l2_line = 64;
-    g_config.l2_latency = 10;
-    snprintf(g_config.l2_policy_str, sizeof(g_config.l2_policy_str), "LRU");
-
-    g_config.l3_size = 2048 * 1024;
-    g_config.l3_assoc = 8;
-    g_config.l3_line = 64;
-    g_config.l3_latency = 20;
-    snprintf(g_config.l3_policy_str, sizeof(g_config.l3_policy_str), "LRU");
-
-    g_config.l4_size = 0;
-    g_config.l4_assoc = 16;
-    g_config.l4_line = 64;
-    g_config.l4_latency = 40;
-    snprintf(g_config.l4_policy_str, sizeof(g_config.l4_policy_str), "LRU");
-
-    g_config.mem_latency = 100;
+    set_level_defaults(&config->levels[0], 1, 32 * 1024, 8, 1);
+    config->levels[0].split = 1; // separate L1 instruction and data caches
+    set_level_defaults(&config->levels[1], 1, 256 * 1024, 8, 10);
+    set_level_defaults(&config->levels[2], 1, 2048 * 1024, 8, 20);
+    set_level_defaults(&config->levels[3], 0, 0, 16, 40);
+    for (unsigned long n = 4; n < MAX_CACHE_LEVELS; n++)
+        set_level_defaults(&config->levels[n], 0, 0, 16, 40 << (n - 3));
+    for (unsigned long n = 2; n < MAX_CACHE_LEVELS; n++)
+        config->levels[n].shared = 1; // private L1 and L2, shared L3 and below
+
+    config->mem_latency = 100;
+    config->use_dram = 0;
+    dram_defaults(&config->dram);
+    config->use_tlb = 0;
+    mmu_defaults(&config->mmu);
+    config->mem_bandwidth = 0;
+    config->bandwidth_interval = 10000;
+    config->seed = 1;
+    config->issue_window = 0;
+    config->sample_period = 0;
+    config->sample_warmup = 2000;
+    config->sample_window = 1000;
+    config->cores = 1;
+    config->c2c_latency = 50;
+    config->invalidate_latency = 30;
+    config->interval_accesses = 0;
+    config->interval_cycles = 0;
+    config->interval_buffer = 4096;
+    config->interval_binary = 0;
+    strcpy(config->interval_path, "intervals.csv");
 
     FILE *fp = fopen(filename, "r");
     if (!fp) {
@@ -60,154 +101,384 @@ void read_config(const char *filename) {
         if (newline)
             *newline = '\0';
 
-        if (strcmp(key, "USE_L1") == 0)
-            g_config.use_l1 = strtoul(value, NULL, 10);
-        else if (strcmp(key, "USE_L2") == 0)
-            g_config.use_l2 = strtoul(value, NULL, 10);
-        else if (strcmp(key, "USE_L3") == 0)
-            g_config.use_l3 = strtoul(value, NULL, 10);
-        else if (strcmp(key, "USE_L4") == 0)
-            g_config.use_l4 = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L1_SIZE") == 0)
-            g_config.l1_size = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L1_ASSOC") == 0)
-            g_config.l1_assoc = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L1_LINE") == 0)
-            g_config.l1_line = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L1_LATENCY") == 0)
-            g_config.l1_latency = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L1_POLICY") == 0)
-            strncpy(g_config.l1_policy_str, value, sizeof(g_config.l1_policy_str)-1);
-        else if (strcmp(key, "L2_SIZE") == 0)
-            g_config.l2_size = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L2_ASSOC") == 0)
-            g_config.l2_assoc = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L2_LINE") == 0)
-            g_config.l2_line = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L2_LATENCY") == 0)
-            g_config.l2_latency = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L2_POLICY") == 0)
-            strncpy(g_config.l2_policy_str, value, sizeof(g_config.l2_policy_str)-1);
-        else if (strcmp(key, "L3_SIZE") == 0)
-            g_config.l3_size = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L3_ASSOC") == 0)
-            g_config.l3_assoc = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L3_LINE") == 0)
-            g_config.l3_line = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L3_LATENCY") == 0)
-            g_config.l3_latency = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L3_POLICY") == 0)
-            strncpy(g_config.l3_policy_str, value, sizeof(g_config.l3_policy_str)-1);
-        else if (strcmp(key, "L4_SIZE") == 0)
-            g_config.l4_size = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L4_ASSOC") == 0)
-            g_config.l4_assoc = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L4_LINE") == 0)
-            g_config.l4_line = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L4_LATENCY") == 0)
-            g_config.l4_latency = strtoul(value, NULL, 10);
-        else if (strcmp(key, "L4_POLICY") == 0)
-            strncpy(g_config.l4_policy_str, value, sizeof(g_config.l4_policy_str)-1);
+        const char *field;
+        LevelConfig *level = level_key(config, key, &field);
+        if (level) {
+            if (strcmp(field, "USE") == 0)
+                level->use = strtoul(value, NULL, 10);
+            else if (strcmp(field, "SIZE") == 0)
+                level->size = strtoul(value, NULL, 10);
+            else if (strcmp(field, "ASSOC") == 0)
+                level->assoc = strtoul(value, NULL, 10);
+            else if (strcmp(field, "LINE") == 0)
+                level->line = strtoul(value, NULL, 10);
+            else if (strcmp(field, "LATENCY") == 0)
+                level->latency = strtoul(value, NULL, 10);
+            else if (strcmp(field, "SPLIT") == 0)
+                level->split = strtoul(value, NULL, 10);
+            else if (strcmp(field, "POLICY") == 0)
+                strncpy(level->policy_str, value, sizeof(level->policy_str)-1);
+            else if (strcmp(field, "SAMPLE_SETS") == 0)
+                level->sample_sets = strtoul(value, NULL, 10);
+            else if (strcmp(field, "SAMPLE") == 0)
+                strncpy(level->sample_str, value, sizeof(level->sample_str)-1);
+            else if (strcmp(field, "SHARED") == 0)
+                level->shared = strtoul(value, NULL, 10);
+            else if (strcmp(field, "PREFETCHER") == 0)
+                strncpy(level->prefetcher_str, value, sizeof(level->prefetcher_str)-1);
+            else if (strcmp(field, "PREFETCH_DEGREE") == 0)
+                level->prefetch_degree = strtoul(value, NULL, 10);
+            else if (strcmp(field, "WRITE_POLICY") == 0)
+                level->write_through = (strcmp(value, "WT") == 0);
+            else if (strcmp(field, "WRITE_ALLOCATE") == 0)
+                level->write_allocate = strtoul(value, NULL, 10);
+            else if (strcmp(field, "INCLUSION") == 0) {
+                if (strcmp(value, "INCLUSIVE") == 0)
+                    level->inclusion = INCLUSION_INCLUSIVE;
+                else if (strcmp(value, "EXCLUSIVE") == 0)
+                    level->inclusion = INCLUSION_EXCLUSIVE;
+                else {
+                    if (strcmp(value, "NINE") != 0)
+                        fprintf(stderr, "Warning: unknown %s %s, using NINE.\n", key, value);
+                    level->inclusion = INCLUSION_NINE;
+                }
+            }
+            else if (strcmp(field, "MSHRS") == 0)
+                level->mshrs = strtoul(value, NULL, 10);
+        }
         else if (strcmp(key, "MEM_LATENCY") == 0)
-            g_config.mem_latency = strtoul(value, NULL, 10);
+            config->mem_latency = strtoul(value, NULL, 10);
+        else if (strcmp(key, "MEM_MODEL") == 0) {
+            config->use_dram = (strcmp(value, "DRAM") == 0);
+            if (!config->use_dram && strcmp(value, "FIXED") != 0)
+                fprintf(stderr, "Warning: unknown MEM_MODEL %s, using FIXED.\n", value);
+        }
+        else if (strncmp(key, "DRAM_", 5) == 0)
+            dram_config_key(&config->dram, key + 5, value);
+        else if (strcmp(key, "MEM_BANDWIDTH") == 0)
+            config->mem_bandwidth = strtoul(value, NULL, 10);
+        else if (strcmp(key, "BANDWIDTH_INTERVAL") == 0)
+            config->bandwidth_interval = strtoul(value, NULL, 10);
+        else if (strcmp(key, "RNG_SEED") == 0)
+            config->seed = strtoull(value, NULL, 10);
+        else if (strcmp(key, "ISSUE_WINDOW") == 0)
+            config->issue_window = strtoul(value, NULL, 10);
+        else if (strcmp(key, "SAMPLE_PERIOD") == 0)
+            config->sample_period = strtoul(value, NULL, 10);
+        else if (strcmp(key, "SAMPLE_WARMUP") == 0)
+            config->sample_warmup = strtoul(value, NULL, 10);
+        else if (strcmp(key, "SAMPLE_WINDOW") == 0)
+            config->sample_window = strtoul(value, NULL, 10);
+        else if (strcmp(key, "CORES") == 0)
+            config->cores = strtoul(value, NULL, 10);
+        else if (strcmp(key, "C2C_LATENCY") == 0)
+            config->c2c_latency = strtoul(value, NULL, 10);
+        else if (strcmp(key, "INVALIDATE_LATENCY") == 0)
+            config->invalidate_latency = strtoul(value, NULL, 10);
+        else if (strcmp(key, "INTERVAL_ACCESSES") == 0)
+            config->interval_accesses = strtoul(value, NULL, 10);
+        else if (strcmp(key, "INTERVAL_CYCLES") == 0)
+            config->interval_cycles = strtoul(value, NULL, 10);
+        else if (strcmp(key, "INTERVAL_BUFFER") == 0)
+            config->interval_buffer = strtoul(value, NULL, 10);
+        else if (strcmp(key, "INTERVAL_FILE") == 0) {
+            strncpy(config->interval_path, value, sizeof(config->interval_path)-1);
+            config->interval_path[sizeof(config->interval_path)-1] = '\0';
+        }
+        else if (strcmp(key, "INTERVAL_FORMAT") == 0) {
+            config->interval_binary = (strcmp(value, "BINARY") == 0);
+            if (!config->interval_binary && strcmp(value, "CSV") != 0)
+                fprintf(stderr, "Warning: unknown INTERVAL_FORMAT %s, using CSV.\n", value);
+        }
+        else if (strcmp(key, "USE_TLB") == 0)
+            config->use_tlb = strtoul(value, NULL, 10);
+        else
+            mmu_config_key(&config->mmu, key, value);
     }
     fclose(fp);
 }
 
 
-CacheLevel *g_l1_data = NULL;
-CacheLevel *g_l1_instr = NULL;
-CacheLevel *g_l2 = NULL;
-CacheLevel *g_l3 = NULL;
-CacheLevel *g_l4 = NULL;
+SimContext *g_sim = NULL;
+
+
+void update_policy_lru(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    (void) event;
+    set->last_access_time[line_index] = ctx->current_time;
+}
+
+unsigned long find_victim_lru(SimContext *ctx, CacheSet *set) {
+    (void) ctx;
+    unsigned long victim = 0;
+    unsigned long min_time = set->last_access_time[0];
+    for (unsigned long i = 1; i < set->num_lines; i++) {
+        if (set->last_access_time[i] < min_time) {
+            min_time = set->last_access_time[i];
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+void update_policy_bip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    if (event == POLICY_HIT || sim_rand(ctx) % 32 == 0) { // hits and 1 fill in 32 go to most recently used
+        set->last_access_time[line_index] = ctx->current_time;
+    } else {
+        // insert at least recently used
+        set->last_access_time[line_index] = 0;
+    }
+}
+
+unsigned long find_victim_bip(SimContext *ctx, CacheSet *set) {
+    return find_victim_lru(ctx, set);
+}
+
+void update_policy_random(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    // fills keep recency ages, which a checkpoint can hand to LRU or BIP
+    if (event == POLICY_FILL)
+        set->last_access_time[line_index] = ctx->current_time;
+}
+
+unsigned long find_victim_random(SimContext *ctx, CacheSet *set) {
+    return sim_rand(ctx) % set->num_lines;
+}
+
+// first invalid way of the set, or WAY_NONE
+static inline unsigned long invalid_way(const CacheSet *set) {
+    for (unsigned long base = 0; base < set->num_lines; base += 64) {
+        uint64_t invalid = ~set->valid[base / 64] & way_mask(set->num_lines - base);
+        if (invalid)
+            return base + __builtin_ctzll(invalid);
+    }
+    return WAY_NONE;
+}
+
+// first byte of the line with tag in set index of cache
+static inline unsigned long line_address(const CacheLevel *cache, unsigned long index, unsigned int tag) {
+    if (cache->pow2_geometry)
+        return ((unsigned long)tag << cache->tag_shift) | (index << cache->line_shift);
+    return ((unsigned long)tag * cache->num_sets + index) * cache->line_size;
+}
+
+void update_policy_plru_tree(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    (void) ctx;
+    (void) event; // a fill is a touch
+    *set->plru = plru_tree_touch(*set->plru, line_index, set->num_lines);
+}
+
+unsigned long find_victim_plru_tree(SimContext *ctx, CacheSet *set) {
+    (void) ctx;
+    unsigned long way = invalid_way(set);
+    return way != WAY_NONE ? way : plru_tree_victim(*set->plru, set->num_lines);
+}
 
-unsigned long g_current_time = 0;
+void update_policy_plru_bit(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    (void) ctx;
+    (void) event;
+    *set->plru = plru_bit_touch(*set->plru, line_index, set->num_lines);
+}
 
-unsigned long g_mem_accesses = 0;
-unsigned long g_instr_accesses = 0;
-unsigned long g_data_accesses = 0;
-unsigned long g_total_latency_instr = 0;
-unsigned long g_total_latency_data = 0;
+unsigned long find_victim_plru_bit(SimContext *ctx, CacheSet *set) {
+    (void) ctx;
+    unsigned long way = invalid_way(set);
+    return way != WAY_NONE ? way : plru_bit_victim(*set->plru, set->num_lines);
+}
 
-unsigned long g_counting = 0;
+// Set dueling. Constituency c (sets [c * stride, (c + 1) * stride)) of the first DUEL_LEADERS
+// holds one leader of each policy, at offsets c and c + stride / 2 modulo stride, so the
+// leaders do not all share their low index bits with one access stride.
+enum { DUEL_FOLLOWER, DUEL_FIRST, DUEL_SECOND };
 
-static unsigned long l1_data_accesses_stats = 0, l1_data_hits_stats = 0;
-static unsigned long l1_instr_accesses_stats = 0, l1_instr_hits_stats = 0;
-static unsigned long l2_accesses_stats = 0, l2_hits_stats = 0;
-static unsigned long l3_accesses_stats = 0, l3_hits_stats = 0;
-static unsigned long l4_accesses_stats = 0, l4_hits_stats = 0;
+static inline int duel_role(const CacheLevel *cache, unsigned long index) {
+    unsigned long stride = cache->duel_stride;
+    unsigned long c = index / stride, offset = index % stride;
+    if (c >= DUEL_LEADERS)
+        return DUEL_FOLLOWER;
+    if (offset == c % stride)
+        return DUEL_FIRST;
+    if (offset == (c + stride / 2) % stride)
+        return DUEL_SECOND;
+    return DUEL_FOLLOWER;
+}
 
+// on a fill, i.e. a miss: a leader's miss counts against its policy. Returns whether the
+// set inserts with the second policy.
+static inline int duel_fill(CacheSet *set) {
+    CacheLevel *cache = set->level;
+    switch (duel_role(cache, set->index)) {
+        case DUEL_FIRST:
+            if (cache->psel < PSEL_MAX)
+                cache->psel++;
+            return 0;
+        case DUEL_SECOND:
+            if (cache->psel > 0)
+                cache->psel--;
+            return 1;
+    }
+    return cache->psel > PSEL_MAX / 2;
+}
 
-void update_policy_lru(CacheSet *set, unsigned long line_index) {
-    set->lines[line_index].last_access_time = g_current_time;
+void update_policy_dip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    if (event == POLICY_FILL && duel_fill(set))
+        update_policy_bip(ctx, set, line_index, event);
+    else
+        update_policy_lru(ctx, set, line_index, event);
 }
 
-unsigned long find_victim_lru(CacheSet *set) {
+unsigned long find_victim_rrip(SimContext *ctx, CacheSet *set) {
+    (void) ctx;
+    unsigned long way = invalid_way(set);
+    if (way != WAY_NONE)
+        return way;
+    // ageing until some way reaches RRPV_MAX is adding the gap to the oldest at once
     unsigned long victim = 0;
-    unsigned long min_time = set->lines[0].last_access_time;
+    uint8_t max = set->rrpv[0];
     for (unsigned long i = 1; i < set->num_lines; i++) {
-        if (set->lines[i].last_access_time < min_time) {
-            min_time = set->lines[i].last_access_time;
+        if (set->rrpv[i] > max) {
+            max = set->rrpv[i];
             victim = i;
         }
     }
+    if (max < RRPV_MAX) {
+        for (unsigned long i = 0; i < set->num_lines; i++)
+            set->rrpv[i] += RRPV_MAX - max;
+    }
     return victim;
 }
 
-void update_policy_bip(CacheSet *set, unsigned long line_index) {
-    if (rand() % 32 == 0) { // 1/32 insert at most recently used
-        set->lines[line_index].last_access_time = g_current_time;
-    } else {
-        // insert at least recently used
-        set->lines[line_index].last_access_time = 0;
-    }
+void update_policy_srrip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    (void) ctx;
+    set->rrpv[line_index] = event == POLICY_HIT ? 0 : RRPV_MAX - 1; // long re-reference on insertion
+}
+
+void update_policy_brrip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    if (event == POLICY_HIT)
+        set->rrpv[line_index] = 0;
+    else
+        set->rrpv[line_index] = sim_rand(ctx) % 32 == 0 ? RRPV_MAX - 1 : RRPV_MAX;
 }
 
-unsigned long find_victim_bip(CacheSet *set) {
-    return find_victim_lru(set);
+void update_policy_drrip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    if (event == POLICY_FILL && duel_fill(set))
+        update_policy_brrip(ctx, set, line_index, event);
+    else
+        update_policy_srrip(ctx, set, line_index, event);
 }
 
-void update_policy_random(CacheSet *set, unsigned long line_index) {
-    (void) set; // unused parameter warning if unused
-    (void) line_index;
+#define SHIP_REUSED 0x8000 // in CacheLevel.ship
+
+// counter of the access filling line_index: its explicit signature, else its memory region
+static inline unsigned long ship_signature(const SimContext *ctx, const CacheSet *set, unsigned long line_index) {
+    uint64_t signature = ctx->signed_access ? ctx->signature
+                       : line_address(set->level, set->index, set->tags[line_index]) >> SHIP_REGION_SHIFT;
+    return (signature * 0x9E3779B97F4A7C15ULL) >> (64 - SHIP_SIGNATURE_BITS);
 }
 
-unsigned long find_victim_random(CacheSet *set) {
-    return rand() % set->num_lines;
+void update_policy_ship(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event) {
+    uint8_t *shct = set->level->shct;
+    uint16_t *line = &set->ship[line_index];
+    if (event == POLICY_HIT) {
+        set->rrpv[line_index] = 0;
+        *line |= SHIP_REUSED;
+        if (shct[*line & (SHIP_SHCT_SIZE - 1)] < SHIP_COUNTER_MAX)
+            shct[*line & (SHIP_SHCT_SIZE - 1)]++;
+        return;
+    }
+    // the line this fill replaced was never hit: its signature predicts no reuse a bit more
+    if (set->level->evicted_valid && !(*line & SHIP_REUSED) && shct[*line] > 0)
+        shct[*line]--;
+    unsigned long signature = ship_signature(ctx, set, line_index);
+    *line = signature;
+    set->rrpv[line_index] = shct[signature] ? RRPV_MAX - 1 : RRPV_MAX;
 }
 
-static ReplacementPolicy parse_policy(const char *policy_str) {
+ReplacementPolicy parse_policy(const char *policy_str) {
     if (strcmp(policy_str, "LRU") == 0)
         return POLICY_LRU;
     else if (strcmp(policy_str, "BIP") == 0)
         return POLICY_BIP;
     else if (strcmp(policy_str, "RANDOM") == 0)
         return POLICY_RANDOM;
+    else if (strcmp(policy_str, "PLRU_TREE") == 0)
+        return POLICY_PLRU_TREE;
+    else if (strcmp(policy_str, "PLRU_BIT") == 0)
+        return POLICY_PLRU_BIT;
+    else if (strcmp(policy_str, "SRRIP") == 0)
+        return POLICY_SRRIP;
+    else if (strcmp(policy_str, "BRRIP") == 0)
+        return POLICY_BRRIP;
+    else if (strcmp(policy_str, "DRRIP") == 0)
+        return POLICY_DRRIP;
+    else if (strcmp(policy_str, "SHIP") == 0)
+        return POLICY_SHIP;
+    else if (strcmp(policy_str, "DIP") == 0)
+        return POLICY_DIP;
     else
         return POLICY_LRU;  /* Default */
 }
 
+static int is_rrip(ReplacementPolicy policy) {
+    return policy == POLICY_SRRIP || policy == POLICY_BRRIP || policy == POLICY_DRRIP || policy == POLICY_SHIP;
+}
+
+static int is_pow2(unsigned long x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+// zeroed, cache-line-aligned array for the tag store
+static void *alloc_tag_store(size_t bytes) {
+    bytes = (bytes + 63) & ~(size_t)63;
+    void *p = aligned_alloc(64, bytes ? bytes : 64);
+    if (!p) { perror("aligned_alloc"); exit(1); }
+    memset(p, 0, bytes);
+    return p;
+}
+
 CacheLevel* init_cache_level(unsigned long cache_size, unsigned long associativity, unsigned long line_size, unsigned long access_latency, ReplacementPolicy policy) {
-    CacheLevel *cache = malloc(sizeof(CacheLevel));
-    if (!cache) { perror("malloc"); exit(1); }
+    CacheLevel *cache = calloc(1, sizeof(CacheLevel));
+    if (!cache) { perror("calloc"); exit(1); }
     cache->cache_size = cache_size;
     cache->associativity = associativity;
     cache->line_size = line_size;
     cache->access_latency = access_latency;
     cache->num_sets = cache_size / (line_size * associativity);
+    // PLRU state is one word per set
+    if (policy == POLICY_PLRU_TREE && !is_pow2(associativity) && associativity <= 64) {
+        fprintf(stderr, "Warning: PLRU_TREE needs a power-of-two associativity, using PLRU_BIT for %lu ways.\n",
+                associativity);
+        policy = POLICY_PLRU_BIT;
+    }
+    if ((policy == POLICY_PLRU_TREE || policy == POLICY_PLRU_BIT) && associativity > 64) {
+        fprintf(stderr, "Warning: PLRU supports up to 64 ways, using LRU for %lu ways.\n", associativity);
+        policy = POLICY_LRU;
+    }
     cache->policy = policy;
     
-    cache->sets = malloc(sizeof(CacheSet) * cache->num_sets);
-    if (!cache->sets) { perror("malloc"); exit(1); }
-    for (unsigned long i = 0; i < cache->num_sets; i++) {
-        cache->sets[i].num_lines = associativity;
-        cache->sets[i].lines = malloc(sizeof(CacheLine) * associativity);
-        if (!cache->sets[i].lines) { perror("malloc"); exit(1); }
-        for (unsigned long j = 0; j < associativity; j++) {
-            cache->sets[i].lines[j].valid = 0;
-            cache->sets[i].lines[j].tag = 0;
-            cache->sets[i].lines[j].last_access_time = 0;
-        }
+    unsigned long ways = cache->num_sets * associativity;
+    cache->valid_words = (associativity + 63) / 64;
+    cache->tags = alloc_tag_store(sizeof(unsigned int) * ways);
+    cache->valid = alloc_tag_store(sizeof(uint64_t) * cache->num_sets * cache->valid_words);
+    cache->dirty = alloc_tag_store(sizeof(uint64_t) * cache->num_sets * cache->valid_words);
+    cache->write_allocate = 1;
+    if (policy == POLICY_PLRU_TREE || policy == POLICY_PLRU_BIT)
+        cache->plru = alloc_tag_store(sizeof(uint64_t) * cache->num_sets);
+    else if (is_rrip(policy))
+        cache->rrpv = alloc_tag_store(ways);
+    else
+        cache->ages = alloc_tag_store(sizeof(unsigned long) * ways);
+    if (policy == POLICY_SHIP) {
+        cache->ship = alloc_tag_store(sizeof(uint16_t) * ways);
+        cache->shct = alloc_tag_store(SHIP_SHCT_SIZE);
+    }
+    cache->duel_stride = cache->num_sets / DUEL_LEADERS < 2 ? 2 : cache->num_sets / DUEL_LEADERS;
+    reset_policy_learning(cache);
+    cache->match_ways = select_way_match(associativity);
+
+    cache->pow2_geometry = is_pow2(line_size) && is_pow2(cache->num_sets);
+    if (cache->pow2_geometry) {
+        cache->line_shift = __builtin_ctzl(line_size);
+        cache->set_mask = cache->num_sets - 1;
+        cache->tag_shift = cache->line_shift + __builtin_ctzl(cache->num_sets);
     }
     
     switch(policy) {
@@ -223,549 +494,2572 @@ CacheLevel* init_cache_level(unsigned long cache_size, unsigned long associativi
             cache->update_policy = update_policy_random;
             cache->find_victim = find_victim_random;
             break;
+        case POLICY_PLRU_TREE:
+            cache->update_policy = update_policy_plru_tree;
+            cache->find_victim = find_victim_plru_tree;
+            break;
+        case POLICY_PLRU_BIT:
+            cache->update_policy = update_policy_plru_bit;
+            cache->find_victim = find_victim_plru_bit;
+            break;
+        case POLICY_SRRIP:
+            cache->update_policy = update_policy_srrip;
+            cache->find_victim = find_victim_rrip;
+            break;
+        case POLICY_BRRIP:
+            cache->update_policy = update_policy_brrip;
+            cache->find_victim = find_victim_rrip;
+            break;
+        case POLICY_DRRIP:
+            cache->update_policy = update_policy_drrip;
+            cache->find_victim = find_victim_rrip;
+            break;
+        case POLICY_SHIP:
+            cache->update_policy = update_policy_ship;
+            cache->find_victim = find_victim_rrip;
+            break;
+        case POLICY_DIP:
+            cache->update_policy = update_policy_dip;
+            cache->find_victim = find_victim_lru;
+            break;
         default:
             cache->update_policy = update_policy_lru;
             cache->find_victim = find_victim_lru;
     }
+    select_kernels(cache);
     
     return cache;
 }
 
 void free_cache_level(CacheLevel *cache) {
     if (cache) {
-        for (unsigned long i = 0; i < cache->num_sets; i++) {
-            free(cache->sets[i].lines);
+        if (!cache->mapped_store) {
+            free(cache->tags);
+            free(cache->valid);
+            free(cache->dirty);
+        }
+        if (!cache->mapped_state) {
+            free(cache->ages);
+            free(cache->plru);
+            free(cache->rrpv);
         }
-        free(cache->sets);
+        free(cache->ship);
+        free(cache->shct);
+        prefetcher_destroy(cache->prefetcher);
+        free(cache->prefetched);
+        free(cache->prefetch_ready);
+        free(cache->pollution_filter);
+        free(cache->mshr);
+        free(cache->sample_bits);
+        free(cache->set_samples);
         free(cache);
     }
 }
 
-static void init_cache_simulator(CacheLevel *l1_data, CacheLevel *l1_instr, CacheLevel *l2, CacheLevel *l3, CacheLevel *l4) {
-    g_l1_data   = l1_data;
-    g_l1_instr  = l1_instr;
-    g_l2        = l2;
-    g_l3        = l3;
-    g_l4        = l4;
-    g_current_time = 0;
+#define POLLUTION_FILTER_BITS 12
+
+void reset_prefetcher(CacheLevel *cache) {
+    if (!cache->prefetcher)
+        return;
+    prefetcher_reset(cache->prefetcher);
+    memset(cache->prefetched, 0, sizeof(uint64_t) * cache->num_sets * cache->valid_words);
+    memset(cache->pollution_filter, 0, sizeof(uint64_t) << POLLUTION_FILTER_BITS);
 }
 
-void init(void) {
-    read_config(CONFIG);
-
-    if (g_config.use_l1) {
-        g_l1_data = init_cache_level(g_config.l1_size, g_config.l1_assoc, g_config.l1_line,
-                                       g_config.l1_latency, parse_policy(g_config.l1_policy_str));
-        g_l1_instr = init_cache_level(g_config.l1_size, g_config.l1_assoc, g_config.l1_line,
-                                       g_config.l1_latency, parse_policy(g_config.l1_policy_str));
-    }
-    if (g_config.use_l2)
-        g_l2 = init_cache_level(g_config.l2_size, g_config.l2_assoc, g_config.l2_line,
-                                g_config.l2_latency, parse_policy(g_config.l2_policy_str));
-    if (g_config.use_l3)
-        g_l3 = init_cache_level(g_config.l3_size, g_config.l3_assoc, g_config.l3_line,
-                                g_config.l3_latency, parse_policy(g_config.l3_policy_str));
-    if (g_config.use_l4)
-        g_l4 = init_cache_level(g_config.l4_size, g_config.l4_assoc, g_config.l4_line,
-                                g_config.l4_latency, parse_policy(g_config.l4_policy_str));
-    
-    init_cache_simulator(g_l1_data, g_l1_instr, g_l2, g_l3, g_l4);
-    g_counting = 0;
+void reset_policy_learning(CacheLevel *cache) {
+    cache->psel = PSEL_MAX / 2;
+    if (cache->ship) {
+        // lines of unknown origin count as reused, so their evictions teach nothing
+        for (unsigned long i = 0; i < cache->num_sets * cache->associativity; i++)
+            cache->ship[i] = SHIP_REUSED;
+        // weakly reused: a signature's first lines are inserted as SRRIP would
+        memset(cache->shct, 1, SHIP_SHCT_SIZE);
+    }
 }
 
-void start(void) {
-    g_mem_accesses = 0;
-    g_instr_accesses = 0;
-    g_data_accesses = 0;
-    g_total_latency_instr = 0;
-    g_total_latency_data = 0;
-    g_current_time = 0;
-    g_counting = 1;
+static inline CacheSet cache_set(CacheLevel *cache, unsigned long set_index) {
+    CacheSet set;
+    set.num_lines = cache->associativity;
+    set.tags = cache->tags + set_index * cache->associativity;
+    set.valid = cache->valid + set_index * cache->valid_words;
+    set.last_access_time = cache->ages ? cache->ages + set_index * cache->associativity : NULL;
+    set.plru = cache->plru ? cache->plru + set_index : NULL;
+    set.rrpv = cache->rrpv ? cache->rrpv + set_index * cache->associativity : NULL;
+    set.ship = cache->ship ? cache->ship + set_index * cache->associativity : NULL;
+    set.index = set_index;
+    set.level = cache;
+    return set;
+}
 
-    l1_data_accesses_stats = l1_data_hits_stats = 0;
-    l1_instr_accesses_stats = l1_instr_hits_stats = 0;
-    l2_accesses_stats = l2_hits_stats = 0;
-    l3_accesses_stats = l3_hits_stats = 0;
-    l4_accesses_stats = l4_hits_stats = 0;
+// matching valid way for ref, or WAY_NONE
+static inline unsigned long find_way(const CacheLevel *cache, const SetRef *ref) {
+    const unsigned int *tags = cache->tags + ref->index * cache->associativity;
+    const uint64_t *valid = cache->valid + ref->index * cache->valid_words;
+    if (cache->associativity <= 64) {
+        uint64_t hits = cache->match_ways(tags, cache->associativity, ref->tag) & valid[0];
+        return hits ? (unsigned long)__builtin_ctzll(hits) : WAY_NONE;
+    }
+    for (unsigned long base = 0; base < cache->associativity; base += 64) {
+        unsigned long n = cache->associativity - base < 64 ? cache->associativity - base : 64;
+        uint64_t hits = cache->match_ways(tags + base, n, ref->tag) & valid[base / 64];
+        if (hits)
+            return base + __builtin_ctzll(hits);
+    }
+    return WAY_NONE;
 }
 
-void end(void) {
-    FILE *fp = fopen("results.log", "a");
-    if (!fp) {
-        perror("fopen");
-        exit(1);
+static inline void fill_line(CacheLevel *cache, const SetRef *ref, unsigned long victim) {
+    cache->evicted_valid = (cache->valid[ref->index * cache->valid_words + victim / 64] >> (victim % 64)) & 1;
+    cache->evicted_tag = cache->tags[ref->index * cache->associativity + victim];
+    cache->evicted_way = victim;
+    cache->tags[ref->index * cache->associativity + victim] = ref->tag;
+    cache->valid[ref->index * cache->valid_words + victim / 64] |= (uint64_t)1 << (victim % 64);
+}
+
+static inline void clear_line(CacheLevel *cache, const SetRef *ref, unsigned long way) {
+    cache->valid[ref->index * cache->valid_words + way / 64] &= ~((uint64_t)1 << (way % 64));
+}
+
+// kernels for levels without a specialized pair in kernels.c
+unsigned long probe_generic(SimContext *ctx, CacheLevel *cache, SetRef *ref) {
+    unsigned long way = find_way(cache, ref);
+    if (way != WAY_NONE) {
+        CacheSet set = cache_set(cache, ref->index);
+        cache->update_policy(ctx, &set, way, POLICY_HIT);
     }
-    
-    fprintf(fp, "--- Simulation Statistics ---\n");
-    fprintf(fp, "Total memory accesses: %lu\n", g_mem_accesses);
-    if (g_instr_accesses > 0)
-        fprintf(fp, "Instruction accesses: average latency = %.2f cycles\n", (double)g_total_latency_instr / g_instr_accesses);
-    else
-        fprintf(fp, "Instruction accesses: none\n");
-    if (g_data_accesses > 0)
-        fprintf(fp, "Data accesses: average latency = %.2f cycles\n", (double)g_total_latency_data / g_data_accesses);
-    else
-        fprintf(fp, "Data accesses: none\n");
+    return way;
+}
 
-    fprintf(fp, "\n--- Cache Miss Rates ---\n");
-    if (l1_instr_accesses_stats > 0)
-        fprintf(fp, "L1 Instruction: %.2f%% misses\n", 100.0 * (l1_instr_accesses_stats - l1_instr_hits_stats) / l1_instr_accesses_stats);
-    if (l1_data_accesses_stats > 0)
-        fprintf(fp, "L1 Data: %.2f%% misses\n", 100.0 * (l1_data_accesses_stats - l1_data_hits_stats) / l1_data_accesses_stats);
-    if (l2_accesses_stats > 0)
-        fprintf(fp, "L2: %.2f%% misses\n", 100.0 * (l2_accesses_stats - l2_hits_stats) / l2_accesses_stats);
-    if (l3_accesses_stats > 0)
-        fprintf(fp, "L3: %.2f%% misses\n", 100.0 * (l3_accesses_stats - l3_hits_stats) / l3_accesses_stats);
-    if (l4_accesses_stats > 0)
-        fprintf(fp, "L4: %.2f%% misses\n", 100.0 * (l4_accesses_stats - l4_hits_stats) / l4_accesses_stats);
-    
-    fprintf(fp, "\n--- Replacement Policy ---\n");
-    if (g_l1_instr)
-        fprintf(fp, "L1 Instruction: %s\n", (g_l1_instr->policy == POLICY_LRU) ? "LRU" : ((g_l1_instr->policy == POLICY_BIP) ? "BIP" : "RANDOM"));
-    if (g_l1_data)
-        fprintf(fp, "L1 Data: %s\n", (g_l1_data->policy == POLICY_LRU) ? "LRU" : ((g_l1_data->policy == POLICY_BIP) ? "BIP" : "RANDOM"));
-    if (g_l2)
-        fprintf(fp, "L2: %s\n", (g_l2->policy == POLICY_LRU) ? "LRU" : ((g_l2->policy == POLICY_BIP) ? "BIP" : "RANDOM"));
-    if (g_l3)
-        fprintf(fp, "L3: %s\n", (g_l3->policy == POLICY_LRU) ? "LRU" : ((g_l3->policy == POLICY_BIP) ? "BIP" : "RANDOM"));
-    if (g_l4)
-        fprintf(fp, "L4: %s\n", (g_l4->policy == POLICY_LRU) ? "LRU" : ((g_l4->policy == POLICY_BIP) ? "BIP" : "RANDOM"));
-    
-    fclose(fp);
-    g_counting = 0;
+void fill_generic(SimContext *ctx, CacheLevel *cache, SetRef *ref) {
+    CacheSet set = cache_set(cache, ref->index);
+    unsigned long victim = cache->find_victim(ctx, &set);
+    fill_line(cache, ref, victim);
+    cache->update_policy(ctx, &set, victim, POLICY_FILL);
 }
 
-void deinit(void) {
-    if (g_l1_data) { free_cache_level(g_l1_data); g_l1_data = NULL; }
-    if (g_l1_instr) { free_cache_level(g_l1_instr); g_l1_instr = NULL; }
-    if (g_l2) { free_cache_level(g_l2); g_l2 = NULL; }
-    if (g_l3) { free_cache_level(g_l3); g_l3 = NULL; }
-    if (g_l4) { free_cache_level(g_l4); g_l4 = NULL; }
+static const char *policy_name(ReplacementPolicy policy) {
+    switch (policy) {
+        case POLICY_LRU:    return "LRU";
+        case POLICY_BIP:    return "BIP";
+        case POLICY_RANDOM: return "RANDOM";
+        case POLICY_PLRU_TREE: return "PLRU_TREE";
+        case POLICY_PLRU_BIT: return "PLRU_BIT";
+        case POLICY_SRRIP:  return "SRRIP";
+        case POLICY_BRRIP:  return "BRRIP";
+        case POLICY_DRRIP:  return "DRRIP";
+        case POLICY_SHIP:   return "SHIP";
+        case POLICY_DIP:    return "DIP";
+    }
+    return "LRU";
 }
 
-unsigned long simulate_memory_access(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
-    if (!g_counting) 
-    return 0;  // simulator inactive
-    g_current_time++;
-    unsigned long latency = 0;
-    
-    CacheLevel *l1 = (access_type == 1 ? g_l1_instr : g_l1_data);
-    
-    // l1 check
-    if (l1 != NULL) {
-        unsigned long l1_set_index = (vaddr / l1->line_size) % l1->num_sets;
-        unsigned int l1_tag = vaddr / (l1->line_size * l1->num_sets);
-        CacheSet *l1_set = &l1->sets[l1_set_index];
-        
-        if (access_type == 1)
-            l1_instr_accesses_stats++;
-        else
-            l1_data_accesses_stats++;
-        
-        for (unsigned long i = 0; i < l1_set->num_lines; i++) {
-            if (l1_set->lines[i].valid && l1_set->lines[i].tag == l1_tag) {
-                l1->update_policy(l1_set, i);
-                latency += l1->access_latency;
-                if (access_type == 1)
-                    l1_instr_hits_stats++;
-                else
-                    l1_data_hits_stats++;
-                goto DONE; // couldnt think of a better way to avoid goto statement
-            }
+static inline CacheLevel *get_level(SimContext *ctx, unsigned long n, unsigned long side) {
+    return ctx->levels[n - 1][side];
+}
+
+// Picks about `sets` of the level's sets to simulate: every (num_sets / sets)th set for
+// STRIDE, otherwise the sets whose hashed index falls below sets / num_sets.
+static void sample_level(CacheLevel *cache, unsigned long sets, const char *mode, uint64_t seed) {
+    if (sets == 0 || sets >= cache->num_sets)
+        return;
+    cache->sample_bits = calloc((cache->num_sets + 63) / 64, sizeof(uint64_t));
+    cache->set_samples = calloc(cache->num_sets, sizeof(SetSample));
+    if (!cache->sample_bits || !cache->set_samples) { perror("calloc"); exit(1); }
+
+    int stride = strcmp(mode, "STRIDE") == 0;
+    unsigned long step = cache->num_sets / sets;
+    for (unsigned long i = 0; i < cache->num_sets; i++) {
+        int take;
+        if (stride) {
+            take = i % step == 0;
+        } else {
+            uint64_t h = (i ^ seed) + 0x9E3779B97F4A7C15ULL; // splitmix64 finalizer
+            h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+            h ^= h >> 31;
+            take = h % cache->num_sets < sets;
+        }
+        if (take) {
+            cache->sample_bits[i / 64] |= (uint64_t)1 << (i % 64);
+            cache->sampled_sets++;
         }
-        latency += l1->access_latency;
     }
-    
-    // l2 check
-    if (g_l2 != NULL) {
-        l2_accesses_stats++;
-        unsigned long l2_set_index = (paddr / g_l2->line_size) % g_l2->num_sets;
-        unsigned int l2_tag = paddr / (g_l2->line_size * g_l2->num_sets);
-        CacheSet *l2_set = &g_l2->sets[l2_set_index];
-        unsigned long hit_in_l2 = 0;
-        for (unsigned long i = 0; i < l2_set->num_lines; i++) {
-            if (l2_set->lines[i].valid && l2_set->lines[i].tag == l2_tag) {
-                g_l2->update_policy(l2_set, i);
-                latency += g_l2->access_latency;
-                hit_in_l2 = 1;
-                l2_hits_stats++;
-                break;
-            }
+}
+
+// Checks a multi-core configuration: the private levels have to come first and share one
+// line size, the unit of coherence. Sampling assumes a single access stream and is turned off.
+static void check_cores(CacheConfig *config) {
+    if (config->cores <= 1) {
+        config->cores = 1;
+        return;
+    }
+    if (config->cores > MAX_CORES) {
+        fprintf(stderr, "CORES=%lu: at most %d cores are supported\n", config->cores, MAX_CORES);
+        exit(1);
+    }
+    unsigned long private_line = 0, sampled = config->sample_period != 0;
+    int shared_above = 0;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        LevelConfig *lc = &config->levels[n];
+        if (!lc->use)
+            continue;
+        if (lc->shared) {
+            shared_above = 1;
+            continue;
         }
-        if (!hit_in_l2)
-            latency += g_l2->access_latency;
-        if (hit_in_l2) { // elevate data
-            if (l1 != NULL) {
-                unsigned long victim_l1 = l1->find_victim(&l1->sets[(paddr / l1->line_size) % l1->num_sets]);
-                CacheSet *l1_set = &l1->sets[(paddr / l1->line_size) % l1->num_sets];
-                l1_set->lines[victim_l1].tag = paddr / (l1->line_size * l1->num_sets);
-                l1_set->lines[victim_l1].valid = 1;
-                l1_set->lines[victim_l1].last_access_time = g_current_time;
-            }
-            goto DONE;
+        if (shared_above) {
+            fprintf(stderr, "L%lu is private to each core but lies below a shared level\n", n + 1);
+            exit(1);
         }
-    }
-    
-    // l3 check
-    if (g_l3 != NULL) {
-        l3_accesses_stats++;
-        unsigned long l3_set_index = (paddr / g_l3->line_size) % g_l3->num_sets;
-        unsigned int l3_tag = paddr / (g_l3->line_size * g_l3->num_sets);
-        CacheSet *l3_set = &g_l3->sets[l3_set_index];
-        unsigned long hit_in_l3 = 0;
-        for (unsigned long i = 0; i < l3_set->num_lines; i++) {
-            if (l3_set->lines[i].valid && l3_set->lines[i].tag == l3_tag) {
-                g_l3->update_policy(l3_set, i);
-                latency += g_l3->access_latency;
-                hit_in_l3 = 1;
-                l3_hits_stats++;
-                break;
-            }
+        if (strcmp(lc->prefetcher_str, "NONE") != 0) {
+            fprintf(stderr, "Warning: L%lu is private to each core, its prefetcher is turned off.\n", n + 1);
+            snprintf(lc->prefetcher_str, sizeof(lc->prefetcher_str), "NONE");
         }
-        if (!hit_in_l3)
-            latency += g_l3->access_latency;
-        if (hit_in_l3) { // elevate data
-            if (g_l2 != NULL) {
-                unsigned long victim_l2 = g_l2->find_victim(&g_l2->sets[(paddr / g_l2->line_size) % g_l2->num_sets]);
-                CacheSet *l2_set = &g_l2->sets[(paddr / g_l2->line_size) % g_l2->num_sets];
-                l2_set->lines[victim_l2].tag = paddr / (g_l2->line_size * g_l2->num_sets);
-                l2_set->lines[victim_l2].valid = 1;
-                l2_set->lines[victim_l2].last_access_time = g_current_time;
-            }
-            if (l1 != NULL) {
-                unsigned long victim_l1 = l1->find_victim(&l1->sets[(paddr / l1->line_size) % l1->num_sets]);
-                CacheSet *l1_set = &l1->sets[(paddr / l1->line_size) % l1->num_sets];
-                l1_set->lines[victim_l1].tag = paddr / (l1->line_size * l1->num_sets);
-                l1_set->lines[victim_l1].valid = 1;
-                l1_set->lines[victim_l1].last_access_time = g_current_time;
-            }
-            goto DONE;
+        if (private_line && lc->line != private_line) {
+            fprintf(stderr, "private levels need one line size, L%lu has %lu instead of %lu\n", n + 1, lc->line,
+                    private_line);
+            exit(1);
         }
+        private_line = lc->line;
     }
-    
-    // l4 check
-    if (g_l4 != NULL) {
-        l4_accesses_stats++;
-        unsigned long l4_set_index = (paddr / g_l4->line_size) % g_l4->num_sets;
-        unsigned int l4_tag = paddr / (g_l4->line_size * g_l4->num_sets);
-        CacheSet *l4_set = &g_l4->sets[l4_set_index];
-        unsigned long hit_in_l4 = 0;
-        for (unsigned long i = 0; i < l4_set->num_lines; i++) {
-            if (l4_set->lines[i].valid && l4_set->lines[i].tag == l4_tag) {
-                g_l4->update_policy(l4_set, i);
-                latency += g_l4->access_latency;
-                hit_in_l4 = 1;
-                l4_hits_stats++;
-                break;
-            }
+    if (!private_line) {
+        fprintf(stderr, "Warning: CORES=%lu but every level is shared, simulating one core.\n", config->cores);
+        config->cores = 1;
+        return;
+    }
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        sampled |= config->levels[n].use && config->levels[n].sample_sets;
+        config->levels[n].sample_sets = 0;
+    }
+    if (sampled)
+        fprintf(stderr, "Warning: sampling is not supported with CORES > 1, simulating every access.\n");
+    config->sample_period = 0;
+}
+
+// The first level has nothing above it to be exclusive of, and an inclusive level has to
+// take the store misses the levels above it allocate.
+static void check_inclusion(CacheConfig *config) {
+    int first = 1;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        LevelConfig *lc = &config->levels[n];
+        if (!lc->use)
+            continue;
+        if (first && lc->inclusion == INCLUSION_EXCLUSIVE) {
+            fprintf(stderr, "Warning: L%lu is the first level and cannot be exclusive, using NINE.\n", n + 1);
+            lc->inclusion = INCLUSION_NINE;
         }
-        if (!hit_in_l4)
-            latency += g_l4->access_latency;
-        if (hit_in_l4) {
-            if (g_l3 != NULL) {
-                unsigned long victim_l3 = g_l3->find_victim(&g_l3->sets[(paddr / g_l3->line_size) % g_l3->num_sets]);
-                CacheSet *l3_set = &g_l3->sets[(paddr / g_l3->line_size) % g_l3->num_sets];
-                l3_set->lines[victim_l3].tag = paddr / (g_l3->line_size * g_l3->num_sets);
-                l3_set->lines[victim_l3].valid = 1;
-                l3_set->lines[victim_l3].last_access_time = g_current_time;
-            }
-            if (g_l2 != NULL) {
-                unsigned long victim_l2 = g_l2->find_victim(&g_l2->sets[(paddr / g_l2->line_size) % g_l2->num_sets]);
-                CacheSet *l2_set = &g_l2->sets[(paddr / g_l2->line_size) % g_l2->num_sets];
-                l2_set->lines[victim_l2].tag = paddr / (g_l2->line_size * g_l2->num_sets);
-                l2_set->lines[victim_l2].valid = 1;
-                l2_set->lines[victim_l2].last_access_time = g_current_time;
-            }
-            if (l1 != NULL) {
-                unsigned long victim_l1 = l1->find_victim(&l1->sets[(paddr / l1->line_size) % l1->num_sets]);
-                CacheSet *l1_set = &l1->sets[(paddr / l1->line_size) % l1->num_sets];
-                l1_set->lines[victim_l1].tag = paddr / (l1->line_size * l1->num_sets);
-                l1_set->lines[victim_l1].valid = 1;
-                l1_set->lines[victim_l1].last_access_time = g_current_time;
-            }
-            goto DONE;
+        if (lc->inclusion == INCLUSION_INCLUSIVE && !lc->write_allocate) {
+            fprintf(stderr, "Warning: L%lu is inclusive, so it write-allocates.\n", n + 1);
+            lc->write_allocate = 1;
         }
+        first = 0;
     }
-    
-    // if here, no cache hit, go to main memory
-    latency += g_config.mem_latency;
-    if (g_l4 != NULL) {
-        unsigned long l4_set_index = (paddr / g_l4->line_size) % g_l4->num_sets;
-        unsigned int l4_tag = paddr / (g_l4->line_size * g_l4->num_sets);
-        CacheSet *l4_set = &g_l4->sets[l4_set_index];
-        unsigned long victim_l4 = g_l4->find_victim(l4_set);
-        l4_set->lines[victim_l4].tag = l4_tag;
-        l4_set->lines[victim_l4].valid = 1;
-        l4_set->lines[victim_l4].last_access_time = g_current_time;
-    }
-    if (g_l3 != NULL) {
-        unsigned long l3_set_index = (paddr / g_l3->line_size) % g_l3->num_sets;
-        unsigned int l3_tag = paddr / (g_l3->line_size * g_l3->num_sets);
-        CacheSet *l3_set = &g_l3->sets[l3_set_index];
-        unsigned long victim_l3 = g_l3->find_victim(l3_set);
-        l3_set->lines[victim_l3].tag = l3_tag;
-        l3_set->lines[victim_l3].valid = 1;
-        l3_set->lines[victim_l3].last_access_time = g_current_time;
-    }
-    if (g_l2 != NULL) {
-        unsigned long l2_set_index = (paddr / g_l2->line_size) % g_l2->num_sets;
-        unsigned int l2_tag = paddr / (g_l2->line_size * g_l2->num_sets);
-        CacheSet *l2_set = &g_l2->sets[l2_set_index];
-        unsigned long victim_l2 = g_l2->find_victim(l2_set);
-        l2_set->lines[victim_l2].tag = l2_tag;
-        l2_set->lines[victim_l2].valid = 1;
-        l2_set->lines[victim_l2].last_access_time = g_current_time;
-    }
-    if (l1 != NULL) {
-        unsigned long l1_set_index = (paddr / l1->line_size) % l1->num_sets;
-        unsigned int l1_tag = paddr / (l1->line_size * l1->num_sets);
-        CacheSet *l1_set = &l1->sets[l1_set_index];
-        unsigned long victim_l1 = l1->find_victim(l1_set);
-        l1_set->lines[victim_l1].tag = l1_tag;
-        l1_set->lines[victim_l1].valid = 1;
-        l1_set->lines[victim_l1].last_access_time = g_current_time;
+}
+
+// The TLBs and the page walker belong to a single core.
+static void check_tlb(CacheConfig *config) {
+    if (config->use_tlb && config->cores > 1) {
+        fprintf(stderr, "Warning: USE_TLB is not supported with CORES > 1, translating for free instead.\n");
+        config->use_tlb = 0;
     }
-    
-DONE:
-    if (g_counting) {
-        if (access_type == 1) {
-            g_total_latency_instr += latency;
-            g_instr_accesses++;
-        } else {
-            g_total_latency_data += latency;
-            g_data_accesses++;
-        }
-        g_mem_accesses++;
+}
+
+static void check_intervals(CacheConfig *config) {
+    if (config->interval_accesses && config->interval_cycles) {
+        fprintf(stderr, "Warning: both INTERVAL_ACCESSES and INTERVAL_CYCLES set, using INTERVAL_ACCESSES.\n");
+        config->interval_cycles = 0;
+    }
+    if ((config->interval_accesses || config->interval_cycles) && config->sample_period) {
+        fprintf(stderr, "Warning: interval statistics are not supported with SAMPLE_PERIOD, turning them off.\n");
+        config->interval_accesses = config->interval_cycles = 0;
     }
-    
-    return latency;
 }
 
-unsigned long simulate_prefetch(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
-    if (!g_counting) 
-      return 0;  // simulator inactive
-    g_current_time++;
-    unsigned long latency = 0;
-    CacheLevel *l1 = (access_type == 1 ? g_l1_instr : g_l1_data);
-    if (l1 == NULL)
-        return 0;
-    
-    unsigned long l1_set_index = (paddr / l1->line_size) % l1->num_sets;
-    unsigned int l1_tag = paddr / (l1->line_size * l1->num_sets);
-    CacheSet *l1_set = &l1->sets[l1_set_index];
-    
-    for (unsigned long i = 0; i < l1_set->num_lines; i++) {
-        if (l1_set->lines[i].valid && l1_set->lines[i].tag == l1_tag)
-            return 0; // already there
+// The timing model follows one access stream, and a level needs an MSHR to miss at all.
+static void check_timing(CacheConfig *config) {
+    if (!config->issue_window)
+        return;
+    if (config->cores > 1) {
+        fprintf(stderr, "Warning: ISSUE_WINDOW is not supported with CORES > 1, adding up latencies instead.\n");
+        config->issue_window = 0;
+        return;
     }
-    
-    if (g_l2 != NULL) {
-        unsigned long l2_set_index = (paddr / g_l2->line_size) % g_l2->num_sets;
-        CacheSet *l2_set = &g_l2->sets[l2_set_index];
-        unsigned long hit_in_l2 = 0;
-        for (unsigned long i = 0; i < l2_set->num_lines; i++) {
-            if (l2_set->lines[i].valid && l2_set->lines[i].tag == (paddr / (g_l2->line_size * g_l2->num_sets))) {
-                g_l2->update_policy(l2_set, i);
-                latency += g_l2->access_latency;
-                hit_in_l2 = 1;
-                break;
-            }
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        LevelConfig *lc = &config->levels[n];
+        if (lc->use && lc->mshrs == 0) {
+            fprintf(stderr, "Warning: L%lu_MSHRS=0, using 1.\n", n + 1);
+            lc->mshrs = 1;
         }
-        if (!hit_in_l2)
-            latency += g_l2->access_latency;
     }
-    
-    unsigned long victim_l1 = l1->find_victim(l1_set);
-    l1_set->lines[victim_l1].tag = l1_tag;
-    l1_set->lines[victim_l1].valid = 1;
-    l1_set->lines[victim_l1].last_access_time = g_current_time;
-    latency += l1->access_latency;
-    return latency;
 }
 
+// unknown prefetcher names are turned off once, before any level is created
+static void check_prefetchers(CacheConfig *config) {
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        LevelConfig *lc = &config->levels[n];
+        if (lc->use && prefetcher_kind(lc->prefetcher_str) == PREFETCHER_NUM_KINDS) {
+            fprintf(stderr, "Warning: unknown L%lu_PREFETCHER %s, using none.\n", n + 1, lc->prefetcher_str);
+            snprintf(lc->prefetcher_str, sizeof(lc->prefetcher_str), "NONE");
+        }
+    }
+}
 
-static void flush_cache_line(CacheLevel *cache, unsigned long paddr) {
-    if (cache == NULL)
+static void attach_prefetcher(CacheLevel *cache, const LevelConfig *lc) {
+    PrefetcherKind kind = prefetcher_kind(lc->prefetcher_str);
+    if (kind == PREFETCHER_NONE || kind == PREFETCHER_NUM_KINDS)
         return;
-    unsigned long set_index = (paddr / cache->line_size) % cache->num_sets;
-    unsigned int tag = paddr / (cache->line_size * cache->num_sets);
-    CacheSet *set = &cache->sets[set_index];
-    for (unsigned long i = 0; i < set->num_lines; i++) {
-        if (set->lines[i].valid && set->lines[i].tag == tag) {
-            set->lines[i].valid = 0;
-            break;
+    cache->prefetcher = prefetcher_create(kind, cache->line_size, lc->prefetch_degree);
+    cache->prefetched = alloc_tag_store(sizeof(uint64_t) * cache->num_sets * cache->valid_words);
+    cache->prefetch_ready = alloc_tag_store(sizeof(unsigned long) * cache->num_sets * cache->associativity);
+    cache->pollution_filter = alloc_tag_store(sizeof(uint64_t) << POLLUTION_FILTER_BITS);
+}
+
+static void attach_mshrs(CacheLevel *cache, unsigned long mshrs) {
+    cache->mshrs = mshrs;
+    cache->mshr = calloc(mshrs, sizeof(Mshr));
+    if (!cache->mshr) { perror("calloc"); exit(1); }
+}
+
+// level n of one core, instruction side the same level unless split
+static void create_level(const LevelConfig *lc, unsigned long n, CacheLevel **pair) {
+    ReplacementPolicy policy = parse_policy(lc->policy_str);
+    pair[0] = init_cache_level(lc->size, lc->assoc, lc->line, lc->latency, policy);
+    pair[1] = lc->split ? init_cache_level(lc->size, lc->assoc, lc->line, lc->latency, policy) : pair[0];
+    attach_prefetcher(pair[0], lc);
+    if (pair[1] != pair[0])
+        attach_prefetcher(pair[1], lc);
+    pair[0]->write_through = pair[1]->write_through = lc->write_through;
+    pair[0]->write_allocate = pair[1]->write_allocate = lc->write_allocate;
+    pair[0]->inclusion = pair[1]->inclusion = lc->inclusion;
+    pair[0]->shared = pair[1]->shared = lc->shared;
+    // L1 is looked up with the virtual address
+    pair[0]->vaddr_indexed = pair[1]->vaddr_indexed = (n == 0);
+}
+
+// core c's view: core 0 and shared levels are the context's, private ones its own copies
+static void create_core(SimContext *ctx, unsigned long c) {
+    SimCore *core = &ctx->cores[c];
+    unsigned long len = 0;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        const LevelConfig *lc = &ctx->config.levels[n];
+        if (!lc->use)
+            continue;
+        if (c == 0 || lc->shared) {
+            core->levels[n][0] = ctx->levels[n][0];
+            core->levels[n][1] = ctx->levels[n][1];
+        } else {
+            create_level(lc, n, core->levels[n]);
+            core->levels[n][0]->owner = core->levels[n][1]->owner = c;
+        }
+        if (!lc->shared) {
+            core->private_caches[core->num_private++] = core->levels[n][0];
+            if (core->levels[n][1] != core->levels[n][0])
+                core->private_caches[core->num_private++] = core->levels[n][1];
+            if (c == 0) {
+                ctx->private_levels++;
+                ctx->coherence_line = lc->line;
+            }
         }
+        core->path[0][len] = core->levels[n][0];
+        core->path[1][len] = core->levels[n][1];
+        core->levels[n][0]->depth = core->levels[n][1]->depth = len;
+        len++;
+    }
+    // a unified level above a split one writes back to the data side
+    for (unsigned long side = 2; side-- > 0;) {
+        for (unsigned long i = 0; i < len; i++)
+            core->path[side][i]->below = i + 1 < len ? core->path[side][i + 1] : NULL;
     }
 }
 
-void flush_instruction(unsigned long paddr) {
-    if (!g_counting) return;
-    flush_cache_line(g_l1_instr, paddr);
-    flush_cache_line(g_l2, paddr);
-    flush_cache_line(g_l3, paddr);
-    flush_cache_line(g_l4, paddr);
-}
+// Interval statistics. Each row starts with INTERVAL_POSITION_FIELDS that say where it
+// ends; the other fields are running totals, and a row holds what they gained since the
+// row before.
+#define INTERVAL_POSITION_FIELDS 3
 
-void flush_data(unsigned long paddr) {
-    if (!g_counting) return;
-    flush_cache_line(g_l1_data, paddr);
-    flush_cache_line(g_l2, paddr);
-    flush_cache_line(g_l3, paddr);
-    flush_cache_line(g_l4, paddr);
+typedef struct {
+    unsigned long *values;
+    char (*names)[INTERVAL_NAME_SIZE]; // NULL when not naming them
+    unsigned long n;
+} IntervalFields;
+
+static void interval_field(IntervalFields *f, const char *prefix, const char *name, unsigned long value) {
+    if (f->names)
+        snprintf(f->names[f->n], INTERVAL_NAME_SIZE, "%s%s", prefix, name);
+    if (f->values)
+        f->values[f->n] = value;
+    f->n++;
 }
 
-void invalidate(unsigned long paddr) {
-    if (!g_counting) return;
-    if (g_l1_instr) { flush_cache_line(g_l1_instr, paddr); }
-    if (g_l1_data) { flush_cache_line(g_l1_data, paddr); }
-    if (g_l2)      { flush_cache_line(g_l2, paddr); }
-    if (g_l3)      { flush_cache_line(g_l3, paddr); }
-    if (g_l4)      { flush_cache_line(g_l4, paddr); }
+// whether level n or one above it is set-sampled, so that its write traffic covers the
+// sampled stream only
+static int write_counts_sampled(const SimContext *ctx, unsigned long n) {
+    for (unsigned long m = 0; m <= n; m++) {
+        if (ctx->levels[m][0] && (ctx->levels[m][0]->sample_bits || ctx->levels[m][1]->sample_bits))
+            return 1;
+    }
+    return 0;
 }
 
-void invalidate_all(void) {
-    if (!g_counting) return;
-    unsigned long i, j;
-    if (g_l1_instr) {
-        for (i = 0; i < g_l1_instr->num_sets; i++)
-            for (j = 0; j < g_l1_instr->sets[i].num_lines; j++)
-                g_l1_instr->sets[i].lines[j].valid = 0;
+// the fields of a row, from the stats of ctx in s; which ones depends on the configuration only
+static void interval_fields(const SimContext *ctx, const SimStats *s, IntervalFields *f) {
+    unsigned long cycles = *ctx->cycle_clock;
+    interval_field(f, "", "interval", ctx->interval_rows);
+    interval_field(f, "", "end_access", ctx->mem_accesses);
+    interval_field(f, "", "end_cycle", cycles);
+    interval_field(f, "", "accesses", s->mem_accesses);
+    interval_field(f, "", "cycles", cycles);
+    interval_field(f, "", "instr_accesses", s->instr_accesses);
+    interval_field(f, "", "data_accesses", s->data_accesses);
+    interval_field(f, "", "instr_latency", s->total_latency_instr);
+    interval_field(f, "", "data_latency", s->total_latency_data);
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        for (unsigned long side = 0; side < 2; side++) {
+            const CacheLevel *cache = ctx->levels[n][side];
+            int split = ctx->levels[n][1] != ctx->levels[n][0];
+            if (!cache || (side && !split))
+                continue;
+            char prefix[16];
+            snprintf(prefix, sizeof(prefix), split ? (side ? "L%luI_" : "L%luD_") : "L%lu_", n + 1);
+            interval_field(f, prefix, "accesses", s->level_accesses[n][side]);
+            interval_field(f, prefix, "hits", s->level_hits[n][side]);
+            if (!write_counts_sampled(ctx, n))
+                interval_field(f, prefix, "writebacks", s->level_writebacks[n][side]);
+            if (cache->prefetcher) {
+                interval_field(f, prefix, "prefetches", s->level_prefetch[n][side].issued);
+                interval_field(f, prefix, "prefetch_hits", s->level_prefetch[n][side].useful);
+            }
+            if (ctx->config.issue_window)
+                interval_field(f, prefix, "mshr_stalls", s->level_mshr_stalls[n][side]);
+        }
     }
-    if (g_l1_data) {
-        for (i = 0; i < g_l1_data->num_sets; i++)
-            for (j = 0; j < g_l1_data->sets[i].num_lines; j++)
-                g_l1_data->sets[i].lines[j].valid = 0;
+    if (!ctx->sampling) {
+        interval_field(f, "", "mem_read_bytes", s->mem_read_bytes);
+        interval_field(f, "", "mem_write_bytes", s->mem_write_bytes);
     }
-    if (g_l2) {
-        for (i = 0; i < g_l2->num_sets; i++)
-            for (j = 0; j < g_l2->sets[i].num_lines; j++)
-                g_l2->sets[i].lines[j].valid = 0;
+    if (ctx->dram) {
+        interval_field(f, "", "dram_reads", s->dram.reads);
+        interval_field(f, "", "dram_writes", s->dram.writes);
+        interval_field(f, "", "dram_row_hits", s->dram.row_hits);
     }
-    if (g_l3) {
-        for (i = 0; i < g_l3->num_sets; i++)
-            for (j = 0; j < g_l3->sets[i].num_lines; j++)
-                g_l3->sets[i].lines[j].valid = 0;
+    if (ctx->mmu) {
+        const TlbStats *t = s->mmu.tlb;
+        interval_field(f, "", "itlb_misses", t[TLB_ITLB].accesses - t[TLB_ITLB].hits);
+        interval_field(f, "", "dtlb_misses", t[TLB_DTLB].accesses - t[TLB_DTLB].hits);
+        interval_field(f, "", "stlb_misses", t[TLB_STLB].accesses - t[TLB_STLB].hits);
+        interval_field(f, "", "page_walks", s->mmu.walks);
+        interval_field(f, "", "walk_cycles", s->mmu.walk_cycles);
     }
-    if (g_l4) {
-        for (i = 0; i < g_l4->num_sets; i++)
-            for (j = 0; j < g_l4->sets[i].num_lines; j++)
-                g_l4->sets[i].lines[j].valid = 0;
+    if (ctx->num_cores > 1) {
+        interval_field(f, "", "invalidations", s->invalidations);
+        interval_field(f, "", "coherence_misses", s->coherence_misses);
+        interval_field(f, "", "c2c_transfers", s->c2c_transfers);
     }
 }
 
+// opens the log and takes the running totals the first row starts from
+static void interval_start(SimContext *ctx) {
+    if (ctx->intervals)
+        interval_close(ctx->intervals);
+    char (*names)[INTERVAL_NAME_SIZE] = malloc(ctx->interval_fields * INTERVAL_NAME_SIZE);
+    if (!names) { perror("malloc"); exit(1); }
+    ctx->interval_rows = ctx->interval_stalls = 0;
+    sim_get_stats(ctx, ctx->interval_stats);
+    IntervalFields f = { ctx->interval_prev, names, 0 };
+    interval_fields(ctx, ctx->interval_stats, &f);
+    ctx->intervals = interval_open(ctx->config.interval_path, ctx->config.interval_binary, names,
+                                   ctx->interval_fields, ctx->config.interval_buffer);
+    free(names);
+    ctx->interval_next = *ctx->interval_clock + ctx->interval_period;
+}
 
-static void prefetch_into_cache(CacheLevel *cache, unsigned long paddr) {
-    if (cache == NULL) return;
-    unsigned long set_index = (paddr / cache->line_size) % cache->num_sets;
-    unsigned int tag = paddr / (cache->line_size * cache->num_sets);
-    CacheSet *set = &cache->sets[set_index];
-    for (unsigned long i = 0; i < set->num_lines; i++) {
-        if (set->lines[i].valid && set->lines[i].tag == tag)
-            return; // already there
+// hands the writer the row ending now, and sets the end of the next one
+static void interval_snapshot(SimContext *ctx) {
+    sim_get_stats(ctx, ctx->interval_stats);
+    IntervalFields f = { ctx->interval_values, NULL, 0 };
+    interval_fields(ctx, ctx->interval_stats, &f);
+    uint64_t *row = interval_slot(ctx->intervals);
+    for (unsigned long i = 0; i < ctx->interval_fields; i++) {
+        row[i] = i < INTERVAL_POSITION_FIELDS ? f.values[i] : f.values[i] - ctx->interval_prev[i];
+        ctx->interval_prev[i] = f.values[i];
     }
-    unsigned long victim = cache->find_victim(set);
-    set->lines[victim].tag = tag;
-    set->lines[victim].valid = 1;
-    set->lines[victim].last_access_time = g_current_time;
+    interval_commit(ctx->intervals);
+    ctx->interval_rows++;
+    unsigned long clock = *ctx->interval_clock;
+    if (clock >= ctx->interval_next) // a long access may skip whole intervals
+        ctx->interval_next += ((clock - ctx->interval_next) / ctx->interval_period + 1) * ctx->interval_period;
 }
 
-unsigned long simulate_prefetch_t0(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
-    if (!g_counting) return 0;
-    g_current_time++;
-    unsigned long latency = 0;
-    CacheLevel *l1 = (access_type == 1 ? g_l1_instr : g_l1_data);
-    if (l1) {
-        unsigned long set_index = (paddr / l1->line_size) % l1->num_sets;
-        unsigned int tag = paddr / (l1->line_size * l1->num_sets);
-        CacheSet *set = &l1->sets[set_index];
-        unsigned long found = 0;
-        for (unsigned long i = 0; i < set->num_lines; i++) {
-            if (set->lines[i].valid && set->lines[i].tag == tag) {
-                found = 1;
-                break;
-            }
-        }
-        if (!found) {
-            unsigned long victim = l1->find_victim(set);
-            set->lines[victim].tag = tag;
-            set->lines[victim].valid = 1;
-            set->lines[victim].last_access_time = g_current_time;
-            latency += l1->access_latency;
-        } else {
-            latency += l1->access_latency;
+// writes the last, partial row and closes the log
+static void interval_finish(SimContext *ctx) {
+    // end_access and end_cycle of the last row; under ISSUE_WINDOW the last retirement
+    // can come after it
+    if (ctx->mem_accesses != ctx->interval_prev[1] || *ctx->cycle_clock != ctx->interval_prev[2])
+        interval_snapshot(ctx);
+    ctx->interval_stalls = interval_stalls(ctx->intervals);
+    interval_close(ctx->intervals);
+    ctx->intervals = NULL;
+    ctx->interval_next = ULONG_MAX;
+}
+
+SimContext *sim_create_from_config(const CacheConfig *config) {
+    SimContext *ctx = calloc(1, sizeof(SimContext));
+    if (!ctx) { perror("calloc"); exit(1); }
+    ctx->config = *config;
+    check_prefetchers(&ctx->config);
+    check_inclusion(&ctx->config);
+    check_cores(&ctx->config);
+    check_timing(&ctx->config);
+    check_tlb(&ctx->config);
+    check_intervals(&ctx->config);
+    // a period too short for its warm-up and window has no functional warming
+    if (ctx->config.sample_period) {
+        if (ctx->config.sample_window == 0)
+            ctx->config.sample_window = 1;
+        if (ctx->config.sample_period < ctx->config.sample_warmup + ctx->config.sample_window)
+            ctx->config.sample_period = ctx->config.sample_warmup + ctx->config.sample_window;
+    }
+
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        const LevelConfig *lc = &ctx->config.levels[n];
+        if (!lc->use)
+            continue;
+        create_level(lc, n, ctx->levels[n]);
+        sample_level(ctx->levels[n][0], lc->sample_sets, lc->sample_str, ctx->config.seed);
+        if (ctx->levels[n][1] != ctx->levels[n][0])
+            sample_level(ctx->levels[n][1], lc->sample_sets, lc->sample_str, ctx->config.seed);
+        ctx->sampling |= ctx->levels[n][0]->sample_bits != NULL;
+        ctx->prefetching |= ctx->levels[n][0]->prefetcher || ctx->levels[n][1]->prefetcher;
+        if (ctx->config.issue_window) {
+            attach_mshrs(ctx->levels[n][0], lc->mshrs);
+            if (ctx->levels[n][1] != ctx->levels[n][0])
+                attach_mshrs(ctx->levels[n][1], lc->mshrs);
         }
+        ctx->path[0][ctx->path_len] = ctx->levels[n][0];
+        ctx->path[1][ctx->path_len] = ctx->levels[n][1];
+        ctx->path_len++;
     }
-    if (g_l2) {
-        prefetch_into_cache(g_l2, paddr);
-        latency += g_l2->access_latency;
+    // only sampled sets make traffic, which the extrapolated latency clock would water down
+    if (ctx->sampling && ctx->config.mem_bandwidth)
+        fprintf(stderr, "Warning: MEM_BANDWIDTH is not supported with set sampling, turning it off.\n");
+    if (ctx->sampling)
+        ctx->config.mem_bandwidth = ctx->config.bandwidth_interval = 0;
+    // until a sampled access has been seen, a filtered one is charged a miss all the way down
+    unsigned long below = ctx->config.mem_latency;
+    for (unsigned long i = ctx->path_len; i-- > 0;) {
+        ctx->path[0][i]->miss_latency = ctx->path[1][i]->miss_latency = below + ctx->path[0][i]->access_latency;
+        below += ctx->path[0][i]->access_latency;
     }
-    if (g_l3) {
-        prefetch_into_cache(g_l3, paddr);
-        latency += g_l3->access_latency;
+    ctx->num_cores = ctx->config.cores;
+    ctx->cores = calloc(ctx->num_cores, sizeof(SimCore));
+    if (!ctx->cores) { perror("calloc"); exit(1); }
+    if (ctx->config.issue_window) {
+        ctx->retire_ring = calloc(ctx->config.issue_window, sizeof(unsigned long));
+        if (!ctx->retire_ring) { perror("calloc"); exit(1); }
     }
-    return latency;
+    for (unsigned long c = 0; c < ctx->num_cores; c++)
+        create_core(ctx, c);
+    if (ctx->config.use_dram)
+        ctx->dram = dram_create(&ctx->config.dram);
+    if (ctx->config.use_tlb)
+        ctx->mmu = mmu_create(&ctx->config.mmu);
+    ctx->cycle_clock = ctx->config.issue_window ? &ctx->timed_cycles : &ctx->cycles;
+    ctx->interval_clock = ctx->config.interval_cycles ? ctx->cycle_clock : &ctx->mem_accesses;
+    ctx->interval_period = ctx->config.interval_cycles ? ctx->config.interval_cycles : ctx->config.interval_accesses;
+    ctx->interval_next = ULONG_MAX;
+    if (ctx->interval_period) {
+        ctx->interval_stats = calloc(1, sizeof(SimStats));
+        if (!ctx->interval_stats) { perror("calloc"); exit(1); }
+        IntervalFields f = { NULL, NULL, 0 };
+        interval_fields(ctx, ctx->interval_stats, &f);
+        ctx->interval_fields = f.n;
+        ctx->interval_prev = calloc(f.n, sizeof(unsigned long));
+        ctx->interval_values = calloc(f.n, sizeof(unsigned long));
+        if (!ctx->interval_prev || !ctx->interval_values) { perror("calloc"); exit(1); }
+    }
+    sim_seed(ctx, ctx->config.seed);
+    return ctx;
 }
 
-unsigned long simulate_prefetch_t1(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
-    if (!g_counting) return 0;
-    g_current_time++;
-    unsigned long latency = 0;
-    if (g_l2) {
-        prefetch_into_cache(g_l2, paddr);
-        latency += g_l2->access_latency;
+SimContext *sim_create(const char *config_path) {
+    CacheConfig config;
+    read_config(config_path, &config);
+    return sim_create_from_config(&config);
+}
+
+void sim_destroy(SimContext *ctx) {
+    if (!ctx)
+        return;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        if (ctx->levels[n][1] != ctx->levels[n][0])
+            free_cache_level(ctx->levels[n][1]);
+        free_cache_level(ctx->levels[n][0]);
     }
-    if (g_l3) {
-        prefetch_into_cache(g_l3, paddr);
-        latency += g_l3->access_latency;
+    for (unsigned long c = 1; c < ctx->num_cores; c++) {
+        for (unsigned long i = 0; i < ctx->cores[c].num_private; i++)
+            free_cache_level(ctx->cores[c].private_caches[i]);
     }
-    return latency;
+    free(ctx->cores);
+    free(ctx->retire_ring);
+    dir_free(&ctx->directory);
+    dram_destroy(ctx->dram);
+    mmu_destroy(ctx->mmu);
+    interval_close(ctx->intervals);
+    free(ctx->interval_prev);
+    free(ctx->interval_values);
+    free(ctx->interval_stats);
+    if (ctx->checkpoint_base)
+        munmap(ctx->checkpoint_base, ctx->checkpoint_length);
+    free(ctx);
 }
 
-unsigned long simulate_prefetch_t2(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
-    if (!g_counting) return 0;
-    g_current_time++;
-    unsigned long latency = 0;
-    if (g_l3) {
-        prefetch_into_cache(g_l3, paddr);
-        latency += g_l3->access_latency;
-    } else {
-        latency += g_config.mem_latency;
-    }
-    return latency;
+void sim_seed(SimContext *ctx, uint64_t seed) {
+    // splitmix64 of the seed, xorshift needs a non-zero state
+    uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    ctx->rng_state = z ? z : 1;
 }
 
-unsigned long simulate_prefetch_nta(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
-    if (!g_counting) return g_config.mem_latency;
-    g_current_time++;
-    return g_config.mem_latency;
+void sim_start(SimContext *ctx) {
+    ctx->mem_accesses = 0;
+    ctx->instr_accesses = 0;
+    ctx->data_accesses = 0;
+    ctx->total_latency_instr = 0;
+    ctx->total_latency_data = 0;
+    ctx->counting = 1; // the clock keeps running, ages in a warm (or restored) hierarchy stay ordered
+
+    for (unsigned long i = 0; i < ctx->path_len; i++) {
+        for (unsigned long side = 0; side < 2; side++) {
+            CacheLevel *cache = ctx->path[side][i];
+            cache->accesses = cache->hits = 0;
+            cache->filtered = 0;
+            memset(cache->filtered_side, 0, sizeof(cache->filtered_side));
+            memset(cache->sample_accesses, 0, sizeof(cache->sample_accesses));
+            memset(cache->sample_latency, 0, sizeof(cache->sample_latency));
+            memset(cache->filtered_charged, 0, sizeof(cache->filtered_charged));
+            if (cache->set_samples)
+                memset(cache->set_samples, 0, cache->num_sets * sizeof(SetSample));
+            memset(&cache->prefetch, 0, sizeof(cache->prefetch));
+            cache->writebacks = cache->write_throughs = 0;
+            cache->inclusion_victims = cache->victims_taken = 0;
+            cache->mshr_merges = cache->mshr_stalls = cache->mshr_stall_cycles = 0;
+        }
+    }
+    for (unsigned long c = 0; c < ctx->num_cores; c++) {
+        SimCore *core = &ctx->cores[c];
+        for (unsigned long i = 0; c > 0 && i < core->num_private; i++) {
+            CacheLevel *cache = core->private_caches[i];
+            cache->accesses = cache->hits = 0;
+            cache->writebacks = cache->write_throughs = 0;
+            cache->inclusion_victims = cache->victims_taken = 0;
+        }
+        core->accesses = core->total_latency = 0;
+    }
+    ctx->invalidations = ctx->coherence_misses = ctx->c2c_transfers = 0;
+    ctx->mem_read_bytes = ctx->mem_write_bytes = 0;
+    ctx->bw_cycles = ctx->bw_elapsed = ctx->bw_bytes = 0;
+    ctx->bw_intervals = ctx->bw_peak = ctx->bw_saturated = 0;
+    ctx->timed_cycles = 0;
+    if (ctx->dram)
+        dram_clear_stats(ctx->dram);
+    if (ctx->mmu)
+        mmu_clear_stats(ctx->mmu);
+    ctx->sw_prefetches = ctx->sw_prefetches_late = ctx->sw_prefetch_late_cycles = ctx->sw_prefetches_dropped = 0;
+
+    // a sampling period starts with its functional warming
+    ctx->phase = ctx->config.sample_period ? PHASE_WARMING : PHASE_MEASURE;
+    ctx->phase_left = ctx->config.sample_period - ctx->config.sample_warmup - ctx->config.sample_window;
+    ctx->warmed_accesses = 0;
+    memset(ctx->windows, 0, sizeof(ctx->windows));
+    if (ctx->interval_period)
+        interval_start(ctx);
 }
 
-unsigned long simulate_prefetch_w(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
-    if (!g_counting) return 0;
-    g_current_time++;
-    unsigned long latency = 0;
-    if (access_type != 0)
-        return 0;
-    if (g_l1_data) {
-        unsigned long set_index = (paddr / g_l1_data->line_size) % g_l1_data->num_sets;
-        unsigned int tag = paddr / (g_l1_data->line_size * g_l1_data->num_sets);
-        CacheSet *set = &g_l1_data->sets[set_index];
-        unsigned long found = 0;
-        for (unsigned long i = 0; i < set->num_lines; i++) {
-            if (set->lines[i].valid && set->lines[i].tag == tag) {
-                found = 1;
-                break;
-            }
+static void save_counters(const SimContext *ctx, SimCounters *saved) {
+    saved->mem_accesses = ctx->mem_accesses;
+    saved->instr_accesses = ctx->instr_accesses;
+    saved->data_accesses = ctx->data_accesses;
+    saved->total_latency_instr = ctx->total_latency_instr;
+    saved->total_latency_data = ctx->total_latency_data;
+    for (unsigned long i = 0; i < ctx->path_len; i++) {
+        for (unsigned long side = 0; side < 2; side++) {
+            const CacheLevel *cache = ctx->path[side][i];
+            saved->levels[i][side].accesses = cache->accesses;
+            saved->levels[i][side].hits = cache->hits;
+            saved->levels[i][side].filtered = cache->filtered;
+            memcpy(saved->levels[i][side].filtered_side, cache->filtered_side, sizeof(cache->filtered_side));
+            memcpy(saved->levels[i][side].filtered_charged, cache->filtered_charged, sizeof(cache->filtered_charged));
+            memcpy(saved->levels[i][side].sample_accesses, cache->sample_accesses, sizeof(cache->sample_accesses));
+            memcpy(saved->levels[i][side].sample_latency, cache->sample_latency, sizeof(cache->sample_latency));
         }
-        if (!found) {
-            unsigned long victim = g_l1_data->find_victim(set);
-            set->lines[victim].tag = tag;
-            set->lines[victim].valid = 1;
-            set->lines[victim].last_access_time = g_current_time;
-            latency += g_l1_data->access_latency;
-        } else {
-            latency += g_l1_data->access_latency;
+    }
+}
+
+// per-set sample counters are not rolled back, warm-ups leave them alone
+static void restore_counters(SimContext *ctx, const SimCounters *saved) {
+    ctx->mem_accesses = saved->mem_accesses;
+    ctx->instr_accesses = saved->instr_accesses;
+    ctx->data_accesses = saved->data_accesses;
+    ctx->total_latency_instr = saved->total_latency_instr;
+    ctx->total_latency_data = saved->total_latency_data;
+    for (unsigned long i = 0; i < ctx->path_len; i++) {
+        for (unsigned long side = 0; side < 2; side++) {
+            CacheLevel *cache = ctx->path[side][i];
+            cache->accesses = saved->levels[i][side].accesses;
+            cache->hits = saved->levels[i][side].hits;
+            cache->filtered = saved->levels[i][side].filtered;
+            memcpy(cache->filtered_side, saved->levels[i][side].filtered_side, sizeof(cache->filtered_side));
+            memcpy(cache->filtered_charged, saved->levels[i][side].filtered_charged, sizeof(cache->filtered_charged));
+            memcpy(cache->sample_accesses, saved->levels[i][side].sample_accesses, sizeof(cache->sample_accesses));
+            memcpy(cache->sample_latency, saved->levels[i][side].sample_latency, sizeof(cache->sample_latency));
         }
     }
-    return latency;
-}
\ No newline at end of file
+}
+
+static void ratio_add(RatioSums *sums, double x, double y) {
+    sums->n++;
+    sums->x += x;
+    sums->y += y;
+    sums->xx += x * x;
+    sums->yy += y * y;
+    sums->xy += x * y;
+}
+
+// adds the measured window that began at window_start to the window sums
+static void end_window(SimContext *ctx) {
+    const SimCounters *start = &ctx->window_start;
+    if (ctx->mem_accesses == start->mem_accesses)
+        return;
+    unsigned long data = ctx->data_accesses - start->data_accesses;
+    unsigned long instr = ctx->instr_accesses - start->instr_accesses;
+    unsigned long data_latency = ctx->total_latency_data - start->total_latency_data;
+    unsigned long instr_latency = ctx->total_latency_instr - start->total_latency_instr;
+    ratio_add(&ctx->windows[0], data, data_latency);
+    ratio_add(&ctx->windows[1], instr, instr_latency);
+    ratio_add(&ctx->windows[2], data + instr, data_latency + instr_latency);
+}
+
+// enters the next phase of the sampling period, called once the current one is used up
+static void next_phase(SimContext *ctx) {
+    const CacheConfig *config = &ctx->config;
+    while (ctx->phase_left == 0) {
+        switch (ctx->phase) {
+            case PHASE_WARMING:
+                save_counters(ctx, &ctx->window_start);
+                ctx->phase = PHASE_WARMUP;
+                ctx->phase_left = config->sample_warmup;
+                break;
+            case PHASE_WARMUP:
+                restore_counters(ctx, &ctx->window_start); // drops what the warm-up counted
+                ctx->phase = PHASE_MEASURE;
+                ctx->phase_left = config->sample_window;
+                break;
+            case PHASE_MEASURE:
+                end_window(ctx);
+                ctx->phase = PHASE_WARMING;
+                ctx->phase_left = config->sample_period - config->sample_warmup - config->sample_window;
+                break;
+        }
+    }
+}
+
+void sim_stop(SimContext *ctx) {
+    // close a partial window, or drop a partial warm-up
+    if (ctx->counting && ctx->config.sample_period) {
+        if (ctx->phase == PHASE_WARMUP)
+            restore_counters(ctx, &ctx->window_start);
+        else if (ctx->phase == PHASE_MEASURE)
+            end_window(ctx);
+        ctx->phase = PHASE_WARMING;
+    }
+    if (ctx->intervals)
+        interval_finish(ctx);
+    ctx->counting = 0;
+}
+
+// Total latency of a side with filtered accesses re-priced at the final sampled average
+// of their level, rather than the running average they were charged when they happened
+// (which starts out cold).
+static unsigned long sampled_total_latency(const SimContext *ctx, unsigned long side) {
+    double total = side ? ctx->total_latency_instr : ctx->total_latency_data;
+    if (!ctx->sampling)
+        return total;
+    for (unsigned long i = 0; i < ctx->path_len; i++) {
+        const CacheLevel *cache = ctx->path[side][i];
+        if (!cache->filtered_side[side] || !cache->sample_accesses[side])
+            continue;
+        total -= cache->filtered_charged[side];
+        total += (double)cache->filtered_side[side] * cache->sample_latency[side] / cache->sample_accesses[side];
+    }
+    return total + 0.5;
+}
+
+// level n's side with its access counters summed over the cores, which only adds
+// anything for the private levels of a multi-core hierarchy
+static void level_totals(const SimContext *ctx, unsigned long n, unsigned long side, CacheLevel *total) {
+    *total = *ctx->levels[n][side];
+    for (unsigned long c = 1; c < ctx->num_cores; c++) {
+        const CacheLevel *cache = ctx->cores[c].levels[n][side];
+        if (cache != ctx->levels[n][side]) {
+            total->accesses += cache->accesses;
+            total->hits += cache->hits;
+            total->writebacks += cache->writebacks;
+            total->write_throughs += cache->write_throughs;
+            total->inclusion_victims += cache->inclusion_victims;
+            total->victims_taken += cache->victims_taken;
+        }
+    }
+}
+
+void sim_get_stats(const SimContext *ctx, SimStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->mem_accesses = ctx->mem_accesses;
+    stats->instr_accesses = ctx->instr_accesses;
+    stats->data_accesses = ctx->data_accesses;
+    stats->total_latency_instr = sampled_total_latency(ctx, 1);
+    stats->total_latency_data = sampled_total_latency(ctx, 0);
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        for (unsigned long side = 0; side < 2; side++) {
+            if (ctx->levels[n][side]) {
+                CacheLevel total;
+                level_totals(ctx, n, side, &total);
+                stats->level_accesses[n][side] = total.accesses;
+                stats->level_hits[n][side] = total.hits;
+                stats->level_filtered[n][side] = total.filtered;
+                stats->level_prefetch[n][side] = total.prefetch; // prefetchers sit on shared levels only
+                stats->level_writebacks[n][side] = total.writebacks;
+                stats->level_write_throughs[n][side] = total.write_throughs;
+                stats->level_inclusion_victims[n][side] = total.inclusion_victims;
+                stats->level_victims_taken[n][side] = total.victims_taken;
+                stats->level_mshr_merges[n][side] = total.mshr_merges;
+                stats->level_mshr_stalls[n][side] = total.mshr_stalls;
+                stats->level_mshr_stall_cycles[n][side] = total.mshr_stall_cycles;
+            }
+        }
+    }
+    stats->warmed_accesses = ctx->warmed_accesses;
+    stats->sample_windows = ctx->windows[2].n;
+    stats->invalidations = ctx->invalidations;
+    stats->coherence_misses = ctx->coherence_misses;
+    stats->c2c_transfers = ctx->c2c_transfers;
+    stats->mem_read_bytes = ctx->mem_read_bytes;
+    stats->mem_write_bytes = ctx->mem_write_bytes;
+    stats->bandwidth_intervals = ctx->bw_intervals;
+    stats->bandwidth_peak = ctx->config.bandwidth_interval ? (double)ctx->bw_peak / ctx->config.bandwidth_interval : 0;
+    stats->bandwidth_saturated = ctx->bw_saturated;
+    stats->cycles = ctx->timed_cycles;
+    stats->sw_prefetches = ctx->sw_prefetches;
+    stats->sw_prefetches_late = ctx->sw_prefetches_late;
+    stats->sw_prefetch_late_cycles = ctx->sw_prefetch_late_cycles;
+    stats->sw_prefetches_dropped = ctx->sw_prefetches_dropped;
+    if (ctx->dram)
+        dram_totals(ctx->dram, &stats->dram);
+    if (ctx->mmu)
+        stats->mmu = *mmu_stats(ctx->mmu);
+}
+
+// Newton's method, saves linking libm for the confidence intervals
+static double newton_sqrt(double x) {
+    if (x <= 0)
+        return 0;
+    double r = x > 1 ? x : 1;
+    for (int i = 0; i < 100; i++) {
+        double next = 0.5 * (r + x / r);
+        if (next >= r)
+            break;
+        r = next;
+    }
+    return r;
+}
+
+// 95% confidence half-width of the ratio estimate sum(y) / sum(x), with the finite
+// population correction when the units were drawn from `population` of them (0 = unbounded)
+static double ratio_half_width(const RatioSums *sums, unsigned long population) {
+    if (sums->n < 2 || sums->x == 0)
+        return 0;
+    double ratio = sums->y / sums->x, mean_x = sums->x / sums->n;
+    double squares = sums->yy - 2 * ratio * sums->xy + ratio * ratio * sums->xx; // sum((y - ratio x)^2)
+    if (squares < 0)
+        squares = 0;
+    double correction = population ? 1.0 - (double)sums->n / population : 1.0;
+    double variance = correction * squares / (sums->n - 1) / (sums->n * mean_x * mean_x);
+    return 1.96 * newton_sqrt(variance);
+}
+
+// half-width for the misses per access of a set-sampled level, with its sets as the
+// sampling units
+static double sample_half_width(const CacheLevel *cache) {
+    RatioSums sums = {0};
+    for (unsigned long i = 0; i < cache->num_sets; i++) {
+        if (set_sampled(cache, i))
+            ratio_add(&sums, cache->set_samples[i].accesses[0] + cache->set_samples[i].accesses[1],
+                      cache->set_samples[i].misses);
+    }
+    return ratio_half_width(&sums, cache->num_sets);
+}
+
+// the same for the latency from this level down per access of side
+static double sample_latency_half_width(const CacheLevel *cache, unsigned long side) {
+    RatioSums sums = {0};
+    for (unsigned long i = 0; i < cache->num_sets; i++) {
+        if (set_sampled(cache, i))
+            ratio_add(&sums, cache->set_samples[i].accesses[side], cache->set_samples[i].latency[side]);
+    }
+    return ratio_half_width(&sums, cache->num_sets);
+}
+
+// Half-width for a side's average latency. Each sampled level contributes the interval of
+// the side's remaining latency there, scaled by the share of the side's accesses that
+// reach it; the contributions are taken as independent. Only a sampled level's sampled
+// accesses go on down, so the share below it is scaled up by its sampling factor: the
+// estimate of a deeper level is charged, through the level's average, to its filtered
+// accesses as well.
+static double latency_half_width(const SimContext *ctx, unsigned long side) {
+    unsigned long accesses = side ? ctx->instr_accesses : ctx->data_accesses;
+    double variance = 0, scale = 1.0 / (accesses ? accesses : 1);
+    for (unsigned long i = 0; i < ctx->path_len; i++) {
+        const CacheLevel *cache = ctx->path[side][i];
+        if (!cache->sample_bits)
+            continue;
+        unsigned long reached = cache->sample_accesses[side] + cache->filtered_side[side];
+        double width = reached * scale * sample_latency_half_width(cache, side);
+        variance += width * width;
+        if (!cache->sample_accesses[side])
+            break;
+        scale *= (double)reached / cache->sample_accesses[side];
+    }
+    return newton_sqrt(variance);
+}
+
+static void print_miss_rate(FILE *fp, const char *name, const CacheLevel *cache) {
+    if (cache->accesses == 0)
+        return;
+    double rate = 100.0 * (cache->accesses - cache->hits) / cache->accesses;
+    if (cache->sample_bits)
+        fprintf(fp, "%s: %.2f%% misses (+/- %.2f%%, 95%% CI, %lu of %lu sets sampled)\n", name, rate,
+                100.0 * sample_half_width(cache), cache->sampled_sets, cache->num_sets);
+    else
+        fprintf(fp, "%s: %.2f%% misses\n", name, rate);
+}
+
+// interval of an average latency, side 2 for all accesses; measured windows are the
+// sampling units under SMARTS sampling, which covers set sampling within them too
+static void print_latency_interval(FILE *fp, const SimContext *ctx, unsigned long side) {
+    if (ctx->config.sample_period)
+        fprintf(fp, " (+/- %.2f, 95%% CI, %lu windows)", ratio_half_width(&ctx->windows[side], 0), ctx->windows[side].n);
+    else if (ctx->sampling)
+        fprintf(fp, " (+/- %.2f, 95%% CI, set-sampled)", latency_half_width(ctx, side));
+}
+
+static void print_latency(FILE *fp, const SimContext *ctx, const char *kind, unsigned long side,
+                          unsigned long accesses, unsigned long total_latency) {
+    if (accesses == 0) {
+        fprintf(fp, "%s accesses: none\n", kind);
+        return;
+    }
+    fprintf(fp, "%s accesses: average latency = %.2f cycles", kind, (double)total_latency / accesses);
+    print_latency_interval(fp, ctx, side);
+    fprintf(fp, "\n");
+}
+
+// the dueling policies also say which side their follower sets are on
+static void print_policy(FILE *fp, const char *name, const CacheLevel *cache) {
+    fprintf(fp, "%s: %s", name, policy_name(cache->policy));
+    if (cache->policy == POLICY_DIP || cache->policy == POLICY_DRRIP) {
+        int second = cache->psel > PSEL_MAX / 2;
+        const char *follow = cache->policy == POLICY_DIP ? (second ? "BIP" : "LRU") : (second ? "BRRIP" : "SRRIP");
+        fprintf(fp, " (followers on %s, PSEL %lu of %d)", follow, cache->psel, PSEL_MAX);
+    }
+    fprintf(fp, "\n");
+}
+
+static void print_inclusion(FILE *fp, const char *name, const CacheLevel *cache) {
+    if (cache->inclusion == INCLUSION_INCLUSIVE)
+        fprintf(fp, "%s: inclusive, %lu copies above back-invalidated\n", name, cache->inclusion_victims);
+    else if (cache->inclusion == INCLUSION_EXCLUSIVE)
+        fprintf(fp, "%s: exclusive, %lu victims taken in from above\n", name, cache->victims_taken);
+    else
+        fprintf(fp, "%s: non-inclusive non-exclusive\n", name);
+}
+
+// counts are left out when they cover the sampled stream only
+static void print_writes(FILE *fp, const char *name, const CacheLevel *cache, int sampled) {
+    fprintf(fp, "%s: %s, %s", name, cache->write_through ? "write-through" : "write-back",
+            cache->write_allocate ? "write-allocate" : "no write-allocate");
+    if (sampled)
+        fprintf(fp, " (counts not reported with set sampling)\n");
+    else
+        fprintf(fp, ": %lu write-backs, %lu write-throughs\n", cache->writebacks, cache->write_throughs);
+}
+
+// accuracy is useful/issued, coverage the share of would-be misses that prefetches turned into hits
+static void print_prefetcher(FILE *fp, const char *name, const CacheLevel *cache) {
+    const PrefetchStats *p = &cache->prefetch;
+    fprintf(fp, "%s: %s, degree %lu\n", name, prefetcher_name(prefetcher_get_kind(cache->prefetcher)),
+            prefetcher_degree(cache->prefetcher));
+    fprintf(fp, "  issued %lu, useful %lu, accuracy %.2f%%, coverage %.2f%%\n", p->issued, p->useful,
+            p->issued ? 100.0 * p->useful / p->issued : 0.0,
+            p->useful + p->demand_misses ? 100.0 * p->useful / (p->useful + p->demand_misses) : 0.0);
+    fprintf(fp, "  late %lu (%.2f%% of useful, %.2f cycles waited on average)\n", p->late,
+            p->useful ? 100.0 * p->late / p->useful : 0.0, p->late ? (double)p->late_cycles / p->late : 0.0);
+    fprintf(fp, "  useless %lu, pollution misses %lu\n", p->useless, p->pollution);
+    if (cache->mshr)
+        fprintf(fp, "  dropped %lu with every MSHR busy\n", p->dropped);
+}
+
+static void print_mshrs(FILE *fp, const char *name, const CacheLevel *cache) {
+    fprintf(fp, "%s: %lu MSHRs, %lu accesses waited on a fill in flight, %lu misses on full MSHRs", name,
+            cache->mshrs, cache->mshr_merges, cache->mshr_stalls);
+    if (cache->mshr_stalls)
+        fprintf(fp, " (%.2f cycles waited on average)", (double)cache->mshr_stall_cycles / cache->mshr_stalls);
+    fprintf(fp, "\n");
+}
+
+static void print_row_buffer(FILE *fp, const DramStats *s) {
+    unsigned long total = s->row_hits + s->row_empty + s->row_conflicts;
+    fprintf(fp, "%lu reads, %lu writes, row hits %.2f%%, empty %.2f%%, conflicts %.2f%%", s->reads, s->writes,
+            total ? 100.0 * s->row_hits / total : 0.0, total ? 100.0 * s->row_empty / total : 0.0,
+            total ? 100.0 * s->row_conflicts / total : 0.0);
+    if (s->reads)
+        fprintf(fp, ", %.2f cycles per read", (double)s->read_latency / s->reads);
+    fprintf(fp, "\n");
+}
+
+static void print_dram(FILE *fp, const Dram *dram, const DramConfig *c) {
+    fprintf(fp, "\n--- DRAM (%lu channels x %lu ranks x %lu banks, %lu-byte rows, %s) ---\n", c->channels, c->ranks,
+            c->banks, c->row_size, dram_page_policy_name(c->page_policy));
+    DramStats total;
+    dram_totals(dram, &total);
+    fprintf(fp, "All banks: ");
+    print_row_buffer(fp, &total);
+    for (unsigned long i = 0; i < dram_num_banks(dram); i++) {
+        const DramStats *s = dram_bank_stats(dram, i);
+        if (!s->reads && !s->writes)
+            continue;
+        fprintf(fp, "ch%lu rk%lu bk%lu: ", i / (c->ranks * c->banks), i / c->banks % c->ranks, i % c->banks);
+        print_row_buffer(fp, s);
+    }
+}
+
+static void print_tlbs(FILE *fp, const SimContext *ctx) {
+    static const char *const names[TLB_NUM_KINDS] = { "ITLB", "DTLB", "STLB" };
+    const MmuConfig *c = &ctx->config.mmu;
+    const MmuStats *s = mmu_stats(ctx->mmu);
+    fprintf(fp, "\n--- TLBs (%s pages", page_size_name(c->page_size));
+    if (c->page_size != PAGE_4K && c->huge_percent < 100)
+        fprintf(fp, " in %lu%% of the regions, 4K elsewhere", c->huge_percent);
+    fprintf(fp, ", %lu-level page table) ---\n", c->walk_levels);
+    for (TlbKind k = 0; k < TLB_NUM_KINDS; k++) {
+        const TlbConfig *tlb = &c->tlb[k];
+        if (!tlb->entries)
+            continue;
+        fprintf(fp, "%s: %lu entries, ", names[k], tlb->entries);
+        if (tlb->associativity && tlb->associativity < tlb->entries)
+            fprintf(fp, "%lu-way", tlb->associativity);
+        else
+            fprintf(fp, "fully associative");
+        const char *sep = ", ";
+        for (PageSize size = 0; size < PAGE_NUM_SIZES; size++) {
+            if (tlb->page_sizes & (1u << size)) {
+                fprintf(fp, "%s%s", sep, page_size_name(size));
+                sep = "/";
+            }
+        }
+        const TlbStats *t = &s->tlb[k];
+        fprintf(fp, ", %lu accesses, miss rate %.2f%%\n", t->accesses,
+                t->accesses ? 100.0 * (t->accesses - t->hits) / t->accesses : 0.0);
+    }
+    if (c->page_size != PAGE_4K)
+        fprintf(fp, "Translations: %lu of 4K pages, %lu of %s pages\n", s->translations[PAGE_4K],
+                s->translations[c->page_size], page_size_name(c->page_size));
+    fprintf(fp, "Page walks: %lu (%.2f per 1000 accesses)", s->walks,
+            ctx->mem_accesses ? 1000.0 * s->walks / ctx->mem_accesses : 0.0);
+    if (s->walks)
+        fprintf(fp, ", %.2f cycles and %.2f reads on average, %.2f%% of the reads from memory",
+                (double)s->walk_cycles / s->walks, (double)s->walk_reads / s->walks,
+                s->walk_reads ? 100.0 * s->walk_reads_memory / s->walk_reads : 0.0);
+    fprintf(fp, "\n");
+    if (c->walk_cache)
+        fprintf(fp, "Page walk cache: %lu entries, %lu reads saved\n", c->walk_cache, s->walk_cache_hits);
+}
+
+void sim_report(const SimContext *ctx, FILE *fp) {
+    unsigned long instr_latency = sampled_total_latency(ctx, 1), data_latency = sampled_total_latency(ctx, 0);
+    fprintf(fp, "--- Simulation Statistics ---\n");
+    fprintf(fp, "Total memory accesses: %lu\n", ctx->mem_accesses);
+    if (ctx->config.sample_period) {
+        fprintf(fp, "Sampled: %lu measured, %lu warmed (windows of %lu after %lu warm-up, every %lu)\n",
+                ctx->mem_accesses, ctx->warmed_accesses, ctx->config.sample_window, ctx->config.sample_warmup,
+                ctx->config.sample_period);
+        if (ctx->mem_accesses) {
+            fprintf(fp, "All accesses: average latency = %.2f cycles",
+                    (double)(instr_latency + data_latency) / ctx->mem_accesses);
+            print_latency_interval(fp, ctx, 2);
+            fprintf(fp, "\n");
+        }
+    }
+    print_latency(fp, ctx, "Instruction", 1, ctx->instr_accesses, instr_latency);
+    print_latency(fp, ctx, "Data", 0, ctx->data_accesses, data_latency);
+
+    char name[32];
+    fprintf(fp, "\n--- Cache Miss Rates ---\n");
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        if (!ctx->levels[n][0])
+            continue;
+        CacheLevel data, instr; // summed over the cores
+        level_totals(ctx, n, 0, &data);
+        level_totals(ctx, n, 1, &instr);
+        if (ctx->levels[n][1] != ctx->levels[n][0]) {
+            snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+            print_miss_rate(fp, name, &instr);
+            snprintf(name, sizeof(name), "L%lu Data", n + 1);
+            print_miss_rate(fp, name, &data);
+        } else {
+            snprintf(name, sizeof(name), "L%lu", n + 1);
+            print_miss_rate(fp, name, &data);
+        }
+    }
+    
+    fprintf(fp, "\n--- Replacement Policy ---\n");
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        const CacheLevel *data = ctx->levels[n][0], *instr = ctx->levels[n][1];
+        if (!data)
+            continue;
+        if (instr != data) {
+            snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+            print_policy(fp, name, instr);
+            snprintf(name, sizeof(name), "L%lu Data", n + 1);
+            print_policy(fp, name, data);
+        } else {
+            snprintf(name, sizeof(name), "L%lu", n + 1);
+            print_policy(fp, name, data);
+        }
+    }
+
+    int inclusion = 0;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++)
+        inclusion |= ctx->levels[n][0] && ctx->levels[n][0]->inclusion != INCLUSION_NINE;
+    if (inclusion) {
+        fprintf(fp, "\n--- Inclusion ---\n");
+        for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+            if (!ctx->levels[n][0])
+                continue;
+            CacheLevel data, instr;
+            level_totals(ctx, n, 0, &data);
+            level_totals(ctx, n, 1, &instr);
+            if (ctx->levels[n][1] != ctx->levels[n][0]) {
+                snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+                print_inclusion(fp, name, &instr);
+                snprintf(name, sizeof(name), "L%lu Data", n + 1);
+                print_inclusion(fp, name, &data);
+            } else {
+                snprintf(name, sizeof(name), "L%lu", n + 1);
+                print_inclusion(fp, name, &data);
+            }
+        }
+    }
+
+    fprintf(fp, "\n--- Writes and Memory Traffic ---\n");
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        if (!ctx->levels[n][0])
+            continue;
+        CacheLevel data, instr;
+        level_totals(ctx, n, 0, &data);
+        level_totals(ctx, n, 1, &instr);
+        int sampled = write_counts_sampled(ctx, n);
+        if (ctx->levels[n][1] != ctx->levels[n][0]) {
+            snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+            print_writes(fp, name, &instr, sampled);
+            snprintf(name, sizeof(name), "L%lu Data", n + 1);
+            print_writes(fp, name, &data, sampled);
+        } else {
+            snprintf(name, sizeof(name), "L%lu", n + 1);
+            print_writes(fp, name, &data, sampled);
+        }
+    }
+    if (ctx->sampling) {
+        fprintf(fp, "Memory: not reported with set sampling\n");
+    } else {
+        fprintf(fp, "Memory: %lu bytes read, %lu bytes written", ctx->mem_read_bytes, ctx->mem_write_bytes);
+        if (ctx->bw_cycles)
+            fprintf(fp, ", %.3f bytes/cycle", (double)(ctx->mem_read_bytes + ctx->mem_write_bytes) / ctx->bw_cycles);
+        fprintf(fp, "\n");
+    }
+    if (ctx->bw_intervals) {
+        fprintf(fp, "Bandwidth: peak %.3f bytes/cycle over %lu intervals of %lu cycles",
+                (double)ctx->bw_peak / ctx->config.bandwidth_interval, ctx->bw_intervals, ctx->config.bandwidth_interval);
+        if (ctx->config.mem_bandwidth)
+            fprintf(fp, ", %lu (%.2f%%) above %lu bytes/cycle", ctx->bw_saturated,
+                    100.0 * ctx->bw_saturated / ctx->bw_intervals, ctx->config.mem_bandwidth);
+        fprintf(fp, "\n");
+    }
+    if (ctx->dram)
+        print_dram(fp, ctx->dram, &ctx->config.dram);
+    if (ctx->mmu)
+        print_tlbs(fp, ctx);
+
+    if (ctx->config.issue_window) {
+        fprintf(fp, "\n--- Timing (issue window of %lu accesses) ---\n", ctx->config.issue_window);
+        fprintf(fp, "Cycles: %lu", ctx->timed_cycles);
+        if (ctx->timed_cycles)
+            fprintf(fp, ", %.2f accesses in flight on average",
+                    (double)(ctx->total_latency_instr + ctx->total_latency_data) / ctx->timed_cycles);
+        fprintf(fp, "\n");
+        for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+            const CacheLevel *data = ctx->levels[n][0], *instr = ctx->levels[n][1];
+            if (!data)
+                continue;
+            if (instr != data) {
+                snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+                print_mshrs(fp, name, instr);
+            }
+            snprintf(name, sizeof(name), instr != data ? "L%lu Data" : "L%lu", n + 1);
+            print_mshrs(fp, name, data);
+        }
+        if (ctx->sw_prefetches || ctx->sw_prefetches_dropped) {
+            fprintf(fp, "Software prefetches: %lu issued, %lu dropped, %lu late", ctx->sw_prefetches,
+                    ctx->sw_prefetches_dropped, ctx->sw_prefetches_late);
+            if (ctx->sw_prefetches_late)
+                fprintf(fp, " (%.2f cycles waited on average)",
+                        (double)ctx->sw_prefetch_late_cycles / ctx->sw_prefetches_late);
+            fprintf(fp, "\n");
+        }
+    }
+
+    if (ctx->prefetching) {
+        fprintf(fp, "\n--- Prefetchers ---\n");
+        for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+            const CacheLevel *data = ctx->levels[n][0], *instr = ctx->levels[n][1];
+            if (!data)
+                continue;
+            if (instr != data && instr->prefetcher) {
+                snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+                print_prefetcher(fp, name, instr);
+            }
+            if (data->prefetcher) {
+                snprintf(name, sizeof(name), instr != data ? "L%lu Data" : "L%lu", n + 1);
+                print_prefetcher(fp, name, data);
+            }
+        }
+    }
+
+    if (ctx->num_cores > 1) {
+        fprintf(fp, "\n--- Cores (%lu private levels each, MESI directory) ---\n", ctx->private_levels);
+        for (unsigned long c = 0; c < ctx->num_cores; c++) {
+            const SimCore *core = &ctx->cores[c];
+            if (core->accesses)
+                fprintf(fp, "Core %lu: %lu accesses, average latency = %.2f cycles\n", c, core->accesses,
+                        (double)core->total_latency / core->accesses);
+            else
+                fprintf(fp, "Core %lu: no accesses\n", c);
+        }
+        fprintf(fp, "Invalidations: %lu (%lu cycles per invalidating write)\n", ctx->invalidations,
+                ctx->config.invalidate_latency);
+        fprintf(fp, "Coherence misses: %lu\n", ctx->coherence_misses);
+        fprintf(fp, "Cache-to-cache transfers: %lu (%lu cycles each)\n", ctx->c2c_transfers,
+                ctx->config.c2c_latency);
+    }
+
+    if (ctx->interval_period) {
+        fprintf(fp, "\n--- Intervals ---\n");
+        fprintf(fp, "%lu rows of %lu fields, one every %lu %s, written to %s (%s), %lu waited for the writer\n",
+                ctx->interval_rows, ctx->interval_fields, ctx->interval_period,
+                ctx->config.interval_cycles ? "cycles" : "accesses", ctx->config.interval_path,
+                ctx->config.interval_binary ? "binary" : "CSV", ctx->interval_stalls);
+    }
+}
+
+// appends the report to results.log and stops counting
+void sim_end(SimContext *ctx) {
+    FILE *fp = fopen("results.log", "a");
+    if (!fp) {
+        perror("fopen");
+        exit(1);
+    }
+    sim_stop(ctx);
+    sim_report(ctx, fp);
+    fclose(fp);
+}
+
+// lookup sets of one access, in path order
+typedef struct {
+    SetRef ref[MAX_CACHE_LEVELS];
+} AccessSets;
+
+// latency charged to an access of side (1 = instruction) that reaches an unsampled set of cache
+static inline unsigned long sampled_latency(const CacheLevel *cache, unsigned long side) {
+    unsigned long accesses = cache->sample_accesses[side];
+    if (!accesses)
+        return cache->miss_latency;
+    return (cache->sample_latency[side] + accesses / 2) / accesses;
+}
+
+// adds one access of side to the per-set counters of the sampled levels among the first
+// probed ones; the last probed level hit if hit is set
+static void record_samples(CacheLevel **path, const SetRef *refs, const unsigned long *latency_above,
+                           unsigned long probed, int hit, unsigned long latency, unsigned long side) {
+    for (unsigned long level = 0; level < probed; level++) {
+        CacheLevel *cache = path[level];
+        if (!cache->sample_bits)
+            continue;
+        unsigned long below = latency - latency_above[level];
+        SetSample *sample = &cache->set_samples[refs[level].index];
+        sample->accesses[side]++;
+        sample->misses += !(hit && level == probed - 1);
+        sample->latency[side] += below;
+        cache->sample_accesses[side]++;
+        cache->sample_latency[side] += below;
+    }
+}
+
+// Writes and memory traffic, counted in the measured phase only. A store dirties the first
+// level holding its line, or passes on down while that level writes through; the fill
+// cascade skips levels without write-allocate for stores. A dirty line that a fill
+// replaces is written back the same way from the level below. Writes never allocate, and
+// they are buffered: they add no latency.
+
+#define NO_CACHE_LINE_SIZE 64 // bytes an access moves to or from memory with every level off
+
+// the line size of path's first level, or of its last, the one memory fills
+static inline unsigned long first_line_size(const SimContext *ctx, CacheLevel *const *path) {
+    return ctx->path_len ? path[0]->line_size : NO_CACHE_LINE_SIZE;
+}
+
+static inline unsigned long last_line_size(const SimContext *ctx, CacheLevel *const *path) {
+    return ctx->path_len ? path[ctx->path_len - 1]->line_size : NO_CACHE_LINE_SIZE;
+}
+
+static inline void memory_traffic(SimContext *ctx, unsigned long bytes, int write) {
+    if (ctx->phase != PHASE_MEASURE)
+        return;
+    if (write)
+        ctx->mem_write_bytes += bytes;
+    else
+        ctx->mem_read_bytes += bytes;
+    ctx->bw_bytes += bytes;
+}
+
+// moves the bandwidth clock on by an access's latency, closing the intervals it completes
+static void bandwidth_advance(SimContext *ctx, unsigned long cycles) {
+    unsigned long interval = ctx->config.bandwidth_interval;
+    if (ctx->phase != PHASE_MEASURE)
+        return;
+    ctx->bw_cycles += cycles;
+    ctx->bw_elapsed += cycles;
+    if (!interval || ctx->bw_elapsed < interval)
+        return;
+    if (ctx->bw_bytes > ctx->bw_peak)
+        ctx->bw_peak = ctx->bw_bytes;
+    if (ctx->config.mem_bandwidth && ctx->bw_bytes > ctx->config.mem_bandwidth * interval)
+        ctx->bw_saturated++;
+    ctx->bw_intervals += ctx->bw_elapsed / interval; // the bytes go to the first, the rest were idle
+    ctx->bw_elapsed %= interval;
+    ctx->bw_bytes = 0;
+}
+
+// cycles memory takes to return paddr's line, asked for at cycle now; functional warming,
+// which does not move the clock, leaves the DRAM model alone
+static inline unsigned long memory_latency(SimContext *ctx, unsigned long paddr, unsigned long now) {
+    if (!ctx->dram || ctx->phase == PHASE_WARMING)
+        return ctx->config.mem_latency;
+    return dram_access(ctx->dram, paddr, now, 0, ctx->phase == PHASE_MEASURE);
+}
+
+// a write of bytes to memory; the DRAM model posts it at the current cycle
+static void memory_write(SimContext *ctx, unsigned long paddr, unsigned long bytes) {
+    memory_traffic(ctx, bytes, 1);
+    if (ctx->dram && ctx->phase != PHASE_WARMING)
+        dram_access(ctx->dram, paddr, ctx->cycles, 1, ctx->phase == PHASE_MEASURE);
+}
+
+// sends a write of paddr's line (bytes long) down from cache, NULL being memory
+static void write_down(SimContext *ctx, CacheLevel *cache, unsigned long paddr, unsigned long bytes) {
+    for (; cache; cache = cache->below) {
+        SetRef ref = set_ref(cache, paddr);
+        if (!set_sampled(cache, ref.index))
+            return; // levels below an unsampled set see none of its traffic
+        if (cache->write_through) {
+            cache->write_throughs += (ctx->phase == PHASE_MEASURE);
+            bytes = cache->line_size;
+            continue;
+        }
+        unsigned long way = find_way(cache, &ref);
+        if (way != WAY_NONE) {
+            cache->dirty[ref.index * cache->valid_words + way / 64] |= (uint64_t)1 << (way % 64);
+            return;
+        }
+    }
+    memory_write(ctx, paddr, bytes);
+}
+
+// Inclusion (L<n>_INCLUSION), relative to the levels above. A NINE level is filled by the
+// misses that pass through it and evicts on its own. An inclusive one is filled the same
+// way, but each line it evicts is invalidated above as well, in every core that sees the
+// level. An exclusive level is skipped by the fill cascade and takes in the victims of the
+// level just above it instead; a hit there moves the line up, out of the level.
+
+static void coherent_forget(SimContext *ctx, unsigned long paddr);
+static void evict_line(SimContext *ctx, CacheLevel *cache, unsigned long paddr, int dirty);
+
+// whether the fill cascade of a load (or a store, write) installs the line in cache
+static inline int fills_level(const CacheLevel *cache, int write) {
+    return cache->inclusion != INCLUSION_EXCLUSIVE && (!write || cache->write_allocate);
+}
+
+static inline int way_dirty(const CacheLevel *cache, const SetRef *ref, unsigned long way) {
+    return (cache->dirty[ref->index * cache->valid_words + way / 64] >> (way % 64)) & 1;
+}
+
+static inline void mark_dirty(CacheLevel *cache, const SetRef *ref, unsigned long way) {
+    cache->dirty[ref->index * cache->valid_words + way / 64] |= (uint64_t)1 << (way % 64);
+}
+
+// invalidates a way that inclusion took the line out of; recency policies see it as the
+// oldest, so it is refilled first (the others already prefer invalid ways)
+static inline void drop_line(CacheLevel *cache, const SetRef *ref, unsigned long way) {
+    clear_line(cache, ref, way);
+    if (cache->ages)
+        cache->ages[ref->index * cache->associativity + way] = 0;
+}
+
+// invalidates the copies of paddr's line (cache's line size) above the inclusive cache,
+// returns whether one of them was dirty
+static int back_invalidate(SimContext *ctx, CacheLevel *cache, unsigned long paddr) {
+    int dirty = 0;
+    unsigned long copies = 0;
+    for (unsigned long c = 0; c < ctx->num_cores; c++) {
+        if (!cache->shared && c != cache->owner)
+            continue;
+        CacheLevel *(*path)[MAX_CACHE_LEVELS] = ctx->cores[c].path;
+        for (unsigned long side = 0; side < 2; side++) {
+            for (unsigned long k = 0; k < cache->depth; k++) {
+                CacheLevel *upper = path[side][k];
+                if ((side == 1 && upper == path[0][k]) || (c > 0 && upper->shared))
+                    continue; // the other side, or core 0, covers it
+                for (unsigned long a = paddr; a < paddr + cache->line_size; a += upper->line_size) {
+                    SetRef ref = set_ref(upper, a);
+                    if (!set_sampled(upper, ref.index))
+                        continue;
+                    unsigned long way = find_way(upper, &ref);
+                    if (way == WAY_NONE)
+                        continue;
+                    dirty |= way_dirty(upper, &ref, way);
+                    drop_line(upper, &ref, way);
+                    copies++;
+                }
+            }
+        }
+    }
+    if (!copies)
+        return 0;
+    if (ctx->phase == PHASE_MEASURE)
+        cache->inclusion_victims += copies;
+    for (unsigned long a = paddr; ctx->num_cores > 1 && a < paddr + cache->line_size; a += ctx->coherence_line)
+        coherent_forget(ctx, a);
+    return dirty;
+}
+
+// A hit in an exclusive path[level] moves the line up to the nearest level above that the
+// fill cascade fills, taking its dirty bit along. Returns that level, or level itself when
+// no level above takes the line and it stays.
+static unsigned long exclusive_hit(CacheLevel **path, unsigned long level, const SetRef *ref, unsigned long way,
+                                   int write, int *dirty) {
+    CacheLevel *cache = path[level];
+    for (unsigned long k = level; k-- > 0;) {
+        if (fills_level(path[k], write)) {
+            *dirty = way_dirty(cache, ref, way);
+            drop_line(cache, ref, way);
+            return k;
+        }
+    }
+    return level;
+}
+
+// after the fill cascade: the level a line moved up to keeps it dirty
+static void set_line_dirty(CacheLevel *cache, unsigned long paddr) {
+    SetRef ref = set_ref(cache, paddr);
+    unsigned long way = find_way(cache, &ref);
+    if (way != WAY_NONE)
+        mark_dirty(cache, &ref, way);
+}
+
+// fills ref's line clean; the line it replaces goes on through evict_line
+static inline void install_line(SimContext *ctx, CacheLevel *cache, SetRef *ref) {
+    cache->fill(ctx, cache, ref);
+    // invalidated ways can still carry a dirty bit
+    uint64_t *word = &cache->dirty[ref->index * cache->valid_words + cache->evicted_way / 64];
+    uint64_t bit = (uint64_t)1 << (cache->evicted_way % 64);
+    int dirty = (*word & bit) != 0;
+    *word &= ~bit;
+    if (!cache->evicted_valid)
+        return;
+    if (dirty || cache->inclusion == INCLUSION_INCLUSIVE ||
+        (cache->below && cache->below->inclusion == INCLUSION_EXCLUSIVE))
+        evict_line(ctx, cache, line_address(cache, ref->index, cache->evicted_tag), dirty);
+}
+
+// Timing model (ISSUE_WINDOW). The MSHRs of a level hold the misses in flight from it. A
+// miss takes an entry, waiting for the first to free up when all are busy, and an access
+// that finds its line in flight waits for that fill instead of fetching it again. An
+// access's latency runs from its issue to the arrival of its data.
+
+// the entry fetching line at cycle now, NULL when none is
+static Mshr *mshr_find(CacheLevel *cache, uint64_t line, unsigned long now) {
+    for (unsigned long i = 0; i < cache->mshrs; i++) {
+        Mshr *entry = &cache->mshr[i];
+        if (entry->ready > now && entry->line == line && entry->kind != MSHR_HW_PREFETCH)
+            return entry;
+    }
+    return NULL;
+}
+
+// an entry free at cycle now, NULL when all are busy
+static Mshr *mshr_free(CacheLevel *cache, unsigned long now) {
+    for (unsigned long i = 0; i < cache->mshrs; i++) {
+        if (cache->mshr[i].ready <= now)
+            return &cache->mshr[i];
+    }
+    return NULL;
+}
+
+// an entry for a demand miss at *now, which moves on to the first fill when all are busy
+static Mshr *mshr_allocate(SimContext *ctx, CacheLevel *cache, unsigned long *now) {
+    Mshr *entry = mshr_free(cache, *now);
+    if (entry)
+        return entry;
+    entry = &cache->mshr[0];
+    for (unsigned long i = 1; i < cache->mshrs; i++) {
+        if (cache->mshr[i].ready < entry->ready)
+            entry = &cache->mshr[i];
+    }
+    if (ctx->phase == PHASE_MEASURE) {
+        cache->mshr_stalls++;
+        cache->mshr_stall_cycles += entry->ready - *now;
+    }
+    *now = entry->ready;
+    return entry;
+}
+
+// cycles path[level] waits, from cycle now, for paddr's line from the first level below
+// that holds it, or from memory; *from gets that level, path_len for memory
+static unsigned long fetch_latency(SimContext *ctx, CacheLevel **path, unsigned long level, unsigned long path_len,
+                                   unsigned long paddr, unsigned long now, unsigned long *from) {
+    unsigned long latency = 0, below;
+    for (below = level + 1; below < path_len; below++) {
+        CacheLevel *next = path[below];
+        SetRef next_ref = set_ref(next, paddr);
+        latency += next->access_latency;
+        if (set_sampled(next, next_ref.index) && find_way(next, &next_ref) != WAY_NONE)
+            break;
+    }
+    if (below == path_len)
+        latency += memory_latency(ctx, paddr, now + latency);
+    *from = below;
+    return latency;
+}
+
+// moves ctx->cycles on to the next access's issue: a cycle after the last one at the
+// earliest, and once the access issue_window places back has retired
+static void timed_issue(SimContext *ctx) {
+    unsigned long issue = ctx->cycles + 1;
+    if (ctx->retire_ring[ctx->ring_pos] > issue)
+        issue = ctx->retire_ring[ctx->ring_pos];
+    bandwidth_advance(ctx, issue - ctx->cycles);
+    ctx->cycles = issue;
+}
+
+// Latency of the access issued at ctx->cycles and translated translation cycles later
+// that looked up path[0, probed), hitting in the last of them when hit, else going on to
+// memory, or for estimate cycles when it reached an unsampled set (filtered). Each level
+// it misses in reserves an MSHR, listed in reserved.
+static unsigned long timed_lookup(SimContext *ctx, CacheLevel **path, unsigned long translation, unsigned long probed,
+                                  int hit, int filtered, unsigned long estimate, unsigned long paddr,
+                                  Mshr **reserved, unsigned long *num_reserved) {
+    int measure = (ctx->phase == PHASE_MEASURE);
+    unsigned long now = ctx->cycles + translation;
+    *num_reserved = 0;
+    for (unsigned long k = 0; k < probed; k++) {
+        CacheLevel *cache = path[k];
+        uint64_t line = paddr / cache->line_size;
+        now += cache->access_latency;
+        Mshr *entry = mshr_find(cache, line, now);
+        if (entry) {
+            if (entry->kind == MSHR_SW_PREFETCH) { // late; later accesses merge with it
+                entry->kind = MSHR_DEMAND;
+                if (measure) {
+                    ctx->sw_prefetches_late++;
+                    ctx->sw_prefetch_late_cycles += entry->ready - now;
+                }
+            } else {
+                cache->mshr_merges += measure;
+            }
+            return entry->ready - ctx->cycles;
+        }
+        if (hit && k + 1 == probed)
+            return now - ctx->cycles;
+        entry = mshr_allocate(ctx, cache, &now);
+        entry->line = line;
+        entry->kind = MSHR_DEMAND;
+        entry->ready = ULONG_MAX; // until timed_retire knows when the data arrives
+        reserved[(*num_reserved)++] = entry;
+    }
+    return now + (filtered ? estimate : memory_latency(ctx, paddr, now)) - ctx->cycles;
+}
+
+// retires the access issued at ctx->cycles, its data arriving latency cycles later
+static void timed_retire(SimContext *ctx, Mshr **reserved, unsigned long num_reserved, unsigned long latency) {
+    unsigned long done = ctx->cycles + latency;
+    for (unsigned long i = 0; i < num_reserved; i++)
+        reserved[i]->ready = done;
+    if (done > ctx->retired) {
+        if (ctx->phase == PHASE_MEASURE)
+            ctx->timed_cycles += done - ctx->retired;
+        ctx->retired = done;
+    }
+    ctx->retire_ring[ctx->ring_pos] = ctx->retired;
+    ctx->ring_pos = (ctx->ring_pos + 1) % ctx->config.issue_window;
+}
+
+// A software prefetch into path[level] takes an MSHR there and arrives once fetched from
+// below, or is dropped when every entry is busy. Returns whether it goes ahead.
+static int sw_prefetch_issue(SimContext *ctx, CacheLevel **path, unsigned long level, unsigned long paddr) {
+    CacheLevel *cache = path[level];
+    int measure = (ctx->phase == PHASE_MEASURE);
+    Mshr *entry = mshr_free(cache, ctx->cycles);
+    if (!entry) {
+        ctx->sw_prefetches_dropped += measure;
+        return 0;
+    }
+    unsigned long from;
+    entry->line = paddr / cache->line_size;
+    entry->kind = MSHR_SW_PREFETCH;
+    unsigned long now = ctx->cycles + cache->access_latency;
+    entry->ready = now + fetch_latency(ctx, path, level, ctx->path_len, paddr, now, &from);
+    ctx->sw_prefetches += measure;
+    return 1;
+}
+
+// Hardware prefetchers (state in CacheLevel). A demand miss on a line in the pollution
+// filter was caused by the prefetcher. Only the measured phase is counted, the warm-ups
+// still train the prefetchers.
+
+static inline unsigned long filter_slot(uint64_t line) {
+    return (line * 0x9E3779B97F4A7C15ULL) >> (64 - POLLUTION_FILTER_BITS);
+}
+
+// after any fill of ref: a prefetched line that leaves unused was useless
+static void prefetch_filled(SimContext *ctx, CacheLevel *cache, const SetRef *ref, int prefetch, unsigned long ready) {
+    unsigned long way = cache->evicted_way;
+    uint64_t *word = &cache->prefetched[ref->index * cache->valid_words + way / 64];
+    uint64_t bit = (uint64_t)1 << (way % 64);
+    if (cache->evicted_valid && (*word & bit) && ctx->phase == PHASE_MEASURE)
+        cache->prefetch.useless++;
+    if (!prefetch) {
+        *word &= ~bit;
+        return;
+    }
+    if (cache->evicted_valid) {
+        uint64_t line = line_address(cache, ref->index, cache->evicted_tag) / cache->line_size;
+        cache->pollution_filter[filter_slot(line)] = line + 1;
+    }
+    *word |= bit;
+    cache->prefetch_ready[ref->index * cache->associativity + way] = ready;
+}
+
+static inline void fill_level(SimContext *ctx, CacheLevel *cache, SetRef *ref) {
+    install_line(ctx, cache, ref);
+    if (cache->prefetcher)
+        prefetch_filled(ctx, cache, ref, 0, 0);
+}
+
+// Where a line that a fill of cache replaced goes. An inclusive cache first invalidates its
+// copies above, whose dirty data joins the line's. An exclusive level below takes the line
+// in, dirty or clean; otherwise a dirty line is written back.
+static void evict_line(SimContext *ctx, CacheLevel *cache, unsigned long paddr, int dirty) {
+    if (cache->inclusion == INCLUSION_INCLUSIVE)
+        dirty |= back_invalidate(ctx, cache, paddr);
+    if (dirty)
+        cache->writebacks += (ctx->phase == PHASE_MEASURE);
+    CacheLevel *below = cache->below;
+    if (below && below->inclusion == INCLUSION_EXCLUSIVE) {
+        SetRef ref = set_ref(below, paddr);
+        if (!set_sampled(below, ref.index))
+            return; // traffic below an unsampled set is not followed
+        unsigned long way = find_way(below, &ref);
+        if (way == WAY_NONE) {
+            fill_level(ctx, below, &ref);
+            way = below->evicted_way;
+            below->victims_taken += (ctx->phase == PHASE_MEASURE);
+        }
+        if (dirty)
+            mark_dirty(below, &ref, way);
+        return;
+    }
+    if (dirty)
+        write_down(ctx, below, paddr, cache->line_size);
+}
+
+// fills paddr into path[level] alone, its data arriving after a lookup of the levels below
+static void prefetch_line(SimContext *ctx, CacheLevel **path, unsigned long level, unsigned long path_len,
+                          unsigned long paddr, unsigned long now) {
+    CacheLevel *cache = path[level];
+    SetRef ref = set_ref(cache, paddr);
+    if (!set_sampled(cache, ref.index) || find_way(cache, &ref) != WAY_NONE)
+        return;
+    Mshr *entry = NULL;
+    if (cache->mshr && !(entry = mshr_free(cache, now))) {
+        cache->prefetch.dropped += (ctx->phase == PHASE_MEASURE);
+        return;
+    }
+    unsigned long below, latency = fetch_latency(ctx, path, level, path_len, paddr, now, &below);
+    if (entry) {
+        entry->line = paddr / cache->line_size;
+        entry->kind = MSHR_HW_PREFETCH;
+        entry->ready = now + latency;
+    }
+    if (below == path_len)
+        memory_traffic(ctx, cache->line_size, 0);
+    while (--below > level) { // inclusive levels the line passed through keep a copy
+        CacheLevel *next = path[below];
+        SetRef next_ref = set_ref(next, paddr);
+        if (next->inclusion == INCLUSION_INCLUSIVE && set_sampled(next, next_ref.index))
+            fill_level(ctx, next, &next_ref);
+    }
+    install_line(ctx, cache, &ref);
+    prefetch_filled(ctx, cache, &ref, 1, now + latency);
+    if (ctx->phase == PHASE_MEASURE)
+        cache->prefetch.issued++;
+}
+
+// Trains path[level]'s prefetcher on a demand access that found way (WAY_NONE on a miss)
+// at cycle now and issues its prefetches. Returns the cycles the access waits for a
+// prefetch still in flight.
+static unsigned long prefetch_access(SimContext *ctx, CacheLevel **path, unsigned long level, unsigned long path_len,
+                                     const SetRef *ref, unsigned long way, unsigned long paddr, unsigned long now) {
+    CacheLevel *cache = path[level];
+    int measure = (ctx->phase == PHASE_MEASURE);
+    PrefetchEvent event = PREFETCH_HIT;
+    unsigned long wait = 0;
+    if (way == WAY_NONE) {
+        uint64_t line = paddr / cache->line_size;
+        uint64_t *slot = &cache->pollution_filter[filter_slot(line)];
+        if (*slot == line + 1) {
+            cache->prefetch.pollution += measure;
+            *slot = 0;
+        }
+        cache->prefetch.demand_misses += measure;
+        event = PREFETCH_MISS;
+    } else {
+        uint64_t *word = &cache->prefetched[ref->index * cache->valid_words + way / 64];
+        uint64_t bit = (uint64_t)1 << (way % 64);
+        if (*word & bit) {
+            *word &= ~bit;
+            unsigned long ready = cache->prefetch_ready[ref->index * cache->associativity + way];
+            wait = ready > now ? ready - now : 0;
+            if (measure) {
+                cache->prefetch.useful++;
+                cache->prefetch.late += (wait != 0);
+                cache->prefetch.late_cycles += wait;
+            }
+            event = PREFETCH_USEFUL_HIT;
+        }
+    }
+    uint64_t lines[PREFETCH_MAX_DEGREE];
+    unsigned long n = prefetcher_train(cache->prefetcher, paddr, ctx->signed_access ? ctx->signature : 0, event, lines);
+    for (unsigned long i = 0; i < n; i++) {
+        if (lines[i] / PREFETCH_PAGE == paddr / PREFETCH_PAGE) // physical pages are not contiguous
+            prefetch_line(ctx, path, level, path_len, lines[i], now + wait);
+    }
+    return wait;
+}
+
+// trains the prefetchers of the probed levels once the demand fills are done, adding
+// any wait for a late prefetch to latency
+static void prefetch_accesses(SimContext *ctx, CacheLevel **path, unsigned long first, unsigned long probed,
+                              const SetRef *refs, const unsigned long *ways, unsigned long paddr,
+                              unsigned long *latency) {
+    for (unsigned long level = first; level < probed; level++) {
+        if (path[level]->prefetcher)
+            *latency += prefetch_access(ctx, path, level, ctx->path_len, &refs[level], ways[level], paddr,
+                                        ctx->cycles + *latency);
+    }
+}
+
+// One page-table read of the walker issued at cycle now: a load of pte down the data
+// levels below L1, where the walker's requests enter, filling them on the way back like
+// a demand load. Returns its latency; *from_memory is set when no level held it.
+static unsigned long walk_read(SimContext *ctx, unsigned long pte, unsigned long now, int warming, int *from_memory) {
+    unsigned long skip = ctx->path_len && ctx->path[0][0] == ctx->levels[0][0]; // L1, when enabled
+    CacheLevel **path = ctx->path[0] + skip;
+    unsigned long path_len = ctx->path_len - skip, latency = 0, level, way = WAY_NONE;
+    SetRef refs[MAX_CACHE_LEVELS];
+    int hit = 0, filtered = 0;
+    for (level = 0; level < path_len; level++) {
+        CacheLevel *cache = path[level];
+        refs[level] = set_ref(cache, pte);
+        if (!set_sampled(cache, refs[level].index)) {
+            latency += sampled_latency(cache, 0);
+            filtered = 1;
+            break;
+        }
+        cache->accesses += !warming;
+        latency += cache->access_latency;
+        if ((way = cache->probe(ctx, cache, &refs[level])) != WAY_NONE) {
+            cache->hits += !warming;
+            hit = 1;
+            break;
+        }
+    }
+    if (!hit && !filtered) {
+        latency += memory_latency(ctx, pte, now + latency);
+        memory_traffic(ctx, last_line_size(ctx, ctx->path[0]), 0);
+    }
+    *from_memory = !hit && !filtered;
+    unsigned long moved = level;
+    int moved_dirty = 0;
+    if (hit && path[level]->inclusion == INCLUSION_EXCLUSIVE)
+        moved = exclusive_hit(path, level, &refs[level], way, 0, &moved_dirty);
+    while (level-- > 0) {
+        if (fills_level(path[level], 0))
+            fill_level(ctx, path[level], &refs[level]);
+    }
+    if (moved_dirty)
+        set_line_dirty(path[moved], pte);
+    return latency;
+}
+
+// Translates vaddr through the TLBs, walking the page table on a miss in all of them.
+// Returns the cycles that takes; the walk's reads go one after the other.
+static unsigned long translate(SimContext *ctx, unsigned long vaddr, unsigned long side, int warming) {
+    int count = (ctx->phase == PHASE_MEASURE);
+    uint64_t ptes[MMU_MAX_WALK];
+    unsigned long num_ptes, walk = 0, from_memory = 0;
+    unsigned long latency = mmu_translate(ctx->mmu, vaddr, side, count, ptes, &num_ptes);
+    if (!num_ptes)
+        return latency;
+    for (unsigned long i = 0; i < num_ptes; i++) {
+        int missed;
+        walk += walk_read(ctx, ptes[i], ctx->cycles + latency + walk, warming, &missed);
+        from_memory += missed;
+    }
+    mmu_walk_done(ctx->mmu, walk, from_memory, count);
+    return latency + walk;
+}
+
+// sets holds the lookup sets already when resolved is set (batch path), otherwise they
+// are computed here as each level is reached
+static inline unsigned long access_memory(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type,
+                                          AccessSets *sets, int resolved) {
+    ctx->current_time++;
+    if (ctx->config.issue_window)
+        timed_issue(ctx);
+    unsigned long translation = ctx->mmu ? translate(ctx, vaddr, access_type == 1, 0) : 0;
+    unsigned long latency = translation, estimate = 0;
+    CacheLevel **path = ctx->path[access_type == 1];
+    SetRef *refs = sets->ref;
+    
+    // look up each level until one hits or the access leaves the sampled sets
+    unsigned long level;
+    unsigned long latency_above[MAX_CACHE_LEVELS]; // set for sampled levels only
+    unsigned long ways[MAX_CACHE_LEVELS];
+    int hit = 0, filtered = 0, write = (access_type == 2), allocated = 0;
+    for (level = 0; level < ctx->path_len; level++) {
+        CacheLevel *cache = path[level];
+        if (!resolved)
+            refs[level] = set_ref(cache, cache->vaddr_indexed ? vaddr : paddr);
+        if (cache->sample_bits) {
+            if (!set_sampled(cache, refs[level].index)) { // dropped before any tag work
+                estimate = sampled_latency(cache, access_type == 1);
+                cache->filtered++;
+                cache->filtered_side[access_type == 1]++;
+                cache->filtered_charged[access_type == 1] += estimate;
+                latency += estimate;
+                filtered = 1;
+                break;
+            }
+            latency_above[level] = latency;
+        }
+        cache->accesses++;
+        latency += cache->access_latency;
+        if ((ways[level] = cache->probe(ctx, cache, &refs[level])) != WAY_NONE) {
+            cache->hits++;
+            hit = 1;
+            break;
+        }
+    }
+    unsigned long probed = level + hit;
+    Mshr *reserved[MAX_CACHE_LEVELS];
+    unsigned long num_reserved = 0;
+    if (ctx->config.issue_window) // overlapping accesses, latencies start over from the issue
+        latency = timed_lookup(ctx, path, translation, probed, hit, filtered, estimate, paddr, reserved,
+                               &num_reserved);
+    else if (!hit && !filtered) // no cache hit, go to main memory
+        latency += memory_latency(ctx, paddr, ctx->cycles + latency);
+    if (ctx->sampling && ctx->phase == PHASE_MEASURE) // warm-ups are not sampled
+        record_samples(path, refs, latency_above, probed, hit, latency, access_type == 1);
+    unsigned long moved = level;
+    int moved_dirty = 0;
+    if (hit && path[level]->inclusion == INCLUSION_EXCLUSIVE)
+        moved = exclusive_hit(path, level, &refs[level], ways[level], write, &moved_dirty);
+    
+    // elevate data into every level above the one that supplied it, lowest first
+    while (level-- > 0) {
+        CacheLevel *cache = path[level];
+        if (!fills_level(cache, write))
+            continue;
+        if (cache->vaddr_indexed) // looked up by vaddr, filled by paddr
+            refs[level] = set_ref(cache, paddr);
+        fill_level(ctx, cache, &refs[level]);
+        allocated = 1;
+    }
+    if (!hit && !filtered && (allocated || !write))
+        memory_traffic(ctx, last_line_size(ctx, path), 0);
+    if (moved_dirty)
+        set_line_dirty(path[moved], paddr);
+    if (write)
+        write_down(ctx, path[0], paddr, first_line_size(ctx, path));
+    if (ctx->prefetching)
+        prefetch_accesses(ctx, path, 0, probed, refs, ways, paddr, &latency);
+    if (ctx->config.issue_window) {
+        timed_retire(ctx, reserved, num_reserved, latency);
+    } else {
+        ctx->cycles += latency;
+        bandwidth_advance(ctx, latency);
+    }
+    
+    if (access_type == 1) {
+        ctx->total_latency_instr += latency;
+        ctx->instr_accesses++;
+    } else {
+        ctx->total_latency_data += latency;
+        ctx->data_accesses++;
+    }
+    ctx->mem_accesses++;
+    if (*ctx->interval_clock >= ctx->interval_next)
+        interval_snapshot(ctx);
+    
+    return latency;
+}
+
+// Functional warming: the lookups and fills of access_memory, without latency or counters.
+static inline void warm_memory(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type,
+                               AccessSets *sets, int resolved) {
+    ctx->current_time++;
+    if (ctx->mmu)
+        translate(ctx, vaddr, access_type == 1, 1);
+    CacheLevel **path = ctx->path[access_type == 1];
+    SetRef *refs = sets->ref;
+    unsigned long ways[MAX_CACHE_LEVELS];
+    unsigned long level, probed = ctx->path_len;
+    for (level = 0; level < ctx->path_len; level++) {
+        CacheLevel *cache = path[level];
+        if (!resolved)
+            refs[level] = set_ref(cache, cache->vaddr_indexed ? vaddr : paddr);
+        if (!set_sampled(cache, refs[level].index)) {
+            probed = level;
+            break;
+        }
+        if ((ways[level] = cache->probe(ctx, cache, &refs[level])) != WAY_NONE) {
+            probed = level + 1;
+            break;
+        }
+    }
+    int write = (access_type == 2), moved_dirty = 0;
+    unsigned long moved = level;
+    if (level < ctx->path_len && probed == level + 1 && path[level]->inclusion == INCLUSION_EXCLUSIVE)
+        moved = exclusive_hit(path, level, &refs[level], ways[level], write, &moved_dirty);
+    while (level-- > 0) {
+        CacheLevel *cache = path[level];
+        if (!fills_level(cache, write))
+            continue;
+        if (cache->vaddr_indexed)
+            refs[level] = set_ref(cache, paddr);
+        fill_level(ctx, cache, &refs[level]);
+    }
+    if (moved_dirty)
+        set_line_dirty(path[moved], paddr);
+    if (write) // keeps the dirty bits right for what follows
+        write_down(ctx, path[0], paddr, first_line_size(ctx, path));
+    if (ctx->prefetching) { // trained, the waits are not charged
+        unsigned long latency = 0;
+        prefetch_accesses(ctx, path, 0, probed, refs, ways, paddr, &latency);
+    }
+}
+
+// Multi-core hierarchies. The directory tracks which cores hold each line in any of their
+// private caches; shared levels are looked up as in access_memory, but only by accesses
+// that miss every private level and are not supplied by another core.
+
+// returns whether the copy it dropped was dirty
+static int flush_cache_line(CacheLevel *cache, unsigned long paddr) {
+    if (cache == NULL)
+        return 0;
+    SetRef ref = set_ref(cache, paddr);
+    if (!set_sampled(cache, ref.index))
+        return 0;
+    unsigned long way = find_way(cache, &ref);
+    if (way == WAY_NONE)
+        return 0;
+    clear_line(cache, &ref, way);
+    return (cache->dirty[ref.index * cache->valid_words + way / 64] >> (way % 64)) & 1;
+}
+
+// leaves the copies of paddr in cores' private caches clean
+static void clean_private(SimContext *ctx, uint64_t cores, unsigned long paddr) {
+    for (; cores; cores &= cores - 1) {
+        const SimCore *core = &ctx->cores[__builtin_ctzll(cores)];
+        for (unsigned long i = 0; i < core->num_private; i++) {
+            CacheLevel *cache = core->private_caches[i];
+            SetRef ref = set_ref(cache, paddr);
+            unsigned long way = find_way(cache, &ref);
+            if (way != WAY_NONE)
+                cache->dirty[ref.index * cache->valid_words + way / 64] &= ~((uint64_t)1 << (way % 64));
+        }
+    }
+}
+
+static int core_holds(const SimCore *core, unsigned long paddr) {
+    for (unsigned long i = 0; i < core->num_private; i++) {
+        SetRef ref = set_ref(core->private_caches[i], paddr);
+        if (find_way(core->private_caches[i], &ref) != WAY_NONE)
+            return 1;
+    }
+    return 0;
+}
+
+// an entry nobody holds or has lost to an invalidation is dropped
+static inline void dir_release(SimContext *ctx, DirEntry *entry) {
+    if (!entry->sharers && !entry->stale)
+        dir_remove(&ctx->directory, entry);
+}
+
+// After a fill into one of core c's private caches: a replaced line that the core no
+// longer holds anywhere leaves its sharers (silently for clean lines, a write-back for M).
+static void private_evicted(SimContext *ctx, unsigned long c, const CacheLevel *cache, const SetRef *ref) {
+    if (!cache->evicted_valid)
+        return;
+    unsigned long paddr = line_address(cache, ref->index, cache->evicted_tag);
+    if (core_holds(&ctx->cores[c], paddr))
+        return;
+    DirEntry *entry = dir_find(&ctx->directory, paddr / ctx->coherence_line);
+    if (!entry)
+        return;
+    entry->sharers &= ~((uint64_t)1 << c);
+    if (!entry->sharers)
+        entry->exclusive = entry->dirty = 0;
+    dir_release(ctx, entry);
+}
+
+// invalidates every copy of entry's line outside core c, returns the latency of doing so
+static unsigned long invalidate_sharers(SimContext *ctx, DirEntry *entry, unsigned long c) {
+    uint64_t self = (uint64_t)1 << c, others = entry->sharers & ~self;
+    if (!others)
+        return 0;
+    unsigned long paddr = entry->line * ctx->coherence_line;
+    while (others) {
+        unsigned long o = __builtin_ctzll(others);
+        others &= others - 1;
+        const SimCore *core = &ctx->cores[o];
+        for (unsigned long i = 0; i < core->num_private; i++)
+            flush_cache_line(core->private_caches[i], paddr);
+        ctx->invalidations++;
+    }
+    entry->stale |= entry->sharers & ~self;
+    entry->sharers &= self;
+    return ctx->config.invalidate_latency;
+}
+
+static unsigned long access_coherent(SimContext *ctx, unsigned long c, unsigned long vaddr, unsigned long paddr,
+                                     unsigned long access_type) {
+    ctx->current_time++;
+    SimCore *core = &ctx->cores[c];
+    CacheLevel **path = core->path[access_type == 1];
+    SetRef refs[MAX_CACHE_LEVELS];
+    unsigned long ways[MAX_CACHE_LEVELS];
+    uint64_t self = (uint64_t)1 << c;
+    int write = (access_type == 2), hit = 0;
+    unsigned long latency = 0, level;
+
+    for (level = 0; level < ctx->private_levels; level++) {
+        CacheLevel *cache = path[level];
+        refs[level] = set_ref(cache, cache->vaddr_indexed ? vaddr : paddr);
+        cache->accesses++;
+        latency += cache->access_latency;
+        if ((ways[level] = cache->probe(ctx, cache, &refs[level])) != WAY_NONE) {
+            cache->hits++;
+            hit = 1;
+            break;
+        }
+    }
+
+    // directory work first, the fills below may move entries
+    uint64_t line = paddr / ctx->coherence_line;
+    int supplied = hit;
+    if (hit) {
+        if (write) { // E -> M silently, S -> M after invalidating the other copies
+            DirEntry *entry = dir_insert(&ctx->directory, line);
+            if (!entry->exclusive) { // the directory grants ownership once the other copies are gone
+                invalidate_sharers(ctx, entry, c);
+                latency += ctx->config.invalidate_latency;
+            }
+            entry->sharers |= self;
+            entry->exclusive = entry->dirty = 1;
+        }
+    } else {
+        DirEntry *entry = dir_insert(&ctx->directory, line);
+        if (entry->stale & self) {
+            ctx->coherence_misses++;
+            entry->stale &= ~self;
+        }
+        uint64_t others = entry->sharers & ~self;
+        if (others && entry->exclusive && entry->dirty) { // the owner supplies its modified copy
+            ctx->c2c_transfers++;
+            latency += ctx->config.c2c_latency;
+            supplied = 1;
+            if (!write) { // and writes it back below the private levels
+                clean_private(ctx, others, paddr);
+                write_down(ctx, ctx->private_levels < ctx->path_len ? path[ctx->private_levels] : NULL, paddr,
+                           ctx->coherence_line);
+            }
+        }
+        if (write) {
+            latency += invalidate_sharers(ctx, entry, c);
+            entry->exclusive = entry->dirty = 1;
+        } else {
+            entry->exclusive = !others; // E when alone, otherwise everyone ends in S
+            entry->dirty = 0;           // a forwarded M line is written back as it goes to S
+        }
+        entry->sharers |= self;
+    }
+
+    if (!supplied) {
+        for (; level < ctx->path_len; level++) {
+            CacheLevel *cache = path[level];
+            refs[level] = set_ref(cache, paddr);
+            cache->accesses++;
+            latency += cache->access_latency;
+            if ((ways[level] = cache->probe(ctx, cache, &refs[level])) != WAY_NONE) {
+                cache->hits++;
+                hit = 1;
+                break;
+            }
+        }
+        if (!hit)
+            latency += memory_latency(ctx, paddr, ctx->cycles + latency);
+    }
+    int allocated = 0, moved_dirty = 0;
+    // only the shared levels have prefetchers, and only a shared hit ends past the private ones
+    unsigned long probed = (level < ctx->path_len && hit) ? level + 1 : level;
+    unsigned long moved = level;
+    if (hit && path[level]->inclusion == INCLUSION_EXCLUSIVE)
+        moved = exclusive_hit(path, level, &refs[level], ways[level], write, &moved_dirty);
+
+    while (level-- > 0) {
+        CacheLevel *cache = path[level];
+        if (!fills_level(cache, write))
+            continue;
+        if (cache->vaddr_indexed)
+            refs[level] = set_ref(cache, paddr);
+        fill_level(ctx, cache, &refs[level]);
+        if (level < ctx->private_levels)
+            private_evicted(ctx, c, cache, &refs[level]);
+        allocated = 1;
+    }
+    if (!hit && !supplied && (allocated || !write))
+        memory_traffic(ctx, last_line_size(ctx, path), 0);
+    if (moved_dirty)
+        set_line_dirty(path[moved], paddr);
+    if (write)
+        write_down(ctx, path[0], paddr, first_line_size(ctx, path));
+    if (ctx->prefetching && !supplied)
+        prefetch_accesses(ctx, path, ctx->private_levels, probed, refs, ways, paddr, &latency);
+    ctx->cycles += latency;
+    bandwidth_advance(ctx, latency);
+
+    if (access_type == 1) {
+        ctx->total_latency_instr += latency;
+        ctx->instr_accesses++;
+    } else {
+        ctx->total_latency_data += latency;
+        ctx->data_accesses++;
+    }
+    ctx->mem_accesses++;
+    core->accesses++;
+    core->total_latency += latency;
+    if (*ctx->interval_clock >= ctx->interval_next)
+        interval_snapshot(ctx);
+    return latency;
+}
+
+unsigned long sim_access(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!ctx->counting) 
+    return 0;  // simulator inactive
+    if (ctx->num_cores > 1)
+        return access_coherent(ctx, 0, vaddr, paddr, access_type);
+    AccessSets sets;
+    if (ctx->config.sample_period) {
+        if (ctx->phase_left == 0)
+            next_phase(ctx);
+        ctx->phase_left--;
+        if (ctx->phase != PHASE_MEASURE)
+            ctx->warmed_accesses++;
+        if (ctx->phase == PHASE_WARMING) {
+            warm_memory(ctx, vaddr, paddr, access_type, &sets, 0);
+            return 0;
+        }
+    }
+    return access_memory(ctx, vaddr, paddr, access_type, &sets, 0);
+}
+
+unsigned long sim_access_core(SimContext *ctx, unsigned long core, unsigned long vaddr, unsigned long paddr,
+                              unsigned long access_type) {
+    if (ctx->num_cores == 1)
+        return sim_access(ctx, vaddr, paddr, access_type);
+    if (!ctx->counting)
+        return 0;
+    if (core >= ctx->num_cores)
+        core %= ctx->num_cores;
+    return access_coherent(ctx, core, vaddr, paddr, access_type);
+}
+
+unsigned long sim_access_signed(SimContext *ctx, unsigned long core, unsigned long vaddr, unsigned long paddr,
+                                unsigned long access_type, uint64_t signature) {
+    ctx->signed_access = 1;
+    ctx->signature = signature;
+    unsigned long latency = sim_access_core(ctx, core, vaddr, paddr, access_type);
+    ctx->signed_access = 0;
+    return latency;
+}
+
+// The batch path resolves every lookup set BATCH_PREFETCH_DISTANCE records ahead and
+// prefetches its tags, valid bits and ages, so the host-side misses on large L3/L4
+// models overlap with simulating the records in between.
+#define BATCH_PREFETCH_DISTANCE 8
+#define BATCH_RING_SIZE 16 // power of two > BATCH_PREFETCH_DISTANCE
+
+static inline void batch_resolve(SimContext *ctx, AccessSets *sets, const MemoryAccess *access) {
+    CacheLevel **path = ctx->path[access->access_type == 1];
+    for (unsigned long level = 0; level < ctx->path_len; level++) {
+        CacheLevel *cache = path[level];
+        SetRef *ref = &sets->ref[level];
+        *ref = set_ref(cache, cache->vaddr_indexed ? access->vaddr : access->paddr);
+        if (!set_sampled(cache, ref->index))
+            break; // the access stops here
+        __builtin_prefetch(cache->tags + ref->index * cache->associativity);
+        __builtin_prefetch(cache->valid + ref->index * cache->valid_words);
+        if (cache->ages)
+            __builtin_prefetch(cache->ages + ref->index * cache->associativity);
+        else if (cache->plru)
+            __builtin_prefetch(cache->plru + ref->index);
+        else
+            __builtin_prefetch(cache->rrpv + ref->index * cache->associativity);
+    }
+}
+
+// accesses of one sampling phase, functionally warmed when warming is set
+static void access_run(SimContext *ctx, const MemoryAccess *accesses, unsigned long count, unsigned long *latencies,
+                       int warming) {
+    AccessSets ring[BATCH_RING_SIZE];
+    for (unsigned long i = 0; i < count && i < BATCH_PREFETCH_DISTANCE; i++)
+        batch_resolve(ctx, &ring[i], &accesses[i]);
+    for (unsigned long i = 0; i < count; i++) {
+        if (i + BATCH_PREFETCH_DISTANCE < count)
+            batch_resolve(ctx, &ring[(i + BATCH_PREFETCH_DISTANCE) % BATCH_RING_SIZE], &accesses[i + BATCH_PREFETCH_DISTANCE]);
+        const MemoryAccess *access = &accesses[i];
+        unsigned long latency = 0;
+        if (warming)
+            warm_memory(ctx, access->vaddr, access->paddr, access->access_type, &ring[i % BATCH_RING_SIZE], 1);
+        else
+            latency = access_memory(ctx, access->vaddr, access->paddr, access->access_type,
+                                    &ring[i % BATCH_RING_SIZE], 1);
+        if (latencies)
+            latencies[i] = latency;
+    }
+}
+
+void sim_access_batch(SimContext *ctx, const MemoryAccess *accesses, unsigned long count, unsigned long *latencies) {
+    if (!ctx->counting) { // simulator inactive
+        if (latencies)
+            memset(latencies, 0, count * sizeof(*latencies));
+        return;
+    }
+    if (ctx->num_cores > 1) {
+        for (unsigned long i = 0; i < count; i++) {
+            unsigned long core = accesses[i].core;
+            if (core >= ctx->num_cores)
+                core %= ctx->num_cores;
+            unsigned long latency = access_coherent(ctx, core, accesses[i].vaddr, accesses[i].paddr,
+                                                    accesses[i].access_type);
+            if (latencies)
+                latencies[i] = latency;
+        }
+        return;
+    }
+    if (!ctx->config.sample_period) {
+        access_run(ctx, accesses, count, latencies, 0);
+        return;
+    }
+    // split the batch at phase boundaries
+    for (unsigned long i = 0; i < count;) {
+        if (ctx->phase_left == 0)
+            next_phase(ctx);
+        unsigned long run = count - i < ctx->phase_left ? count - i : ctx->phase_left;
+        if (ctx->phase != PHASE_MEASURE)
+            ctx->warmed_accesses += run;
+        access_run(ctx, accesses + i, run, latencies ? latencies + i : NULL, ctx->phase == PHASE_WARMING);
+        ctx->phase_left -= run;
+        i += run;
+    }
+}
+
+unsigned long sim_prefetch(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!ctx->counting) 
+      return 0;  // simulator inactive
+    if (ctx->num_cores > 1)
+        return 0; // software prefetches are not modelled across cores
+    ctx->current_time++;
+    unsigned long latency = 0;
+    unsigned long side = (access_type == 1);
+    CacheLevel *l1 = get_level(ctx, 1, side);
+    CacheLevel *l2 = get_level(ctx, 2, side);
+    if (l1 == NULL)
+        return 0;
+    
+    SetRef l1_ref = set_ref(l1, paddr);
+    if (!set_sampled(l1, l1_ref.index))
+        return 0; // unsampled set, never looked at
+    if (find_way(l1, &l1_ref) != WAY_NONE)
+        return 0; // already there
+    if (l1->mshr && !sw_prefetch_issue(ctx, ctx->path[side], 0, paddr))
+        return 0; // every MSHR busy, dropped
+    
+    if (l2 != NULL) {
+        SetRef l2_ref = set_ref(l2, paddr);
+        if (set_sampled(l2, l2_ref.index))
+            l2->probe(ctx, l2, &l2_ref);
+        latency += l2->access_latency;
+    }
+    
+    fill_level(ctx, l1, &l1_ref);
+    latency += l1->access_latency;
+    return latency;
+}
+
+
+// path levels of core c that are its own: all of them for core 0, the private ones for the others
+static inline unsigned long core_levels(const SimContext *ctx, unsigned long c) {
+    return c ? ctx->private_levels : ctx->path_len;
+}
+
+// after paddr was flushed or invalidated: its line leaves the sharers that no longer hold it
+static void coherent_forget(SimContext *ctx, unsigned long paddr) {
+    DirEntry *entry = dir_find(&ctx->directory, paddr / ctx->coherence_line);
+    if (!entry)
+        return;
+    for (uint64_t sharers = entry->sharers; sharers; sharers &= sharers - 1) {
+        unsigned long c = __builtin_ctzll(sharers);
+        if (!core_holds(&ctx->cores[c], paddr))
+            entry->sharers &= ~((uint64_t)1 << c);
+    }
+    if (!entry->sharers)
+        entry->exclusive = entry->dirty = 0;
+    dir_release(ctx, entry);
+}
+
+// flushes reach every core's copy, and a dirty one is written to memory
+static void flush_side(SimContext *ctx, unsigned long side, unsigned long paddr) {
+    int dirty = 0;
+    for (unsigned long c = 0; c < ctx->num_cores; c++) {
+        for (unsigned long level = 0; level < core_levels(ctx, c); level++)
+            dirty |= flush_cache_line(ctx->cores[c].path[side][level], paddr);
+    }
+    if (dirty)
+        memory_write(ctx, paddr, last_line_size(ctx, ctx->path[side]));
+    if (ctx->num_cores > 1)
+        coherent_forget(ctx, paddr);
+}
+
+void sim_flush_instruction(SimContext *ctx, unsigned long paddr) {
+    if (!ctx->counting) return;
+    flush_side(ctx, 1, paddr);
+}
+
+void sim_flush_data(SimContext *ctx, unsigned long paddr) {
+    if (!ctx->counting) return;
+    flush_side(ctx, 0, paddr);
+}
+
+void sim_invalidate(SimContext *ctx, unsigned long paddr) {
+    if (!ctx->counting) return;
+    for (unsigned long c = 0; c < ctx->num_cores; c++) {
+        CacheLevel *(*path)[MAX_CACHE_LEVELS] = ctx->cores[c].path;
+        for (unsigned long level = 0; level < core_levels(ctx, c); level++) {
+            if (path[1][level] != path[0][level])
+                flush_cache_line(path[1][level], paddr);
+            flush_cache_line(path[0][level], paddr);
+        }
+    }
+    if (ctx->num_cores > 1)
+        coherent_forget(ctx, paddr);
+}
+
+static void invalidate_level(CacheLevel *cache) {
+    memset(cache->valid, 0, sizeof(uint64_t) * cache->num_sets * cache->valid_words);
+}
+
+void sim_invalidate_all(SimContext *ctx) {
+    if (!ctx->counting) return;
+    for (unsigned long c = 0; c < ctx->num_cores; c++) {
+        CacheLevel *(*path)[MAX_CACHE_LEVELS] = ctx->cores[c].path;
+        for (unsigned long level = 0; level < core_levels(ctx, c); level++) {
+            if (path[1][level] != path[0][level])
+                invalidate_level(path[1][level]);
+            invalidate_level(path[0][level]);
+        }
+    }
+    dir_clear(&ctx->directory);
+}
+
+
+static void prefetch_into_cache(SimContext *ctx, unsigned long side, CacheLevel *cache, unsigned long paddr) {
+    if (cache == NULL) return;
+    SetRef ref = set_ref(cache, paddr);
+    if (!set_sampled(cache, ref.index) || find_way(cache, &ref) != WAY_NONE)
+        return; // unsampled set or already there
+    if (cache->mshr && !sw_prefetch_issue(ctx, ctx->path[side], cache->depth, paddr))
+        return;
+    fill_level(ctx, cache, &ref);
+}
+
+// prefetches paddr into config levels first..last of one side, returns their summed latency
+static unsigned long prefetch_levels(SimContext *ctx, unsigned long side, unsigned long first, unsigned long last, unsigned long paddr) {
+    unsigned long latency = 0;
+    if (ctx->num_cores > 1)
+        return 0;
+    for (unsigned long n = first; n <= last; n++) {
+        CacheLevel *cache = get_level(ctx, n, side);
+        if (cache) {
+            prefetch_into_cache(ctx, side, cache, paddr);
+            latency += cache->access_latency;
+        }
+    }
+    return latency;
+}
+
+unsigned long sim_prefetch_t0(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!ctx->counting) return 0;
+    ctx->current_time++;
+    return prefetch_levels(ctx, access_type == 1, 1, 3, paddr);
+}
+
+unsigned long sim_prefetch_t1(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!ctx->counting) return 0;
+    ctx->current_time++;
+    return prefetch_levels(ctx, access_type == 1, 2, 3, paddr);
+}
+
+unsigned long sim_prefetch_t2(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!ctx->counting) return 0;
+    ctx->current_time++;
+    if (get_level(ctx, 3, access_type == 1) == NULL)
+        return ctx->config.mem_latency;
+    return prefetch_levels(ctx, access_type == 1, 3, 3, paddr);
+}
+
+unsigned long sim_prefetch_nta(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!ctx->counting) return ctx->config.mem_latency;
+    ctx->current_time++;
+    return ctx->config.mem_latency;
+}
+
+unsigned long sim_prefetch_w(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    if (!ctx->counting) return 0;
+    ctx->current_time++;
+    if (access_type != 0)
+        return 0;
+    return prefetch_levels(ctx, 0, 1, 1, paddr);
+}
+
+
+// legacy API over the default context
+
+void init(void) {
+    sim_destroy(g_sim);
+    g_sim = sim_create(CONFIG);
+}
+
+void start(void) {
+    if (g_sim) sim_start(g_sim);
+}
+
+void end(void) {
+    if (g_sim) sim_end(g_sim);
+}
+
+void deinit(void) {
+    sim_destroy(g_sim);
+    g_sim = NULL;
+}
+
+unsigned long simulate_memory_access(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    return g_sim ? sim_access(g_sim, vaddr, paddr, access_type) : 0;
+}
+
+unsigned long simulate_memory_access_core(unsigned long core, unsigned long vaddr, unsigned long paddr,
+                                          unsigned long access_type) {
+    return g_sim ? sim_access_core(g_sim, core, vaddr, paddr, access_type) : 0;
+}
+
+unsigned long simulate_memory_access_signed(unsigned long core, unsigned long vaddr, unsigned long paddr,
+                                            unsigned long access_type, uint64_t signature) {
+    return g_sim ? sim_access_signed(g_sim, core, vaddr, paddr, access_type, signature) : 0;
+}
+
+void simulate_memory_access_batch(const MemoryAccess *accesses, unsigned long count, unsigned long *latencies) {
+    if (g_sim)
+        sim_access_batch(g_sim, accesses, count, latencies);
+    else if (latencies)
+        memset(latencies, 0, count * sizeof(*latencies));
+}
+
+unsigned long simulate_prefetch(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    return g_sim ? sim_prefetch(g_sim, vaddr, paddr, access_type) : 0;
+}
+
+void flush_instruction(unsigned long paddr) {
+    if (g_sim) sim_flush_instruction(g_sim, paddr);
+}
+
+void flush_data(unsigned long paddr) {
+    if (g_sim) sim_flush_data(g_sim, paddr);
+}
+
+void invalidate(unsigned long paddr) {
+    if (g_sim) sim_invalidate(g_sim, paddr);
+}
+
+void invalidate_all(void) {
+    if (g_sim) sim_invalidate_all(g_sim);
+}
+
+unsigned long simulate_prefetch_t0(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    return g_sim ? sim_prefetch_t0(g_sim, vaddr, paddr, access_type) : 0;
+}
+
+unsigned long simulate_prefetch_t1(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    return g_sim ? sim_prefetch_t1(g_sim, vaddr, paddr, access_type) : 0;
+}
+
+unsigned long simulate_prefetch_t2(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    return g_sim ? sim_prefetch_t2(g_sim, vaddr, paddr, access_type) : 0;
+}
+
+unsigned long simulate_prefetch_nta(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    return g_sim ? sim_prefetch_nta(g_sim, vaddr, paddr, access_type) : 0;
+}
+
+unsigned long simulate_prefetch_w(unsigned long vaddr, unsigned long paddr, unsigned long access_type) {
+    return g_sim ? sim_prefetch_w(g_sim, vaddr, paddr, access_type) : 0;
+}
@@ -6,26 +6,110 @@
 #include <stdint.h>
 #include <limits.h>
 #include <string.h>
+#include "coherence.h"
+#include "dram.h"
+#include "interval.h"
+#include "prefetch.h"
+#include "tlb.h"
 
 #define CONFIG "configDEFAULT.txt"
 
 typedef enum {
     POLICY_LRU,
     POLICY_BIP,
-    POLICY_RANDOM
+    POLICY_RANDOM,
+    POLICY_PLRU_TREE, // tree pseudo-LRU, power-of-two associativity up to 64
+    POLICY_PLRU_BIT,  // MRU-bit pseudo-LRU, up to 64 ways
+    POLICY_SRRIP,     // static re-reference interval prediction, 2-bit RRPVs
+    POLICY_BRRIP,     // bimodal RRIP: SRRIP that inserts at distant re-reference 31 times in 32
+    POLICY_DRRIP,     // SRRIP/BRRIP set dueling
+    POLICY_SHIP,      // SRRIP with insertion predicted from the signature's reuse history
+    POLICY_DIP        // LRU/BIP set dueling
 } ReplacementPolicy;
 
-typedef struct {
-    unsigned int tag;
-    unsigned long valid;
-    unsigned long last_access_time;  // used for LRU/BIP 
-} CacheLine;
+// what update_policy is told about the way it is given
+typedef enum {
+    POLICY_HIT,  // a lookup hit it
+    POLICY_FILL  // a miss just installed a line in it (evicted_valid/evicted_tag hold the old one)
+} PolicyEvent;
+
+// how a level relates to the levels above it (L<n>_INCLUSION)
+typedef enum {
+    INCLUSION_NINE,      // filled by every miss through it, evicts without telling anyone
+    INCLUSION_INCLUSIVE, // holds everything above it: its evictions back-invalidate their copies
+    INCLUSION_EXCLUSIVE  // holds nothing above it: filled by the victims of the level above, a hit moves the line up
+} InclusionPolicy;
 
+// re-reference prediction values of the RRIP policies: 0 is near-immediate, 3 distant
+#define RRPV_MAX 3
+#define PSEL_MAX 1023   // 10-bit set-dueling selector
+#define DUEL_LEADERS 32 // leader sets of each dueling policy
+#define SHIP_SIGNATURE_BITS 14
+#define SHIP_SHCT_SIZE (1 << SHIP_SIGNATURE_BITS)
+#define SHIP_COUNTER_MAX 7 // 3-bit reuse counters
+#define SHIP_REGION_SHIFT 14 // without an explicit signature, an access is signed by its 16 KB region
+
+// returned by lookups that find no matching way
+#define WAY_NONE ULONG_MAX
+
+// view of one set inside its level's tag store
 typedef struct {
     unsigned long num_lines; // == associativity
-    CacheLine *lines;               
+    unsigned int *tags;
+    uint64_t *valid;                  // bit i of word i/64 set when way i holds a line
+    unsigned long *last_access_time;  // used for LRU/BIP/DIP, NULL for the other policies
+    uint64_t *plru;                   // the set's PLRU word, NULL for the other policies
+    uint8_t *rrpv;                    // RRPV per way for the RRIP policies, else NULL
+    uint16_t *ship;                   // SHiP: per way, see CacheLevel.ship
+    unsigned long index;
+    struct CacheLevel *level;         // for the level-wide state of the dueling and SHiP policies
 } CacheSet;
 
+// set and tag an address maps to in one level
+typedef struct {
+    unsigned long index;
+    unsigned int tag;
+} SetRef;
+
+typedef struct SimContext SimContext;
+
+// per-set counters of a set-sampled level, for the confidence intervals
+typedef struct {
+    unsigned long accesses[2]; // data, instruction
+    unsigned long misses;
+    unsigned long latency[2];  // from this level down
+} SetSample;
+
+// hardware prefetcher outcomes at one level, counted while measuring
+typedef struct {
+    unsigned long issued;        // prefetch fills (lines already present are not fetched)
+    unsigned long useful;        // prefetched lines a demand access hit before their eviction
+    unsigned long late;          // of those, hit before the prefetch had arrived
+    unsigned long late_cycles;   // cycles demand accesses waited for late prefetches
+    unsigned long useless;       // prefetched lines evicted without a demand hit
+    unsigned long pollution;     // demand misses on lines that a prefetch fill had evicted
+    unsigned long demand_misses;
+    unsigned long dropped;       // prefetches that found every MSHR busy (ISSUE_WINDOW)
+} PrefetchStats;
+
+// what an MSHR entry is fetching; a demand access waits on the first two kinds, hardware
+// prefetches are waited on through CacheLevel.prefetch_ready instead
+typedef enum {
+    MSHR_DEMAND,
+    MSHR_SW_PREFETCH,
+    MSHR_HW_PREFETCH
+} MshrKind;
+
+// a miss in flight from one level, the entry is free again once its fill has arrived
+typedef struct {
+    uint64_t line;       // physical address / line size
+    unsigned long ready; // cycle the fill arrives
+    MshrKind kind;
+} Mshr;
+
+// compares the first n (<= 64) tags against tag, bit i of the result set on a match
+typedef uint64_t (*WayMatchFn)(const unsigned int *tags, unsigned long n, unsigned int tag);
+
 typedef struct CacheLevel {
     unsigned long cache_size; // bytes
     unsigned long associativity;
@@ -33,67 +117,501 @@ typedef struct CacheLevel {
     unsigned long num_sets;          
     unsigned long access_latency; // cycles
     ReplacementPolicy policy;
-    CacheSet *sets;                  
+    unsigned long vaddr_indexed; // looked up by vaddr (L1), filled by paddr
+    unsigned long write_through;  // stores pass on to the level below instead of dirtying the line
+    unsigned long write_allocate; // a store miss fills the level
+    struct CacheLevel *below;     // where write-backs go, NULL for memory
+    InclusionPolicy inclusion;
+    unsigned long depth;          // position in the lookup path, the levels above are [0, depth)
+    unsigned long shared;         // one copy for all cores, else core `owner`'s own
+    unsigned long owner;
+
+    unsigned long accesses;
+    unsigned long hits;
+
+    // structure-of-arrays tag store, set i owns ways [i * associativity, (i + 1) * associativity)
+    // of tags/ages/rrpv/ship, words [i * valid_words, (i + 1) * valid_words) of valid and word i
+    // of plru. Each policy keeps one of ages, plru and rrpv as its replacement state: the PLRU
+    // policies plru, the RRIP ones (SRRIP, BRRIP, DRRIP, SHiP) rrpv, the others ages.
+    unsigned int *tags;
+    uint64_t *valid;
+    uint64_t *dirty; // laid out like valid, meaningful for valid ways only
+    unsigned long *ages;
+    uint64_t *plru;
+    uint8_t *rrpv;
+    unsigned long valid_words;
+    WayMatchFn match_ways;
+    unsigned long mapped_store; // tags/valid/dirty live in the context's restored checkpoint
+    unsigned long mapped_state; // ages/plru/rrpv do too
+
+    // Set dueling (DIP, DRRIP): a few leader sets always follow the first policy (LRU,
+    // SRRIP) or the second (BIP, BRRIP), and their misses move psel, which the other sets
+    // follow. Not part of checkpoints.
+    unsigned long duel_stride; // sets per constituency, each has one leader of either policy
+    unsigned long psel;        // saturating at PSEL_MAX, the followers take the second policy above half
+
+    // SHiP: per way the signature of the access that filled it (low 14 bits) and, in the top
+    // bit, whether the line has been hit since; shct counts per signature (SHIP_SHCT_SIZE)
+    // how often its lines were reused. Not part of checkpoints.
+    uint16_t *ship;
+    uint8_t *shct;
+
+    // power-of-two geometry: set index = (addr >> line_shift) & set_mask, tag = addr >> tag_shift
+    unsigned long pow2_geometry;
+    unsigned long line_shift;
+    unsigned long set_mask;
+    unsigned long tag_shift;
+
+    // Set sampling (L<n>_SAMPLE_SETS): only sets with their bit in sample_bits are simulated.
+    // An access to another set goes no further and is charged the average latency that
+    // sampled accesses of its side (data or instruction) saw from this level down.
+    // accesses/hits count sampled accesses only.
+    uint64_t *sample_bits;        // NULL when every set is simulated
+    unsigned long sampled_sets;
+    unsigned long filtered;       // accesses that reached an unsampled set
+    unsigned long filtered_side[2];    // of them, data and instruction
+    unsigned long filtered_charged[2]; // running estimates charged to them, re-priced in reports
+    unsigned long sample_accesses[2]; // sampled accesses, data and instruction
+    unsigned long sample_latency[2];  // latency from this level down, summed over them
+    unsigned long miss_latency;   // charged to filtered accesses until a sampled one is seen
+    SetSample *set_samples;       // [num_sets], only sampled sets are used
+
+    // the line the last fill replaced, for callers that track evictions
+    unsigned long evicted_valid;
+    unsigned int evicted_tag;
+    unsigned long evicted_way;
 
-    void (*update_policy)(CacheSet *set, unsigned long line_index);
-    unsigned long (*find_victim)(CacheSet *set);
+    // lines this level sent down, counted while measuring: dirty lines it evicted, and
+    // stores it passed on as a write-through level
+    unsigned long writebacks;
+    unsigned long write_throughs;
+    // inclusion, counted while measuring: copies above that this inclusive level's evictions
+    // invalidated, and victims of the level above that this exclusive one took in
+    unsigned long inclusion_victims;
+    unsigned long victims_taken;
+
+    // Hardware prefetcher (L<n>_PREFETCHER), NULL without one. A way filled by a prefetch
+    // has its bit in prefetched (laid out like valid) until a demand hit or its eviction,
+    // and arrives at prefetch_ready on the context's cycle clock. pollution_filter remembers,
+    // direct-mapped, line number + 1 of lines that prefetch fills evicted.
+    Prefetcher *prefetcher;
+    uint64_t *prefetched;
+    unsigned long *prefetch_ready;
+    uint64_t *pollution_filter;
+    PrefetchStats prefetch;
+
+    // MSHRs (L<n>_MSHRS), allocated with ISSUE_WINDOW only. Counted while measuring: accesses
+    // that found their line still in flight and waited for it, and misses that found every
+    // entry busy and waited for the first to free up.
+    Mshr *mshr;
+    unsigned long mshrs;
+    unsigned long mshr_merges;
+    unsigned long mshr_stalls;
+    unsigned long mshr_stall_cycles;
+
+    void (*update_policy)(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+    unsigned long (*find_victim)(SimContext *ctx, CacheSet *set);
+
+    // access kernels (kernels.c): probe returns the hit way (updating the policy) or WAY_NONE,
+    // fill installs ref's tag over the policy's victim
+    unsigned long (*probe)(SimContext *ctx, struct CacheLevel *cache, SetRef *ref);
+    void (*fill)(SimContext *ctx, struct CacheLevel *cache, SetRef *ref);
+    const char *kernel_name;
 } CacheLevel;
 
+// ways of a set of at most 64 as a bit mask
+static inline uint64_t way_mask(unsigned long ways) {
+    return ways >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << ways) - 1;
+}
+
+// Tree PLRU: node i (1 <= i < ways) of a heap-ordered binary tree over the ways is bit i
+// of the set's word, clear to send the victim search left and set to send it right. A
+// touch points every node on the way's path away from it. Both walk log2(ways) levels,
+// which the kernels' constant associativity unrolls into straight-line bit operations.
+static inline uint64_t plru_tree_touch(uint64_t bits, unsigned long way, unsigned long ways) {
+    for (unsigned long node = ways + way; node > 1; node >>= 1) {
+        uint64_t parent = (uint64_t)1 << (node >> 1);
+        bits = (node & 1) ? bits & ~parent : bits | parent;
+    }
+    return bits;
+}
+
+static inline unsigned long plru_tree_victim(uint64_t bits, unsigned long ways) {
+    unsigned long node = 1;
+    while (node < ways)
+        node = 2 * node + ((bits >> node) & 1);
+    return node - ways;
+}
+
+// Bit PLRU: bit i set when way i was touched since the bits were last cleared; the touch
+// that would set them all clears the others instead. The victim is the first clear bit.
+static inline uint64_t plru_bit_touch(uint64_t bits, unsigned long way, unsigned long ways) {
+    bits |= (uint64_t)1 << way;
+    return bits == way_mask(ways) ? (uint64_t)1 << way : bits;
+}
+
+static inline unsigned long plru_bit_victim(uint64_t bits, unsigned long ways) {
+    uint64_t clear = ~bits & way_mask(ways);
+    return clear ? (unsigned long)__builtin_ctzll(clear) : 0; // all set only with one way
+}
+
+static inline int set_sampled(const CacheLevel *cache, unsigned long index) {
+    return !cache->sample_bits || (cache->sample_bits[index / 64] >> (index % 64)) & 1;
+}
+
+// set and tag of addr in cache
+static inline SetRef set_ref(const CacheLevel *cache, unsigned long addr) {
+    SetRef ref;
+    if (cache->pow2_geometry) {
+        ref.index = (addr >> cache->line_shift) & cache->set_mask;
+        ref.tag = addr >> cache->tag_shift;
+    } else {
+        ref.index = (addr / cache->line_size) % cache->num_sets;
+        ref.tag = addr / (cache->line_size * cache->num_sets);
+    }
+    return ref;
+}
+
+// one record for simulate_memory_access_batch
+typedef struct {
+    unsigned long vaddr;
+    unsigned long paddr;
+    unsigned long access_type; // 1 = instruction, 2 = data write, otherwise data read
+    unsigned long core;        // issuing core of a multi-core context, taken modulo CORES
+} MemoryAccess;
+
+#define MAX_CACHE_LEVELS 8
+#define MAX_CORES 64 // one bit per core in a directory entry
+
+// one cache level, read from the USE_L<n> and L<n>_* keys
 typedef struct {
-    unsigned long use_l1;
-    unsigned long use_l2;
-    unsigned long use_l3;
-    unsigned long use_l4;
-
-    unsigned long l1_size;
-    unsigned long l1_assoc;
-    unsigned long l1_line;
-    unsigned long l1_latency;
-    char l1_policy_str[16];
-
-    unsigned long l2_size;
-    unsigned long l2_assoc;
-    unsigned long l2_line;
-    unsigned long l2_latency;
-    char l2_policy_str[16];
-
-    unsigned long l3_size;
-    unsigned long l3_assoc;
-    unsigned long l3_line;
-    unsigned long l3_latency;
-    char l3_policy_str[16];
-
-    unsigned long l4_size;
-    unsigned long l4_assoc;
-    unsigned long l4_line;
-    unsigned long l4_latency;
-    char l4_policy_str[16];
+    unsigned long use;
+    unsigned long size; // bytes
+    unsigned long assoc;
+    unsigned long line;
+    unsigned long latency;
+    unsigned long split; // separate instruction and data caches (default for L1 only)
+    char policy_str[16];
+    unsigned long sample_sets; // sets to simulate, 0 = all
+    char sample_str[16];       // set selection, HASH or STRIDE
+    unsigned long shared;      // one copy for all cores (default from L3 down), else one per core
+    char prefetcher_str[16];   // NONE, NEXT_LINE, STRIDE, STREAM or SPP (prefetch.h)
+    unsigned long prefetch_degree; // lines per trigger (SPP: lookahead depth), 0 = the prefetcher's default
+    unsigned long write_through;   // WRITE_POLICY=WT, default WB (write-back)
+    unsigned long write_allocate;  // WRITE_ALLOCATE, default 1
+    InclusionPolicy inclusion;     // INCLUSION=NINE|INCLUSIVE|EXCLUSIVE, default NINE
+    unsigned long mshrs;           // MSHRS, misses in flight with ISSUE_WINDOW, default 16
+} LevelConfig;
+
+typedef struct {
+    LevelConfig levels[MAX_CACHE_LEVELS]; // levels[0] is L1
 
     unsigned long mem_latency;
+    unsigned long use_dram; // MEM_MODEL=DRAM, default FIXED: every access to memory takes mem_latency
+    DramConfig dram;        // the DRAM_<field> keys (dram.h)
+    unsigned long use_tlb;  // USE_TLB=1 translates vaddrs through the TLBs of mmu
+    MmuConfig mmu;          // the ITLB_, DTLB_, STLB_ and PAGE_ keys (tlb.h)
+    unsigned long mem_bandwidth;      // bytes per cycle memory sustains, MEM_BANDWIDTH, 0 = not checked
+    unsigned long bandwidth_interval; // cycles per bandwidth interval, BANDWIDTH_INTERVAL
+    uint64_t seed; // RNG seed for the randomized policies, RNG_SEED key
+    // ISSUE_WINDOW: accesses in flight at once, 0 = none overlap and latencies simply add up
+    unsigned long issue_window;
+
+    // SMARTS-style sampling (SAMPLE_PERIOD, SAMPLE_WARMUP, SAMPLE_WINDOW keys): every period
+    // of accesses ends with sample_warmup detailed accesses whose results are dropped and a
+    // measured window of sample_window accesses. The accesses before them only warm tags
+    // and replacement state. A period of 0 simulates and counts everything.
+    unsigned long sample_period;
+    unsigned long sample_warmup;
+    unsigned long sample_window;
+
+    // multi-core hierarchies (CORES, C2C_LATENCY, INVALIDATE_LATENCY keys): every core gets
+    // its own copy of the levels above the first shared one, kept coherent by MESI
+    unsigned long cores;
+    unsigned long c2c_latency;        // a line supplied by the core holding it modified
+    unsigned long invalidate_latency; // a write that has to invalidate other copies first
+
+    // interval statistics (INTERVAL_ACCESSES or INTERVAL_CYCLES, INTERVAL_FILE,
+    // INTERVAL_FORMAT, INTERVAL_BUFFER keys): a row of counters every that many accesses
+    // or cycles, written to interval_path by a background thread
+    unsigned long interval_accesses;
+    unsigned long interval_cycles;
+    unsigned long interval_buffer;    // rows the writer may fall behind by
+    int interval_binary;              // INTERVAL_FORMAT=BINARY, default CSV
+    char interval_path[256];
 } CacheConfig;
 
-extern CacheConfig g_config;
+// sums over the units of a sample (sets, windows) for the ratio estimate sum(y) / sum(x)
+typedef struct {
+    unsigned long n;
+    double x, y, xx, yy, xy;
+} RatioSums;
+
+// where an access falls in the sampling period
+typedef enum {
+    PHASE_MEASURE, // detailed and counted, always the phase when SMARTS sampling is off
+    PHASE_WARMING, // functional warming: tags and replacement state only
+    PHASE_WARMUP   // detailed, counters rolled back at the end
+} SimPhase;
+
+// the counters a detailed warm-up rolls back, [level][side] as in SimContext.path
+typedef struct {
+    unsigned long mem_accesses;
+    unsigned long instr_accesses;
+    unsigned long data_accesses;
+    unsigned long total_latency_instr;
+    unsigned long total_latency_data;
+    struct {
+        unsigned long accesses, hits;
+        unsigned long filtered, filtered_side[2], filtered_charged[2];
+        unsigned long sample_accesses[2], sample_latency[2];
+    } levels[MAX_CACHE_LEVELS][2];
+} SimCounters;
+
+// One core's view of a multi-core hierarchy: its own copies of the private levels and
+// the context's shared ones.
+typedef struct {
+    CacheLevel *levels[MAX_CACHE_LEVELS][2];
+    CacheLevel *path[2][MAX_CACHE_LEVELS];
+    CacheLevel *private_caches[2 * MAX_CACHE_LEVELS]; // distinct private caches, both sides
+    unsigned long num_private;
+    unsigned long accesses;
+    unsigned long total_latency;
+} SimCore;
+
+// One simulated hierarchy. Contexts share nothing, so each can be driven from its own thread.
+struct SimContext {
+    CacheConfig config;
+    // [level][side]: level 0 is L1, side 0 = data, 1 = instruction (the same level for unified caches)
+    CacheLevel *levels[MAX_CACHE_LEVELS][2];
+    // enabled levels in lookup order for each side
+    CacheLevel *path[2][MAX_CACHE_LEVELS];
+    unsigned long path_len;
+    unsigned long sampling; // some level is set-sampled
 
-void read_config(const char *filename);
+    unsigned long current_time;
+    // the clock prefetches arrive on: the summed latency of the simulated accesses, or with
+    // ISSUE_WINDOW the cycle the latest one issued
+    unsigned long cycles;
+    unsigned long prefetching; // some level has a prefetcher
+    uint64_t rng_state;
+    unsigned long counting;
+    unsigned long signed_access; // signature holds the SHiP signature of the current access
+    uint64_t signature;
+    void *checkpoint_base; // copy-on-write mapping of the restored checkpoint (checkpoint.h)
+    size_t checkpoint_length;
 
-void update_policy_lru(CacheSet *set, unsigned long line_index);
-unsigned long find_victim_lru(CacheSet *set);
+    // SMARTS sampling
+    SimPhase phase;
+    unsigned long phase_left;      // accesses left in the phase
+    unsigned long warmed_accesses; // functionally warmed or in a detailed warm-up
+    SimCounters window_start;      // counters when the current warm-up began
+    RatioSums windows[3];          // latency over accesses of each window: data, instruction, all
 
-void update_policy_bip(CacheSet *set, unsigned long line_index);
-unsigned long find_victim_bip(CacheSet *set);
+    // cores[0] has the levels/path above; the others exist when CORES > 1
+    SimCore *cores;
+    unsigned long num_cores;
+    unsigned long private_levels;  // leading path levels each core has a copy of
+    unsigned long coherence_line;  // line size of the private levels, the coherence unit
+    Directory directory;
+    Dram *dram; // NULL with a fixed memory latency
+    Mmu *mmu;   // NULL without USE_TLB
+    unsigned long invalidations;    // copies invalidated by another core's write
+    unsigned long coherence_misses; // private misses on a line lost to such an invalidation
+    unsigned long c2c_transfers;    // misses supplied by another core's modified copy
 
-void update_policy_random(CacheSet *set, unsigned long line_index);
-unsigned long find_victim_random(CacheSet *set);
+    // Memory traffic, counted while measuring, in whole lines of the level the transfer
+    // leaves from. Bandwidth is sampled over intervals of measured cycles (the latency
+    // clock), and an interval that moved more than mem_bandwidth bytes per cycle is
+    // saturated: the configuration is bandwidth- rather than latency-bound there.
+    unsigned long mem_read_bytes;
+    unsigned long mem_write_bytes;
+    unsigned long bw_cycles;      // measured cycles
+    unsigned long bw_elapsed;     // cycles into the current interval
+    unsigned long bw_bytes;       // bytes moved in the current interval
+    unsigned long bw_intervals;   // completed intervals
+    unsigned long bw_peak;        // bytes moved in the busiest one
+    unsigned long bw_saturated;
+
+    // Timing model (ISSUE_WINDOW, one core): an access issues a cycle after the one before it
+    // at the earliest, and not before the access issue_window places back has retired.
+    // Accesses retire in order. timed_cycles counts measured cycles of retirement.
+    unsigned long *retire_ring;   // [issue_window] retirement cycles of the latest accesses
+    unsigned long ring_pos;
+    unsigned long retired;        // retirement cycle of the latest access
+    unsigned long timed_cycles;
+    unsigned long sw_prefetches;  // software prefetch fills, counted as for PrefetchStats
+    unsigned long sw_prefetches_late;
+    unsigned long sw_prefetch_late_cycles;
+    unsigned long sw_prefetches_dropped;
+
+    unsigned long mem_accesses;
+    unsigned long instr_accesses;
+    unsigned long data_accesses;
+    unsigned long total_latency_instr;
+    unsigned long total_latency_data;
+
+    // Interval statistics: an access that brings *interval_clock (mem_accesses or *cycle_clock)
+    // to interval_next, ULONG_MAX when off, hands the writer a row.
+    const unsigned long *interval_clock;
+    const unsigned long *cycle_clock; // the report's cycles: timed_cycles under ISSUE_WINDOW, else cycles
+    unsigned long interval_next;
+    unsigned long interval_period;
+    IntervalLog *intervals;          // open between sim_start and sim_stop
+    unsigned long interval_fields;   // per row
+    unsigned long *interval_prev;    // [interval_fields] values at the last row
+    unsigned long *interval_values;  // [interval_fields] scratch
+    struct SimStats *interval_stats; // scratch
+    unsigned long interval_rows;     // since sim_start
+    unsigned long interval_stalls;   // rows that waited for the writer
+};
+
+typedef struct SimStats {
+    unsigned long mem_accesses;
+    unsigned long instr_accesses;
+    unsigned long data_accesses;
+    unsigned long total_latency_instr;
+    unsigned long total_latency_data;
+    // [level][side] as in SimContext.levels, 0 for disabled levels
+    unsigned long level_accesses[MAX_CACHE_LEVELS][2];
+    unsigned long level_hits[MAX_CACHE_LEVELS][2];
+    // accesses that reached an unsampled set of a set-sampled level
+    unsigned long level_filtered[MAX_CACHE_LEVELS][2];
+    // SMARTS sampling: accesses left out of the counts above, and measured windows
+    unsigned long warmed_accesses;
+    unsigned long sample_windows;
+    // multi-core coherence, 0 with one core; level counters above sum over the cores
+    unsigned long invalidations;
+    unsigned long coherence_misses;
+    unsigned long c2c_transfers;
+    // hardware prefetchers, zeroed for levels without one
+    PrefetchStats level_prefetch[MAX_CACHE_LEVELS][2];
+    // write traffic each level sent down, and memory traffic (SimContext); with set
+    // sampling these cover the sampled stream only and are not extrapolated
+    unsigned long level_writebacks[MAX_CACHE_LEVELS][2];
+    unsigned long level_write_throughs[MAX_CACHE_LEVELS][2];
+    unsigned long level_inclusion_victims[MAX_CACHE_LEVELS][2];
+    unsigned long level_victims_taken[MAX_CACHE_LEVELS][2];
+    unsigned long mem_read_bytes;
+    unsigned long mem_write_bytes;
+    unsigned long bandwidth_intervals;
+    double bandwidth_peak; // bytes per cycle in the busiest interval
+    unsigned long bandwidth_saturated; // intervals above MEM_BANDWIDTH
+    // timing model (SimContext), all 0 without ISSUE_WINDOW
+    unsigned long cycles;
+    unsigned long level_mshr_merges[MAX_CACHE_LEVELS][2];
+    unsigned long level_mshr_stalls[MAX_CACHE_LEVELS][2];
+    unsigned long level_mshr_stall_cycles[MAX_CACHE_LEVELS][2];
+    unsigned long sw_prefetches;
+    unsigned long sw_prefetches_late;
+    unsigned long sw_prefetch_late_cycles;
+    unsigned long sw_prefetches_dropped;
+    // DRAM model, summed over the banks, all 0 with a fixed memory latency
+    DramStats dram;
+    // TLBs and page walks, all 0 without USE_TLB
+    MmuStats mmu;
+} SimStats;
+
+// xorshift64* stream of the context, used by the randomized policies (BIP, BRRIP, RANDOM, DIP, DRRIP)
+static inline unsigned long sim_rand(SimContext *ctx) {
+    ctx->rng_state ^= ctx->rng_state >> 12;
+    ctx->rng_state ^= ctx->rng_state << 25;
+    ctx->rng_state ^= ctx->rng_state >> 27;
+    return (ctx->rng_state * 0x2545F4914F6CDD1DULL) >> 33;
+}
+
+void read_config(const char *filename, CacheConfig *config);
+// L<n>_POLICY value, LRU when it names no policy
+ReplacementPolicy parse_policy(const char *policy_str);
+
+// update_policy is called for the way a lookup hit and, after a fill, for the filled way
+void update_policy_lru(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+unsigned long find_victim_lru(SimContext *ctx, CacheSet *set);
+
+// BIP inserts at the LRU position, and only 1 fill in 32 at MRU; hits promote to MRU
+void update_policy_bip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+unsigned long find_victim_bip(SimContext *ctx, CacheSet *set);
+
+void update_policy_random(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+unsigned long find_victim_random(SimContext *ctx, CacheSet *set);
+
+// the PLRU and RRIP policies fill an invalid way, if the set has one, before consulting their state
+void update_policy_plru_tree(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+unsigned long find_victim_plru_tree(SimContext *ctx, CacheSet *set);
+
+void update_policy_plru_bit(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+unsigned long find_victim_plru_bit(SimContext *ctx, CacheSet *set);
+
+// LRU and BIP dueling
+void update_policy_dip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+
+// The RRIP policies share the victim search: the first way predicted distant (RRPV_MAX),
+// after ageing the whole set until one is. Hits predict near-immediate re-reference.
+unsigned long find_victim_rrip(SimContext *ctx, CacheSet *set);
+void update_policy_srrip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+void update_policy_brrip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+void update_policy_drrip(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+// inserts at distant re-reference when lines of the access's signature have not been reused
+void update_policy_ship(SimContext *ctx, CacheSet *set, unsigned long line_index, PolicyEvent event);
+
+// SIMD way matching (waymatch.c), picked per level by runtime CPU dispatch
+WayMatchFn select_way_match(unsigned long associativity);
+const char *way_match_name(WayMatchFn fn);
+
+// picks a specialized probe/fill pair for the level, or the generic one
+void select_kernels(CacheLevel *cache);
+unsigned long probe_generic(SimContext *ctx, CacheLevel *cache, SetRef *ref);
+void fill_generic(SimContext *ctx, CacheLevel *cache, SetRef *ref);
 
 CacheLevel* init_cache_level(unsigned long cache_size, unsigned long associativity, unsigned long line_size, unsigned long access_latency, ReplacementPolicy policy);
 void free_cache_level(CacheLevel *cache);
+// forgets what the dueling and SHiP policies have learned (psel, reuse counters)
+void reset_policy_learning(CacheLevel *cache);
+// forgets the level's prefetcher tables and which lines prefetches brought in
+void reset_prefetcher(CacheLevel *cache);
 
-// simulator API calls
+// context API
+SimContext *sim_create(const char *config_path);
+SimContext *sim_create_from_config(const CacheConfig *config);
+void sim_destroy(SimContext *ctx);
+void sim_seed(SimContext *ctx, uint64_t seed);
+void sim_start(SimContext *ctx);
+void sim_stop(SimContext *ctx);
+void sim_get_stats(const SimContext *ctx, SimStats *stats);
+void sim_report(const SimContext *ctx, FILE *fp);
+void sim_end(SimContext *ctx);
+// latencies are 0 while inactive and for accesses that SMARTS sampling only warms
+unsigned long sim_access(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+// the same from one core (modulo CORES) of a multi-core context; sim_access is core 0
+unsigned long sim_access_core(SimContext *ctx, unsigned long core, unsigned long vaddr, unsigned long paddr,
+                              unsigned long access_type);
+// sim_access_core with a signature, e.g. the PC of the access: SHiP uses it instead of the
+// memory region, STRIDE prefetchers index their table with it instead of the page
+unsigned long sim_access_signed(SimContext *ctx, unsigned long core, unsigned long vaddr, unsigned long paddr,
+                                unsigned long access_type, uint64_t signature);
+void sim_access_batch(SimContext *ctx, const MemoryAccess *accesses, unsigned long count, unsigned long *latencies);
+unsigned long sim_prefetch(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+unsigned long sim_prefetch_t0(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+unsigned long sim_prefetch_t1(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+unsigned long sim_prefetch_t2(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+unsigned long sim_prefetch_nta(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+unsigned long sim_prefetch_w(SimContext *ctx, unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+void sim_flush_instruction(SimContext *ctx, unsigned long paddr);
+void sim_flush_data(SimContext *ctx, unsigned long paddr);
+void sim_invalidate(SimContext *ctx, unsigned long paddr);
+void sim_invalidate_all(SimContext *ctx);
+
+// simulator API calls, thin wrappers over the default context g_sim
 void init(void);
 void start(void);
 void end(void);
 void deinit(void);
 unsigned long simulate_memory_access(unsigned long vaddr, unsigned long paddr, unsigned long access_type);
+unsigned long simulate_memory_access_core(unsigned long core, unsigned long vaddr, unsigned long paddr,
+                                          unsigned long access_type);
+unsigned long simulate_memory_access_signed(unsigned long core, unsigned long vaddr, unsigned long paddr,
+                                            unsigned long access_type, uint64_t signature);
+void simulate_memory_access_batch(const MemoryAccess *accesses, unsigned long count, unsigned long *latencies);
 unsigned long simulate_prefetch(unsigned long vaddr, unsigned long paddr, unsigned long access_type);
 void flush_instruction(unsigned long paddr);
 void flush_data(unsigned long paddr);
@@ -107,17 +625,7 @@ unsigned long simulate_prefetch_t2(unsigned long vaddr, unsigned long paddr, uns
 unsigned long simulate_prefetch_nta(unsigned long vaddr, unsigned long paddr, unsigned long access_type);
 unsigned long simulate_prefetch_w(unsigned long vaddr, unsigned long paddr, unsigned long access_type);
 
-extern CacheLevel *g_l1_data;
-extern CacheLevel *g_l1_instr;
-extern CacheLevel *g_l2;
-extern CacheLevel *g_l3;
-extern CacheLevel *g_l4;
-extern unsigned long g_current_time;
-extern unsigned long g_mem_accesses;
-extern unsigned long g_instr_accesses;
-extern unsigned long g_data_accesses;
-extern unsigned long g_total_latency_instr;
-extern unsigned long g_total_latency_data;
-extern unsigned long g_counting;
-
-#endif
\ No newline at end of file
+// context behind init/start/end/deinit and the simulate_* calls, NULL outside init..deinit
+extern SimContext *g_sim;
+
+#endif
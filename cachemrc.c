@@ -0,0 +1,267 @@
+// Miss-ratio curves for every level of a configuration from one pass over a trace.
+// build: gcc -O2 -o cachemrc cachemrc.c stackdist.c tracesource.c trace.c ctrace.c import.c cache.c coherence.c waymatch.c kernels.c prefetch.c dram.c tlb.c interval.c -lpthread
+// usage: ./cachemrc [-c config] [-j threads] [-f format] [-w max_ways] [-v] trace
+//   -v replays the trace through the simulator afterwards and checks every configured
+//   point against it
+//
+// Each level sees the stream that misses the levels above it, found from the same stack
+// distances at the configured associativity, so the hierarchy behaves as with
+// POLICY_LRU at every level. L1 is looked up by vaddr and filled by paddr, as in the
+// simulator. A miss there can fill a second copy of a line the set already holds, which
+// no stack can represent, so its hits come from an LRU tag store of the configured
+// geometry instead: the distance is taken at the vaddr line and the line the store
+// touched (vaddr on a hit, paddr on a fill) becomes the most recent. The configured
+// point of each curve then matches the LRU miss rate of a replay of the same trace.
+// Where vaddr != paddr the other points of an L1 curve are approximate. Only accesses
+// are analyzed; prefetch, flush and invalidate records are skipped.
+#include "stackdist.h"
+#include "tracesource.h"
+#include <unistd.h>
+
+#define CAPACITY_STEPS_PER_OCTAVE 4
+
+typedef struct {
+    CacheLevel *cache; // geometry only
+    StackDist *sd;
+    CacheLevel *tags;  // LRU tag store deciding the hits of a vaddr-indexed level, else NULL
+    unsigned long misses; // in tags
+} LevelProfile;
+
+static double miss_percent(unsigned long misses, unsigned long accesses) {
+    return accesses ? 100.0 * misses / accesses : 0.0;
+}
+
+// misses of the level as configured, exact where the stack is not
+static unsigned long configured_misses(const LevelProfile *p) {
+    return p->tags ? p->misses : stackdist_set_misses(p->sd, p->cache->associativity);
+}
+
+static void print_curves(const char *name, LevelProfile *p, unsigned long max_ways) {
+    StackDist *sd = p->sd;
+    const CacheLevel *cache = p->cache;
+    stackdist_finish(sd);
+
+    printf("--- %s: %lu sets x %lu ways, %lu B lines, %s ---\n", name, cache->num_sets, cache->associativity,
+           cache->line_size, cache->policy == POLICY_LRU ? "LRU" : "modeled as LRU");
+    printf("accesses: %lu, cold misses: %lu\n", sd->accesses, sd->cold);
+    printf("configured: %.2f%% misses\n", miss_percent(configured_misses(p), sd->accesses));
+
+    // every associativity up to where the curve flattens (or max_ways)
+    unsigned long last_ways = sd->set_hist.length > cache->associativity ? sd->set_hist.length : cache->associativity;
+    if (last_ways > max_ways)
+        last_ways = max_ways > cache->associativity ? max_ways : cache->associativity;
+    printf("\n%8s %14s %10s   (%lu sets)\n", "ways", "bytes", "miss%", cache->num_sets);
+    for (unsigned long ways = 1; ways <= last_ways; ways++) {
+        unsigned long misses = ways == cache->associativity ? configured_misses(p) : stackdist_set_misses(sd, ways);
+        printf("%8lu %14lu %10.2f%s\n", ways, ways * cache->num_sets * cache->line_size,
+               miss_percent(misses, sd->accesses), ways == cache->associativity ? "  <- configured" : "");
+        if (misses == sd->cold && ways >= cache->associativity)
+            break;
+    }
+
+    // capacities at CAPACITY_STEPS_PER_OCTAVE points per doubling, plus the configured one
+    unsigned long configured_lines = cache->num_sets * cache->associativity;
+    printf("\n%8s %14s %10s   (fully associative)\n", "lines", "bytes", "miss%");
+    unsigned long lines = 1, step = 1;
+    int configured_done = 0;
+    for (;;) {
+        if (!configured_done && configured_lines <= lines) {
+            if (configured_lines < lines)
+                printf("%8lu %14lu %10.2f  <- configured size\n", configured_lines, configured_lines * cache->line_size,
+                       miss_percent(stackdist_level_misses(sd, configured_lines), sd->accesses));
+            configured_done = 1;
+        }
+        unsigned long misses = stackdist_level_misses(sd, lines);
+        printf("%8lu %14lu %10.2f%s\n", lines, lines * cache->line_size, miss_percent(misses, sd->accesses),
+               lines == configured_lines ? "  <- configured size" : "");
+        if (misses == sd->cold && configured_done)
+            break;
+        lines += step;
+        if (lines >= CAPACITY_STEPS_PER_OCTAVE * step * 2)
+            step *= 2;
+    }
+    printf("\n");
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c config] [-j threads] [-f lackey|drcachesim|champsim] [-w max_ways] [-v] trace\n",
+            prog);
+    exit(1);
+}
+
+static int check_level(const char *name, const LevelProfile *p, const SimStats *stats, unsigned long n,
+                       unsigned long side) {
+    unsigned long accesses = stats->level_accesses[n][side];
+    unsigned long misses = accesses - stats->level_hits[n][side];
+    unsigned long expected = configured_misses(p);
+    int match = accesses == p->sd->accesses && misses == expected;
+    printf("check: %s: replay %lu misses of %lu, configured point %lu of %lu%s\n", name, misses, accesses,
+           expected, p->sd->accesses, match ? "" : "  <- MISMATCH");
+    return match;
+}
+
+// Replays the access records of the trace through the simulator and compares each level's
+// misses with its configured point. Levels with a policy other than LRU at or above them
+// are only modeled as LRU and are skipped. Returns the number of mismatches.
+static unsigned long check_configured(const char *config_path, const char *trace_path, ImportFormat format,
+                                      unsigned long threads, LevelProfile profiles[][2]) {
+    SimContext *sim = sim_create(config_path);
+    sim_start(sim);
+    TraceSource *source = trace_source_open(trace_path, format, threads);
+    const TraceRecord *batch;
+    unsigned long count;
+    while ((count = trace_source_next(source, &batch)) > 0) {
+        for (unsigned long i = 0; i < count; i++) {
+            if (batch[i].op == TRACE_ACCESS)
+                sim_replay_op(sim, &batch[i]);
+        }
+    }
+    trace_source_close(source);
+    SimStats stats;
+    sim_get_stats(sim, &stats);
+    sim_destroy(sim);
+
+    unsigned long mismatches = 0;
+    int lru[2] = { 1, 1 }; // every level above on the side's path is LRU
+    char name[32];
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        if (!profiles[n][0].cache)
+            continue;
+        int split = profiles[n][1].sd != profiles[n][0].sd;
+        for (unsigned long side = 0; side < 2; side++)
+            lru[side] &= profiles[n][side].cache->policy == POLICY_LRU;
+        if (split) {
+            snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+            if (lru[1])
+                mismatches += !check_level(name, &profiles[n][1], &stats, n, 1);
+            snprintf(name, sizeof(name), "L%lu Data", n + 1);
+            if (lru[0])
+                mismatches += !check_level(name, &profiles[n][0], &stats, n, 0);
+        } else if (lru[0] && lru[1]) {
+            snprintf(name, sizeof(name), "L%lu", n + 1);
+            mismatches += !check_level(name, &profiles[n][0], &stats, n, 0);
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char **argv) {
+    const char *config_path = CONFIG;
+    unsigned long threads = 1, max_ways = 64;
+    int check = 0;
+    ImportFormat format = IMPORT_NUM_FORMATS;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:j:f:w:v")) != -1) {
+        switch (opt) {
+            case 'c': config_path = optarg; break;
+            case 'j': threads = strtoul(optarg, NULL, 10); break;
+            case 'f':
+                format = import_format(optarg);
+                if (format == IMPORT_NUM_FORMATS)
+                    usage(argv[0]);
+                break;
+            case 'w': max_ways = strtoul(optarg, NULL, 10); break;
+            case 'v': check = 1; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+    if (check && strcmp(argv[optind], "-") == 0) {
+        fprintf(stderr, "-v reads the trace twice, it cannot come from stdin\n");
+        exit(1);
+    }
+
+    // the context supplies the geometry, its tag stores are never used; the all-LRU
+    // copy lends its vaddr-indexed levels' tag stores to the profiles
+    CacheConfig config;
+    read_config(config_path, &config);
+    SimContext *ctx = sim_create_from_config(&config);
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++)
+        snprintf(config.levels[n].policy_str, sizeof(config.levels[n].policy_str), "LRU");
+    SimContext *lru = sim_create_from_config(&config);
+    LevelProfile profiles[MAX_CACHE_LEVELS][2] = {{{0}}};
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        for (unsigned long side = 0; side < 2; side++) {
+            CacheLevel *cache = ctx->levels[n][side];
+            if (!cache)
+                continue;
+            profiles[n][side].cache = cache;
+            if (cache->vaddr_indexed)
+                profiles[n][side].tags = lru->levels[n][side];
+            if (side == 1 && cache == ctx->levels[n][0])
+                profiles[n][1].sd = profiles[n][0].sd; // unified
+            else
+                profiles[n][side].sd = stackdist_create(cache->num_sets);
+        }
+    }
+    LevelProfile *path[2][MAX_CACHE_LEVELS];
+    unsigned long path_len = 0;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        if (profiles[n][0].cache) {
+            path[0][path_len] = &profiles[n][0];
+            path[1][path_len] = &profiles[n][1];
+            path_len++;
+        }
+    }
+
+    TraceSource *source = trace_source_open(argv[optind], format, threads);
+    const TraceRecord *batch;
+    unsigned long count;
+    while ((count = trace_source_next(source, &batch)) > 0) {
+        for (unsigned long i = 0; i < count; i++) {
+            const TraceRecord *r = &batch[i];
+            if (r->op != TRACE_ACCESS)
+                continue;
+            LevelProfile **levels = path[r->access_type == 1];
+            lru->current_time++;
+            for (unsigned long level = 0; level < path_len; level++) {
+                LevelProfile *p = levels[level];
+                const CacheLevel *cache = p->cache;
+                SetRef ref = set_ref(cache, r->paddr);
+                uint64_t line = (uint64_t)ref.tag * cache->num_sets + ref.index;
+                if (!p->tags) {
+                    if (stackdist_access(p->sd, line, ref.index) < cache->associativity)
+                        break; // hit, lower levels never see it
+                    continue;
+                }
+                // looked up by vaddr, filled by paddr, as the simulator does
+                SetRef vref = set_ref(cache, r->vaddr);
+                uint64_t vline = (uint64_t)vref.tag * cache->num_sets + vref.index;
+                stackdist_lookup(p->sd, vline, vref.index);
+                if (p->tags->probe(lru, p->tags, &vref) != WAY_NONE) {
+                    stackdist_touch(p->sd, vline, vref.index);
+                    break;
+                }
+                p->misses++;
+                p->tags->fill(lru, p->tags, &ref);
+                stackdist_touch(p->sd, line, ref.index);
+            }
+        }
+    }
+    trace_source_close(source);
+
+    char name[32];
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        if (!profiles[n][0].cache)
+            continue;
+        if (profiles[n][1].sd != profiles[n][0].sd) {
+            snprintf(name, sizeof(name), "L%lu Instruction", n + 1);
+            print_curves(name, &profiles[n][1], max_ways);
+            snprintf(name, sizeof(name), "L%lu Data", n + 1);
+            print_curves(name, &profiles[n][0], max_ways);
+        } else {
+            snprintf(name, sizeof(name), "L%lu", n + 1);
+            print_curves(name, &profiles[n][0], max_ways);
+        }
+    }
+    unsigned long mismatches = check ? check_configured(config_path, argv[optind], format, threads, profiles) : 0;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        if (profiles[n][1].sd != profiles[n][0].sd)
+            stackdist_free(profiles[n][1].sd);
+        stackdist_free(profiles[n][0].sd);
+    }
+    sim_destroy(lru);
+    sim_destroy(ctx);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,114 @@
+// Replays a raw (trace.h), compressed (ctrace.h) or foreign (import.h) trace against one
+// cache configuration.
+// build: gcc -O2 -o cachesim cachesim.c tracesource.c trace.c ctrace.c import.c checkpoint.c shard.c cache.c coherence.c waymatch.c kernels.c prefetch.c dram.c tlb.c interval.c -lpthread
+// usage: ./cachesim [-c config] [-o results_file] [-j threads] [-f lackey|drcachesim|champsim]
+//                   [-p shard_threads] [-r checkpoint] [-s checkpoint] trace
+//   -p simulates set shards of the hierarchy in parallel (shard.h), -r starts from a saved
+//   cache state, -s saves the state at the end of the trace
+#include "checkpoint.h"
+#include "shard.h"
+#include "tracesource.h"
+#include <time.h>
+#include <unistd.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c config] [-o results_file] [-j threads] [-f lackey|drcachesim|champsim] "
+                    "[-p shard_threads] [-r checkpoint] [-s checkpoint] trace\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    const char *config_path = CONFIG;
+    const char *results_path = NULL; // stdout
+    unsigned long threads = 1; // decoder/parser threads for compressed and foreign traces, 0 runs inline
+    ImportFormat format = IMPORT_NUM_FORMATS; // native trace
+    const char *restore_path = NULL, *save_path = NULL;
+    unsigned long shard_threads = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "c:o:j:f:p:r:s:")) != -1) {
+        switch (opt) {
+            case 'c': config_path = optarg; break;
+            case 'o': results_path = optarg; break;
+            case 'j': threads = strtoul(optarg, NULL, 10); break;
+            case 'f':
+                format = import_format(optarg);
+                if (format == IMPORT_NUM_FORMATS)
+                    usage(argv[0]);
+                break;
+            case 'p': shard_threads = strtoul(optarg, NULL, 10); break;
+            case 'r': restore_path = optarg; break;
+            case 's': save_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+        usage(argv[0]);
+
+    const char *trace_path = argv[optind];
+    if (shard_threads > 1 && (restore_path || save_path)) {
+        fprintf(stderr, "cachesim: checkpoints need the serial simulator, ignoring -p\n");
+        shard_threads = 1;
+    }
+
+    SimContext *ctx = NULL;
+    ShardSim *shards = NULL;
+    if (shard_threads > 1) {
+        CacheConfig config;
+        read_config(config_path, &config);
+        const char *reason;
+        shards = shard_create(&config, shard_threads, &reason);
+        if (reason)
+            fprintf(stderr, "cachesim: simulating serially, %s\n", reason);
+        shard_start(shards);
+    } else {
+        ctx = sim_create(config_path);
+        if (restore_path)
+            sim_restore(ctx, restore_path);
+        sim_start(ctx);
+    }
+    double t0 = now_seconds();
+    unsigned long records = 0;
+    TraceSource *source = trace_source_open(trace_path, format, threads);
+    const TraceRecord *batch;
+    unsigned long count;
+    while ((count = trace_source_next(source, &batch)) > 0) {
+        if (shards)
+            shard_replay(shards, batch, count);
+        else
+            sim_replay(ctx, batch, count);
+        records += count;
+    }
+    trace_source_close(source);
+    double seconds = now_seconds() - t0;
+    if (shards) {
+        shard_stop(shards);
+        ctx = shard_merge(shards);
+    } else {
+        sim_stop(ctx);
+    }
+    if (save_path)
+        sim_checkpoint(ctx, save_path);
+
+    FILE *fp = stdout;
+    if (results_path) {
+        fp = fopen(results_path, "a");
+        if (!fp) { perror(results_path); exit(1); }
+    }
+    sim_report(ctx, fp);
+    if (fp != stdout)
+        fclose(fp);
+    fprintf(stderr, "replayed %lu records in %.2f s (%.2f M records/sec)\n",
+            records, seconds, seconds > 0 ? records / seconds / 1e6 : 0.0);
+
+    if (shards)
+        shard_destroy(shards);
+    else
+        sim_destroy(ctx);
+    return 0;
+}
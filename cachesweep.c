@@ -0,0 +1,155 @@
+// Replays one trace against many cache configurations in a single pass.
+// build: gcc -O2 -o cachesweep cachesweep.c sweep.c tracesource.c trace.c ctrace.c import.c checkpoint.c cache.c coherence.c waymatch.c kernels.c prefetch.c dram.c tlb.c interval.c -lpthread
+// usage: ./cachesweep [-j threads] [-J decode_threads] [-f format] [-d outdir] [-r checkpoint] trace config...
+//   writes <outdir>/<config>.log per config and a comparison table to stdout; -r starts every
+//   config from the same saved cache state, which needs the geometry it was saved with
+#include "checkpoint.h"
+#include "sweep.h"
+#include "tracesource.h"
+#include <libgen.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-j threads] [-J decode_threads] [-f lackey|drcachesim|champsim] [-d outdir] "
+                    "[-r checkpoint] trace config...\n", prog);
+    exit(1);
+}
+
+// "dir/config4.txt" -> "config4"
+static void config_name(const char *path, char *name, size_t size) {
+    char copy[4096];
+    snprintf(copy, sizeof(copy), "%s", path);
+    snprintf(name, size, "%s", basename(copy));
+    char *dot = strrchr(name, '.');
+    if (dot && dot != name)
+        *dot = '\0';
+}
+
+static double miss_percent(unsigned long accesses, unsigned long hits) {
+    return accesses ? 100.0 * (accesses - hits) / accesses : 0.0;
+}
+
+// one row per config: average latencies, then each level's miss rate over both sides
+static void print_table(FILE *fp, char names[][256], SimContext **contexts, unsigned long n) {
+    int used[MAX_CACHE_LEVELS] = {0}; // levels enabled in any config get a column
+    int timed = 0; // as does the cycle count when a config sets ISSUE_WINDOW
+    for (unsigned long i = 0; i < n; i++) {
+        for (unsigned long level = 0; level < MAX_CACHE_LEVELS; level++)
+            used[level] |= contexts[i]->levels[level][0] != NULL;
+        timed |= contexts[i]->config.issue_window != 0;
+    }
+
+    fprintf(fp, "%-20s %12s %10s %10s", "config", "accesses", "instr lat", "data lat");
+    if (timed)
+        fprintf(fp, " %12s", "cycles");
+    for (unsigned long level = 0; level < MAX_CACHE_LEVELS; level++)
+        if (used[level])
+            fprintf(fp, "  L%lu miss%%", level + 1);
+    fprintf(fp, "\n");
+
+    for (unsigned long i = 0; i < n; i++) {
+        SimStats stats;
+        sim_get_stats(contexts[i], &stats);
+        fprintf(fp, "%-20s %12lu %10.2f %10.2f", names[i], stats.mem_accesses,
+                stats.instr_accesses ? (double)stats.total_latency_instr / stats.instr_accesses : 0.0,
+                stats.data_accesses ? (double)stats.total_latency_data / stats.data_accesses : 0.0);
+        if (timed && stats.cycles)
+            fprintf(fp, " %12lu", stats.cycles);
+        else if (timed)
+            fprintf(fp, " %12s", "-");
+        for (unsigned long level = 0; level < MAX_CACHE_LEVELS; level++) {
+            if (!used[level])
+                continue;
+            const CacheLevel *data = contexts[i]->levels[level][0], *instr = contexts[i]->levels[level][1];
+            if (!data) {
+                fprintf(fp, "  %9s", "-");
+                continue;
+            }
+            unsigned long accesses = stats.level_accesses[level][0], hits = stats.level_hits[level][0];
+            if (instr != data) {
+                accesses += stats.level_accesses[level][1];
+                hits += stats.level_hits[level][1];
+            }
+            fprintf(fp, "  %9.2f", miss_percent(accesses, hits));
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long threads = cores > 1 ? cores : 1;
+    unsigned long decode_threads = 1;
+    ImportFormat format = IMPORT_NUM_FORMATS;
+    const char *outdir = ".";
+    const char *restore_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:J:f:d:r:")) != -1) {
+        switch (opt) {
+            case 'j': threads = strtoul(optarg, NULL, 10); break;
+            case 'J': decode_threads = strtoul(optarg, NULL, 10); break;
+            case 'f':
+                format = import_format(optarg);
+                if (format == IMPORT_NUM_FORMATS)
+                    usage(argv[0]);
+                break;
+            case 'd': outdir = optarg; break;
+            case 'r': restore_path = optarg; break;
+            default: usage(argv[0]);
+        }
+    }
+    if (argc - optind < 2)
+        usage(argv[0]);
+    const char *trace_path = argv[optind];
+    unsigned long n = argc - optind - 1;
+    char **config_paths = argv + optind + 1;
+
+    SimContext **contexts = malloc(n * sizeof(SimContext *));
+    char (*names)[256] = malloc(n * sizeof(*names));
+    if (!contexts || !names) { perror("malloc"); exit(1); }
+    for (unsigned long i = 0; i < n; i++) {
+        contexts[i] = sim_create(config_paths[i]);
+        config_name(config_paths[i], names[i], sizeof(names[i]));
+        if (restore_path)
+            sim_restore(contexts[i], restore_path);
+        sim_start(contexts[i]);
+    }
+
+    double t0 = now_seconds();
+    Sweep *sweep = sweep_create(contexts, n, threads);
+    TraceSource *source = trace_source_open(trace_path, format, decode_threads);
+    const TraceRecord *batch;
+    unsigned long count, records = 0;
+    while ((count = trace_source_next(source, &batch)) > 0) {
+        sweep_replay(sweep, batch, count);
+        records += count;
+    }
+    trace_source_close(source);
+    sweep_destroy(sweep);
+    double seconds = now_seconds() - t0;
+
+    for (unsigned long i = 0; i < n; i++) {
+        sim_stop(contexts[i]);
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s.log", outdir, names[i]);
+        FILE *fp = fopen(path, "w");
+        if (!fp) { perror(path); exit(1); }
+        sim_report(contexts[i], fp);
+        fclose(fp);
+    }
+    print_table(stdout, names, contexts, n);
+    fprintf(stderr, "replayed %lu records into %lu configs in %.2f s\n", records, n, seconds);
+
+    for (unsigned long i = 0; i < n; i++)
+        sim_destroy(contexts[i]);
+    free(contexts);
+    free(names);
+    return 0;
+}
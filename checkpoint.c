@@ -0,0 +1,238 @@
+#include "checkpoint.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_CHECKPOINT_LEVELS (2 * MAX_CACHE_LEVELS)
+
+static uint64_t align_up(uint64_t offset) {
+    return (offset + CHECKPOINT_ALIGN - 1) & ~(uint64_t)(CHECKPOINT_ALIGN - 1);
+}
+
+static uint64_t tags_bytes(const CacheLevel *cache) {
+    return cache->num_sets * cache->associativity * sizeof(unsigned int);
+}
+
+static uint64_t valid_bytes(const CacheLevel *cache) {
+    return cache->num_sets * cache->valid_words * sizeof(uint64_t);
+}
+
+static uint64_t ages_bytes(const CacheLevel *cache) {
+    if (cache->plru)
+        return cache->num_sets * sizeof(uint64_t);
+    if (cache->rrpv)
+        return cache->num_sets * cache->associativity;
+    return cache->num_sets * cache->associativity * sizeof(unsigned long);
+}
+
+// the level's replacement state, the ages section of its checkpoint
+static void *ages_array(const CacheLevel *cache) {
+    if (cache->plru)
+        return cache->plru;
+    return cache->rrpv ? (void *)cache->rrpv : (void *)cache->ages;
+}
+
+// points the level's replacement state at state
+static void set_ages_array(CacheLevel *cache, void *state) {
+    if (cache->plru)
+        cache->plru = state;
+    else if (cache->rrpv)
+        cache->rrpv = state;
+    else
+        cache->ages = state;
+}
+
+static CheckpointAges ages_kind(const CacheLevel *cache) {
+    switch (cache->policy) {
+        case POLICY_PLRU_TREE: return CHECKPOINT_AGES_PLRU_TREE;
+        case POLICY_PLRU_BIT:  return CHECKPOINT_AGES_PLRU_BIT;
+        case POLICY_SRRIP:
+        case POLICY_BRRIP:
+        case POLICY_DRRIP:
+        case POLICY_SHIP:      return CHECKPOINT_AGES_RRPV;
+        default:               return CHECKPOINT_AGES_RECENCY;
+    }
+}
+
+// the levels a checkpoint of ctx holds, in file order, with their table entries minus offsets
+static unsigned long checkpoint_levels(const SimContext *ctx, CacheLevel **levels, CheckpointLevel *entries) {
+    unsigned long count = 0;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        for (unsigned long side = 0; side < 2; side++) {
+            CacheLevel *cache = ctx->levels[n][side];
+            if (!cache || (side == 1 && cache == ctx->levels[n][0]))
+                continue;
+            CheckpointLevel *entry = &entries[count];
+            memset(entry, 0, sizeof(*entry));
+            entry->level = n;
+            entry->side = side;
+            entry->unified = ctx->levels[n][1] == ctx->levels[n][0];
+            entry->policy = cache->policy;
+            entry->ages = ages_kind(cache);
+            entry->num_sets = cache->num_sets;
+            entry->associativity = cache->associativity;
+            entry->line_size = cache->line_size;
+            levels[count++] = cache;
+        }
+    }
+    return count;
+}
+
+static void write_at(FILE *fp, const char *path, uint64_t offset, const void *data, uint64_t bytes) {
+    if (fseeko(fp, offset, SEEK_SET) != 0 || fwrite(data, 1, bytes, fp) != bytes) {
+        perror(path);
+        exit(1);
+    }
+}
+
+void sim_checkpoint(const SimContext *ctx, const char *path) {
+    if (ctx->num_cores > 1) {
+        fprintf(stderr, "%s: checkpoints hold a single-core hierarchy, CORES is %lu\n", path, ctx->num_cores);
+        exit(1);
+    }
+    CacheLevel *levels[MAX_CHECKPOINT_LEVELS];
+    CheckpointLevel entries[MAX_CHECKPOINT_LEVELS];
+    unsigned long count = checkpoint_levels(ctx, levels, entries);
+
+    CheckpointHeader header = {0};
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    header.version = CHECKPOINT_VERSION;
+    header.num_levels = count;
+    header.tag_size = sizeof(unsigned int);
+    header.age_size = sizeof(unsigned long);
+    header.current_time = ctx->current_time;
+    header.rng_state = ctx->rng_state;
+
+    // the arrays follow the level table, each page-aligned
+    uint64_t offset = align_up(sizeof(header) + count * sizeof(CheckpointLevel));
+    for (unsigned long i = 0; i < count; i++) {
+        entries[i].tags_offset = offset;
+        offset = align_up(offset + tags_bytes(levels[i]));
+        entries[i].valid_offset = offset;
+        offset = align_up(offset + valid_bytes(levels[i]));
+        entries[i].ages_offset = offset;
+        offset = align_up(offset + ages_bytes(levels[i]));
+        entries[i].dirty_offset = offset;
+        offset = align_up(offset + valid_bytes(levels[i]));
+    }
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) { perror(tmp_path); exit(1); }
+    write_at(fp, tmp_path, 0, &header, sizeof(header));
+    write_at(fp, tmp_path, sizeof(header), entries, count * sizeof(CheckpointLevel));
+    for (unsigned long i = 0; i < count; i++) {
+        write_at(fp, tmp_path, entries[i].tags_offset, levels[i]->tags, tags_bytes(levels[i]));
+        write_at(fp, tmp_path, entries[i].valid_offset, levels[i]->valid, valid_bytes(levels[i]));
+        write_at(fp, tmp_path, entries[i].ages_offset, ages_array(levels[i]), ages_bytes(levels[i]));
+        write_at(fp, tmp_path, entries[i].dirty_offset, levels[i]->dirty, valid_bytes(levels[i]));
+    }
+    if (fclose(fp) != 0) { perror(tmp_path); exit(1); }
+    if (rename(tmp_path, path) != 0) { perror(path); exit(1); }
+}
+
+static int fits(uint64_t offset, uint64_t bytes, size_t length) {
+    return offset % 64 == 0 && offset <= length && bytes <= length - offset;
+}
+
+void sim_restore(SimContext *ctx, const char *path) {
+    if (ctx->num_cores > 1) {
+        fprintf(stderr, "%s: checkpoints hold a single-core hierarchy, CORES is %lu\n", path, ctx->num_cores);
+        exit(1);
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); exit(1); }
+    struct stat st;
+    if (fstat(fd, &st) < 0) { perror("fstat"); exit(1); }
+    size_t length = st.st_size;
+    if (length < sizeof(CheckpointHeader)) {
+        fprintf(stderr, "%s: not a checkpoint\n", path);
+        exit(1);
+    }
+    // private and writable: the run modifies its own copy-on-write pages
+    char *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED) { perror("mmap"); exit(1); }
+    close(fd);
+
+    const CheckpointHeader *header = (const CheckpointHeader *)base;
+    if (memcmp(header->magic, CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0 ||
+        header->version != CHECKPOINT_VERSION || header->tag_size != sizeof(unsigned int) ||
+        header->age_size != sizeof(unsigned long)) {
+        fprintf(stderr, "%s: not a version %d checkpoint\n", path, CHECKPOINT_VERSION);
+        exit(1);
+    }
+
+    CacheLevel *levels[MAX_CHECKPOINT_LEVELS];
+    CheckpointLevel expected[MAX_CHECKPOINT_LEVELS];
+    unsigned long count = checkpoint_levels(ctx, levels, expected);
+    const CheckpointLevel *entries = (const CheckpointLevel *)(header + 1);
+    if (header->num_levels != count || !fits(0, sizeof(*header) + count * sizeof(CheckpointLevel), length)) {
+        fprintf(stderr, "%s: checkpoint has %u cache levels, the configuration %lu\n", path, header->num_levels, count);
+        exit(1);
+    }
+    for (unsigned long i = 0; i < count; i++) {
+        const CheckpointLevel *e = &entries[i], *x = &expected[i];
+        if (e->level != x->level || e->side != x->side || e->unified != x->unified || e->num_sets != x->num_sets ||
+            e->associativity != x->associativity || e->line_size != x->line_size) {
+            fprintf(stderr, "%s: L%lu%s geometry differs from the configuration\n", path, (unsigned long)x->level + 1,
+                    x->unified ? "" : x->side ? " instruction" : " data");
+            exit(1);
+        }
+        // ages of another kind are not mapped, only their kind is checked
+        if (e->ages >= CHECKPOINT_NUM_AGES || !fits(e->tags_offset, tags_bytes(levels[i]), length) ||
+            !fits(e->valid_offset, valid_bytes(levels[i]), length) ||
+            !fits(e->dirty_offset, valid_bytes(levels[i]), length) ||
+            (e->ages == x->ages && !fits(e->ages_offset, ages_bytes(levels[i]), length))) {
+            fprintf(stderr, "%s: corrupt checkpoint\n", path);
+            exit(1);
+        }
+    }
+
+    // LRU, BIP, DIP and RANDOM all keep recency ages (BIP by inserting at age 0, RANDOM only
+    // on fills), and the RRIP policies all RRPVs, so those arrays are used as they are
+    // whichever policy of the kind wrote them. State of another kind means nothing to the
+    // level's policy, which then starts from zero.
+    for (unsigned long i = 0; i < count; i++) {
+        CacheLevel *cache = levels[i];
+        if (!cache->mapped_store) {
+            free(cache->tags);
+            free(cache->valid);
+            free(cache->dirty);
+        }
+        cache->tags = (unsigned int *)(base + entries[i].tags_offset);
+        cache->valid = (uint64_t *)(base + entries[i].valid_offset);
+        cache->dirty = (uint64_t *)(base + entries[i].dirty_offset);
+        cache->mapped_store = 1;
+        if (entries[i].ages == expected[i].ages) {
+            if (!cache->mapped_state)
+                free(ages_array(cache));
+            set_ages_array(cache, base + entries[i].ages_offset);
+            cache->mapped_state = 1;
+        } else {
+            if (cache->mapped_state) { // restored before from a checkpoint of the right kind
+                void *state = malloc(ages_bytes(cache));
+                if (!state) { perror("malloc"); exit(1); }
+                set_ages_array(cache, state);
+                cache->mapped_state = 0;
+            }
+            memset(ages_array(cache), 0, ages_bytes(cache));
+            fprintf(stderr, "%s: L%lu%s replacement state was saved by another kind of policy, starting it afresh\n",
+                    path, (unsigned long)entries[i].level + 1,
+                    entries[i].unified ? "" : entries[i].side ? " instruction" : " data");
+        }
+        reset_policy_learning(cache);
+        reset_prefetcher(cache);
+    }
+    if (ctx->dram) // open rows are not saved
+        dram_reset(ctx->dram);
+    if (ctx->mmu) // nor are the TLBs
+        mmu_reset(ctx->mmu);
+    if (ctx->checkpoint_base)
+        munmap(ctx->checkpoint_base, ctx->checkpoint_length);
+    ctx->checkpoint_base = base;
+    ctx->checkpoint_length = length;
+    ctx->current_time = header->current_time;
+    ctx->rng_state = header->rng_state ? header->rng_state : 1;
+}
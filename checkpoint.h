@@ -0,0 +1,67 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "cache.h"
+
+// Cache-state checkpoints: the tag stores of every level, dirty bits included, plus the
+// context clock and RNG, so a warmed hierarchy can be saved once and restored into later runs.
+//
+// Layout, in host byte order: a CheckpointHeader, one CheckpointLevel per level (a unified
+// level once, split levels once per side, in [level][side] order), then each level's tags,
+// valid bits, ages and dirty bits, every array starting on a CHECKPOINT_ALIGN boundary. Restoring maps
+// the file copy-on-write and points the levels at those arrays, so only the pages the run
+// goes on to modify are ever copied.
+//
+// The restoring context must have the same levels with the same geometry; the replacement
+// policy may differ. Policies that keep the same kind of state (ages) share it, otherwise
+// the level restores its lines and starts its replacement state afresh. Statistics,
+// sampling state and what the dueling and SHiP policies have learned are not part of a
+// checkpoint, and multi-core hierarchies (CORES > 1) cannot be checkpointed.
+
+#define CHECKPOINT_MAGIC "CSIMCKP"
+#define CHECKPOINT_VERSION 2
+#define CHECKPOINT_ALIGN 4096
+
+// what a level's ages array holds
+typedef enum {
+    CHECKPOINT_AGES_RECENCY,   // last touch time per way (LRU, BIP, RANDOM, DIP)
+    CHECKPOINT_AGES_PLRU_TREE, // one tree PLRU word per set
+    CHECKPOINT_AGES_PLRU_BIT,  // one MRU-bit word per set
+    CHECKPOINT_AGES_RRPV,      // one byte per way (SRRIP, BRRIP, DRRIP, SHIP)
+    CHECKPOINT_NUM_AGES
+} CheckpointAges;
+
+typedef struct {
+    char magic[8];      // CHECKPOINT_MAGIC, NUL padded
+    uint32_t version;   // CHECKPOINT_VERSION
+    uint32_t num_levels;
+    uint32_t tag_size;  // sizeof(unsigned int)
+    uint32_t age_size;  // sizeof(unsigned long)
+    uint64_t current_time;
+    uint64_t rng_state;
+} CheckpointHeader;
+
+typedef struct {
+    uint32_t level;   // 0 = L1
+    uint32_t side;    // 0 = data or unified, 1 = instruction
+    uint32_t unified;
+    uint32_t policy;  // ReplacementPolicy that wrote it
+    uint32_t ages;    // CheckpointAges
+    uint32_t reserved;
+    uint64_t num_sets;
+    uint64_t associativity;
+    uint64_t line_size;
+    uint64_t tags_offset; // from the start of the file
+    uint64_t valid_offset;
+    uint64_t ages_offset;
+    uint64_t dirty_offset; // laid out like the valid bits
+} CheckpointLevel;
+
+// writes ctx's cache state to path (through a temporary file renamed over it, so path may
+// be the checkpoint the context was restored from)
+void sim_checkpoint(const SimContext *ctx, const char *path);
+
+// replaces ctx's cache state with the checkpoint at path; exits on a mismatched geometry
+void sim_restore(SimContext *ctx, const char *path);
+
+#endif
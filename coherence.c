@@ -0,0 +1,86 @@
+#include "coherence.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIR_MIN_CAPACITY 1024
+
+static inline unsigned long home_slot(const Directory *dir, uint64_t line) {
+    return ((line * 0x9E3779B97F4A7C15ULL) >> 32) & (dir->capacity - 1);
+}
+
+DirEntry *dir_find(Directory *dir, uint64_t line) {
+    if (!dir->capacity)
+        return NULL;
+    unsigned long mask = dir->capacity - 1;
+    for (unsigned long i = home_slot(dir, line); dir->entries[i].used; i = (i + 1) & mask) {
+        if (dir->entries[i].line == line)
+            return &dir->entries[i];
+    }
+    return NULL;
+}
+
+// places a copy of entry, whose line is not in the table yet
+static DirEntry *place(Directory *dir, const DirEntry *entry) {
+    unsigned long mask = dir->capacity - 1;
+    unsigned long i = home_slot(dir, entry->line);
+    while (dir->entries[i].used)
+        i = (i + 1) & mask;
+    dir->entries[i] = *entry;
+    dir->count++;
+    return &dir->entries[i];
+}
+
+// keeps the load factor at or below one half
+static void grow(Directory *dir) {
+    DirEntry *old = dir->entries;
+    unsigned long old_capacity = dir->capacity;
+    dir->capacity = old_capacity ? old_capacity * 2 : DIR_MIN_CAPACITY;
+    dir->entries = calloc(dir->capacity, sizeof(DirEntry));
+    if (!dir->entries) { perror("calloc"); exit(1); }
+    dir->count = 0;
+    for (unsigned long i = 0; i < old_capacity; i++) {
+        if (old[i].used)
+            place(dir, &old[i]);
+    }
+    free(old);
+}
+
+DirEntry *dir_insert(Directory *dir, uint64_t line) {
+    DirEntry *entry = dir_find(dir, line);
+    if (entry)
+        return entry;
+    if ((dir->count + 1) * 2 > dir->capacity)
+        grow(dir);
+    DirEntry fresh = {0};
+    fresh.line = line;
+    fresh.used = 1;
+    return place(dir, &fresh);
+}
+
+void dir_remove(Directory *dir, DirEntry *entry) {
+    unsigned long mask = dir->capacity - 1;
+    unsigned long hole = entry - dir->entries;
+    // pull back every later entry of the run whose home slot does not lie after the hole
+    for (unsigned long i = (hole + 1) & mask; dir->entries[i].used; i = (i + 1) & mask) {
+        unsigned long home = home_slot(dir, dir->entries[i].line);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            dir->entries[hole] = dir->entries[i];
+            hole = i;
+        }
+    }
+    memset(&dir->entries[hole], 0, sizeof(DirEntry));
+    dir->count--;
+}
+
+void dir_clear(Directory *dir) {
+    if (dir->capacity)
+        memset(dir->entries, 0, dir->capacity * sizeof(DirEntry));
+    dir->count = 0;
+}
+
+void dir_free(Directory *dir) {
+    free(dir->entries);
+    dir->entries = NULL;
+    dir->capacity = dir->count = 0;
+}
@@ -0,0 +1,38 @@
+#ifndef COHERENCE_H
+#define COHERENCE_H
+
+#include <stdint.h>
+
+// MESI directory of a multi-core context (CORES > 1): one entry per line that some core
+// holds in its private levels, or that a core lost to another core's write and has not
+// missed on since. The state of a core's copy follows from the entry: M when it is the
+// exclusive sharer of a dirty line, E when the exclusive sharer of a clean one, S when it
+// shares the line without exclusivity, I when its sharer bit is clear.
+//
+// Open addressing with linear probing and backward-shift deletion, keyed by line number.
+// dir_insert and dir_remove move entries, so pointers from dir_find/dir_insert only stay
+// valid until the next of those calls.
+
+typedef struct {
+    uint64_t line;     // paddr / line size
+    uint64_t sharers;  // bit c set while core c holds the line in one of its private caches
+    uint64_t stale;    // cores whose copy another core's write invalidated, until they miss on it
+    uint8_t used;
+    uint8_t exclusive; // the single sharer holds the line in E, or in M when dirty
+    uint8_t dirty;
+} DirEntry;
+
+typedef struct {
+    DirEntry *entries;
+    unsigned long capacity; // power of two, 0 until the first insert
+    unsigned long count;
+} Directory;
+
+DirEntry *dir_find(Directory *dir, uint64_t line);
+// the line's entry, added zeroed (used set) when there is none
+DirEntry *dir_insert(Directory *dir, uint64_t line);
+void dir_remove(Directory *dir, DirEntry *entry);
+void dir_clear(Directory *dir);
+void dir_free(Directory *dir);
+
+#endif
@@ -0,0 +1,410 @@
+#include "ctrace.h"
+#include <pthread.h>
+
+#define MAX_RECORD_BYTES 27 // tag + two 10-byte varints + 3-byte access type and core
+
+// per-stream delta state, stream 1 is instructions, and the core of the previous record
+typedef struct {
+    uint64_t vaddr[2];
+    uint64_t offset[2]; // paddr - vaddr
+    uint64_t core;
+} DeltaState;
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// NULL when the varint runs past end
+static inline const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v) {
+    uint64_t result = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static uint8_t *encode_record(uint8_t *p, DeltaState *state, const TraceRecord *r) {
+    unsigned stream = (r->access_type == 1);
+    uint64_t offset = r->paddr - r->vaddr;
+    uint8_t tag = r->op & 0x0f;
+    tag |= (r->access_type < 3 ? r->access_type : 3) << 4;
+    if (offset == state->offset[stream])
+        tag |= 0x40;
+    if (r->core != state->core)
+        tag |= 0x80;
+    *p++ = tag;
+    if (r->access_type >= 3)
+        p = put_varint(p, r->access_type);
+    if (r->core != state->core)
+        p = put_varint(p, r->core);
+    p = put_varint(p, zigzag((int64_t)(r->vaddr - state->vaddr[stream])));
+    if (offset != state->offset[stream])
+        p = put_varint(p, zigzag((int64_t)(offset - state->offset[stream])));
+    state->vaddr[stream] = r->vaddr;
+    state->offset[stream] = offset;
+    state->core = r->core;
+    return p;
+}
+
+int ctrace_decode_block(const uint8_t *payload, size_t bytes, unsigned long count, TraceRecord *out) {
+    DeltaState state = {{0, 0}, {0, 0}, 0};
+    const uint8_t *p = payload, *end = payload + bytes;
+    for (unsigned long i = 0; i < count; i++) {
+        if (p >= end)
+            return 0;
+        uint8_t tag = *p++;
+        uint64_t access_type = (tag >> 4) & 3, delta;
+        if (access_type == 3 && !(p = get_varint(p, end, &access_type)))
+            return 0;
+        if ((tag & 0x80) && !(p = get_varint(p, end, &state.core)))
+            return 0;
+        unsigned stream = (access_type == 1);
+        if (!(p = get_varint(p, end, &delta)))
+            return 0;
+        state.vaddr[stream] += (uint64_t)unzigzag(delta);
+        if (!(tag & 0x40)) {
+            if (!(p = get_varint(p, end, &delta)))
+                return 0;
+            state.offset[stream] += (uint64_t)unzigzag(delta);
+        }
+        out[i].vaddr = state.vaddr[stream];
+        out[i].paddr = state.vaddr[stream] + state.offset[stream];
+        out[i].access_type = (uint16_t)access_type;
+        out[i].core = (uint16_t)state.core;
+        out[i].op = tag & 0x0f;
+    }
+    return p == end;
+}
+
+
+struct CTraceWriter {
+    FILE *fp;
+    unsigned long block_records;
+    DeltaState state;
+    unsigned long pending; // records in the current block
+    uint8_t *buffer;       // encoded payload of the current block
+    uint8_t *cursor;
+    uint64_t offset;       // bytes written so far
+    uint64_t record_count;
+    CTraceIndexEntry *index;
+    unsigned long block_count;
+    unsigned long index_capacity;
+};
+
+static void write_bytes(CTraceWriter *writer, const void *data, size_t bytes) {
+    if (bytes && fwrite(data, 1, bytes, writer->fp) != bytes) {
+        perror("fwrite");
+        exit(1);
+    }
+    writer->offset += bytes;
+}
+
+static void writer_end_block(CTraceWriter *writer) {
+    if (!writer->pending)
+        return;
+    if (writer->block_count == writer->index_capacity) {
+        writer->index_capacity = writer->index_capacity ? 2 * writer->index_capacity : 64;
+        writer->index = realloc(writer->index, writer->index_capacity * sizeof(CTraceIndexEntry));
+        if (!writer->index) { perror("realloc"); exit(1); }
+    }
+    writer->index[writer->block_count].offset = writer->offset;
+    writer->index[writer->block_count].first_record = writer->record_count;
+    writer->block_count++;
+
+    CTraceBlockHeader block = { writer->pending, (uint32_t)(writer->cursor - writer->buffer) };
+    write_bytes(writer, &block, sizeof(block));
+    write_bytes(writer, writer->buffer, block.payload_bytes);
+    writer->record_count += writer->pending;
+    writer->pending = 0;
+    writer->cursor = writer->buffer;
+    memset(&writer->state, 0, sizeof(writer->state));
+}
+
+CTraceWriter *ctrace_writer_open(const char *path, unsigned long block_records) {
+    if (block_records == 0 || block_records > UINT32_MAX / MAX_RECORD_BYTES) {
+        fprintf(stderr, "ctrace: bad block size %lu\n", block_records);
+        exit(1);
+    }
+    CTraceWriter *writer = calloc(1, sizeof(CTraceWriter));
+    if (!writer) { perror("calloc"); exit(1); }
+    writer->fp = fopen(path, "wb");
+    if (!writer->fp) { perror(path); exit(1); }
+    writer->block_records = block_records;
+    writer->buffer = malloc(block_records * MAX_RECORD_BYTES);
+    if (!writer->buffer) { perror("malloc"); exit(1); }
+    writer->cursor = writer->buffer;
+
+    CTraceHeader header = { .magic = CTRACE_MAGIC, .version = CTRACE_VERSION, .block_records = block_records };
+    write_bytes(writer, &header, sizeof(header));
+    return writer;
+}
+
+void ctrace_write(CTraceWriter *writer, const TraceRecord *record) {
+    writer->cursor = encode_record(writer->cursor, &writer->state, record);
+    if (++writer->pending == writer->block_records)
+        writer_end_block(writer);
+}
+
+void ctrace_writer_close(CTraceWriter *writer) {
+    if (!writer)
+        return;
+    writer_end_block(writer);
+    CTraceBlockHeader end_marker = {0, 0};
+    write_bytes(writer, &end_marker, sizeof(end_marker));
+
+    CTraceFooter footer = { .index_offset = writer->offset, .block_count = writer->block_count,
+                            .record_count = writer->record_count, .magic = CTRACE_INDEX_MAGIC };
+    write_bytes(writer, writer->index, writer->block_count * sizeof(CTraceIndexEntry));
+    write_bytes(writer, &footer, sizeof(footer));
+    if (fclose(writer->fp) != 0) { perror("fclose"); exit(1); }
+    free(writer->index);
+    free(writer->buffer);
+    free(writer);
+}
+
+
+// one block in flight between the file and the caller
+typedef enum { SLOT_FREE, SLOT_DECODING, SLOT_READY } SlotState;
+
+typedef struct {
+    SlotState state;
+    unsigned long seq;      // block number in the file
+    unsigned long count;
+    size_t payload_bytes;
+    uint8_t *payload;       // block_records * MAX_RECORD_BYTES
+    TraceRecord *records;   // block_records
+} BlockSlot;
+
+struct CTraceReader {
+    FILE *fp;
+    const char *path;
+    unsigned long block_records;
+
+    BlockSlot *slots;
+    unsigned long num_slots;
+    unsigned long read_seq;    // next block to read from the file
+    unsigned long consume_seq; // next block to hand to the caller
+    unsigned long end_seq;     // block count once the end marker is read
+    int at_end;
+    BlockSlot *held;           // slot the caller is reading
+
+    unsigned long num_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;      // a slot became READY or the end was found
+    pthread_cond_t space;      // a slot became FREE
+    int stop;
+};
+
+static void read_exact(CTraceReader *reader, void *data, size_t bytes) {
+    if (fread(data, 1, bytes, reader->fp) != bytes) {
+        fprintf(stderr, "%s: truncated compressed trace\n", reader->path);
+        exit(1);
+    }
+}
+
+// reads the next block's payload into slot, returns 0 at the end marker
+static int read_block(CTraceReader *reader, BlockSlot *slot) {
+    CTraceBlockHeader block;
+    read_exact(reader, &block, sizeof(block));
+    if (block.record_count == 0)
+        return 0;
+    if (block.record_count > reader->block_records || block.payload_bytes > reader->block_records * MAX_RECORD_BYTES) {
+        fprintf(stderr, "%s: corrupt block header\n", reader->path);
+        exit(1);
+    }
+    read_exact(reader, slot->payload, block.payload_bytes);
+    slot->count = block.record_count;
+    slot->payload_bytes = block.payload_bytes;
+    return 1;
+}
+
+static void decode_slot(CTraceReader *reader, BlockSlot *slot) {
+    if (!ctrace_decode_block(slot->payload, slot->payload_bytes, slot->count, slot->records)) {
+        fprintf(stderr, "%s: corrupt block %lu\n", reader->path, slot->seq);
+        exit(1);
+    }
+}
+
+// File reads are serialized under the lock so blocks are claimed in file order,
+// decoding runs unlocked.
+static void *decoder_thread(void *arg) {
+    CTraceReader *reader = arg;
+    pthread_mutex_lock(&reader->lock);
+    for (;;) {
+        BlockSlot *slot = &reader->slots[reader->read_seq % reader->num_slots];
+        while (!reader->stop && !reader->at_end && slot->state != SLOT_FREE) {
+            pthread_cond_wait(&reader->space, &reader->lock);
+            slot = &reader->slots[reader->read_seq % reader->num_slots];
+        }
+        if (reader->stop || reader->at_end)
+            break;
+        if (!read_block(reader, slot)) {
+            reader->at_end = 1;
+            reader->end_seq = reader->read_seq;
+            pthread_cond_broadcast(&reader->ready);
+            break;
+        }
+        slot->seq = reader->read_seq++;
+        slot->state = SLOT_DECODING;
+        pthread_mutex_unlock(&reader->lock);
+
+        decode_slot(reader, slot);
+
+        pthread_mutex_lock(&reader->lock);
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&reader->ready);
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return NULL;
+}
+
+CTraceReader *ctrace_open(const char *path, unsigned long threads) {
+    CTraceReader *reader = calloc(1, sizeof(CTraceReader));
+    if (!reader) { perror("calloc"); exit(1); }
+    reader->path = path;
+    reader->fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!reader->fp) { perror(path); exit(1); }
+    setvbuf(reader->fp, NULL, _IOFBF, 1 << 20);
+
+    CTraceHeader header;
+    read_exact(reader, &header, sizeof(header));
+    if (memcmp(header.magic, CTRACE_MAGIC, sizeof(CTRACE_MAGIC)) != 0 || header.version < 1 || header.version > CTRACE_VERSION ||
+        header.block_records == 0 || header.block_records > UINT32_MAX / MAX_RECORD_BYTES) {
+        fprintf(stderr, "%s: not a version 1-%d compressed trace\n", path, CTRACE_VERSION);
+        exit(1);
+    }
+    reader->block_records = header.block_records;
+
+    // two blocks per decoder keeps every thread busy while the caller works through one
+    reader->num_threads = threads;
+    reader->num_slots = threads ? 2 * threads + 1 : 1;
+    reader->slots = calloc(reader->num_slots, sizeof(BlockSlot));
+    if (!reader->slots) { perror("calloc"); exit(1); }
+    for (unsigned long i = 0; i < reader->num_slots; i++) {
+        reader->slots[i].payload = malloc(reader->block_records * MAX_RECORD_BYTES);
+        reader->slots[i].records = malloc(reader->block_records * sizeof(TraceRecord));
+        if (!reader->slots[i].payload || !reader->slots[i].records) { perror("malloc"); exit(1); }
+    }
+
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->ready, NULL);
+    pthread_cond_init(&reader->space, NULL);
+    if (threads) {
+        reader->threads = malloc(threads * sizeof(pthread_t));
+        if (!reader->threads) { perror("malloc"); exit(1); }
+        for (unsigned long i = 0; i < threads; i++) {
+            if (pthread_create(&reader->threads[i], NULL, decoder_thread, reader) != 0) {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+    }
+    return reader;
+}
+
+unsigned long ctrace_next_block(CTraceReader *reader, const TraceRecord **records) {
+    if (reader->num_threads == 0) {
+        BlockSlot *slot = &reader->slots[0];
+        if (reader->at_end || !read_block(reader, slot)) {
+            reader->at_end = 1;
+            return 0;
+        }
+        slot->seq = reader->consume_seq++;
+        decode_slot(reader, slot);
+        *records = slot->records;
+        return slot->count;
+    }
+
+    pthread_mutex_lock(&reader->lock);
+    if (reader->held) {
+        reader->held->state = SLOT_FREE;
+        reader->held = NULL;
+        pthread_cond_broadcast(&reader->space);
+    }
+    BlockSlot *slot = &reader->slots[reader->consume_seq % reader->num_slots];
+    while (!(slot->state == SLOT_READY && slot->seq == reader->consume_seq) &&
+           !(reader->at_end && reader->consume_seq == reader->end_seq))
+        pthread_cond_wait(&reader->ready, &reader->lock);
+    unsigned long count = 0;
+    if (slot->state == SLOT_READY && slot->seq == reader->consume_seq) {
+        reader->held = slot;
+        reader->consume_seq++;
+        *records = slot->records;
+        count = slot->count;
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return count;
+}
+
+void ctrace_close(CTraceReader *reader) {
+    if (!reader)
+        return;
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = 1;
+    pthread_cond_broadcast(&reader->space);
+    pthread_mutex_unlock(&reader->lock);
+    for (unsigned long i = 0; i < reader->num_threads; i++)
+        pthread_join(reader->threads[i], NULL);
+
+    if (reader->fp != stdin)
+        fclose(reader->fp);
+    for (unsigned long i = 0; i < reader->num_slots; i++) {
+        free(reader->slots[i].payload);
+        free(reader->slots[i].records);
+    }
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->ready);
+    pthread_cond_destroy(&reader->space);
+    free(reader->slots);
+    free(reader->threads);
+    free(reader);
+}
+
+
+void ctrace_read_index(const char *path, CTraceFooter *footer, CTraceIndexEntry **index) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) { perror(path); exit(1); }
+    if (fseek(fp, -(long)sizeof(CTraceFooter), SEEK_END) != 0 || fread(footer, sizeof(*footer), 1, fp) != 1 ||
+        memcmp(footer->magic, CTRACE_INDEX_MAGIC, sizeof(CTRACE_INDEX_MAGIC)) != 0) {
+        fprintf(stderr, "%s: no block index\n", path);
+        exit(1);
+    }
+    *index = malloc((footer->block_count ? footer->block_count : 1) * sizeof(CTraceIndexEntry));
+    if (!*index) { perror("malloc"); exit(1); }
+    if (fseek(fp, (long)footer->index_offset, SEEK_SET) != 0 ||
+        fread(*index, sizeof(CTraceIndexEntry), footer->block_count, fp) != footer->block_count) {
+        fprintf(stderr, "%s: truncated block index\n", path);
+        exit(1);
+    }
+    fclose(fp);
+}
+
+int ctrace_is_compressed(const char *path) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+    char magic[8];
+    int compressed = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+                     memcmp(magic, CTRACE_MAGIC, sizeof(CTRACE_MAGIC)) == 0;
+    fclose(fp);
+    return compressed;
+}
@@ -0,0 +1,76 @@
+#ifndef CTRACE_H
+#define CTRACE_H
+
+#include "trace.h"
+
+// Compressed trace format, same records as trace.h:
+//
+//   CTraceHeader
+//   blocks: CTraceBlockHeader + payload, repeated
+//   end marker: CTraceBlockHeader with record_count 0
+//   index: one CTraceIndexEntry per block
+//   CTraceFooter
+//
+// Every record starts with a tag byte (op in bits 0-3, access type in bits 4-5 with 3
+// meaning a varint follows, bit 6 set when paddr - vaddr is unchanged, bit 7 set when the
+// core differs from the previous record's and follows as a varint after the access type;
+// version 1 traces never set bit 7 and read as core 0). Then come the zigzag varint delta
+// of vaddr and, without bit 6, the zigzag varint delta of paddr - vaddr. Deltas are kept separately for the instruction and data streams and
+// restart from zero in each block, so blocks decode independently. The end marker lets
+// a reader stream blocks from a pipe, the index lets it find blocks without scanning.
+
+#define CTRACE_MAGIC "CSIMCTR"
+#define CTRACE_INDEX_MAGIC "CSIMIDX"
+#define CTRACE_VERSION 2
+#define CTRACE_BLOCK_RECORDS 65536 // default records per block
+
+typedef struct {
+    char magic[8];          // CTRACE_MAGIC, NUL padded
+    uint32_t version;       // CTRACE_VERSION
+    uint32_t block_records; // most records in one block
+} CTraceHeader;
+
+typedef struct {
+    uint32_t record_count;
+    uint32_t payload_bytes;
+} CTraceBlockHeader;
+
+typedef struct {
+    uint64_t offset;       // file offset of the block header
+    uint64_t first_record;
+} CTraceIndexEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint64_t block_count;
+    uint64_t record_count;
+    char magic[8];         // CTRACE_INDEX_MAGIC
+} CTraceFooter;
+
+// encoder
+typedef struct CTraceWriter CTraceWriter;
+
+CTraceWriter *ctrace_writer_open(const char *path, unsigned long block_records);
+void ctrace_write(CTraceWriter *writer, const TraceRecord *record);
+void ctrace_writer_close(CTraceWriter *writer);
+
+// decodes one block payload into out (room for count records), returns 0 if it is corrupt
+int ctrace_decode_block(const uint8_t *payload, size_t bytes, unsigned long count, TraceRecord *out);
+
+// Streaming reader, holds a few decoded blocks at a time. With threads == 0 blocks are
+// read and decoded by the caller. Otherwise that many decoder threads run ahead of the
+// caller, and blocks are still returned in file order. path "-" reads stdin.
+typedef struct CTraceReader CTraceReader;
+
+CTraceReader *ctrace_open(const char *path, unsigned long threads);
+// next block of records, valid until the next call; returns the record count, 0 at the end
+unsigned long ctrace_next_block(CTraceReader *reader, const TraceRecord **records);
+void ctrace_close(CTraceReader *reader);
+
+// reads the footer and block index of a seekable compressed trace, *index is malloc'ed
+void ctrace_read_index(const char *path, CTraceFooter *footer, CTraceIndexEntry **index);
+
+// nonzero if path starts with a compressed trace header
+int ctrace_is_compressed(const char *path);
+
+#endif
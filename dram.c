@@ -0,0 +1,203 @@
+#include "dram.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_ROW UINT64_MAX
+
+typedef struct {
+    uint64_t row;             // left open by the scheduled commands, NO_ROW when precharged
+    unsigned long ready;      // cycle the next command can start, a CAS while row is open
+    uint64_t prev_row;        // open before the last scheduled row change, until it starts
+    unsigned long prev_ready; // next CAS to prev_row
+    unsigned long change;     // cycle the last row change starts
+    unsigned long overtaken;  // row hits that went ahead of it
+} Bank;
+
+struct Dram {
+    DramConfig config;
+    Bank *banks;
+    unsigned long *bus_ready; // per channel
+    DramStats *stats;
+    unsigned long num_banks;
+};
+
+void dram_defaults(DramConfig *config) {
+    // DDR4-3200 at 14 ns per timing, seen from a 3.2 GHz core
+    config->channels = 2;
+    config->ranks = 1;
+    config->banks = 16;
+    config->row_size = 8192;
+    config->tcas = 44;
+    config->trcd = 44;
+    config->trp = 44;
+    config->tburst = 8;
+    config->latency = 40;
+    config->frfcfs_cap = 4;
+    config->page_policy = DRAM_OPEN_PAGE;
+}
+
+int dram_config_key(DramConfig *config, const char *field, const char *value) {
+    if (strcmp(field, "CHANNELS") == 0)
+        config->channels = strtoul(value, NULL, 10);
+    else if (strcmp(field, "RANKS") == 0)
+        config->ranks = strtoul(value, NULL, 10);
+    else if (strcmp(field, "BANKS") == 0)
+        config->banks = strtoul(value, NULL, 10);
+    else if (strcmp(field, "ROW_SIZE") == 0)
+        config->row_size = strtoul(value, NULL, 10);
+    else if (strcmp(field, "TCAS") == 0)
+        config->tcas = strtoul(value, NULL, 10);
+    else if (strcmp(field, "TRCD") == 0)
+        config->trcd = strtoul(value, NULL, 10);
+    else if (strcmp(field, "TRP") == 0)
+        config->trp = strtoul(value, NULL, 10);
+    else if (strcmp(field, "TBURST") == 0)
+        config->tburst = strtoul(value, NULL, 10);
+    else if (strcmp(field, "LATENCY") == 0)
+        config->latency = strtoul(value, NULL, 10);
+    else if (strcmp(field, "FRFCFS_CAP") == 0)
+        config->frfcfs_cap = strtoul(value, NULL, 10);
+    else if (strcmp(field, "PAGE_POLICY") == 0) {
+        if (strcmp(value, "CLOSED") == 0) {
+            config->page_policy = DRAM_CLOSED_PAGE;
+        } else {
+            if (strcmp(value, "OPEN") != 0)
+                fprintf(stderr, "Warning: unknown DRAM_PAGE_POLICY %s, using OPEN.\n", value);
+            config->page_policy = DRAM_OPEN_PAGE;
+        }
+    } else
+        return 0;
+    return 1;
+}
+
+const char *dram_page_policy_name(DramPagePolicy policy) {
+    return policy == DRAM_CLOSED_PAGE ? "closed page" : "open page";
+}
+
+static void *zalloc(size_t count, size_t size) {
+    void *p = calloc(count, size);
+    if (!p) { perror("calloc"); exit(1); }
+    return p;
+}
+
+Dram *dram_create(const DramConfig *config) {
+    if (!config->channels || !config->ranks || !config->banks || !config->row_size) {
+        fprintf(stderr, "DRAM needs at least one channel, rank and bank, and a row size\n");
+        exit(1);
+    }
+    Dram *dram = zalloc(1, sizeof(Dram));
+    dram->config = *config;
+    dram->num_banks = config->channels * config->ranks * config->banks;
+    dram->banks = zalloc(dram->num_banks, sizeof(Bank));
+    dram->bus_ready = zalloc(config->channels, sizeof(unsigned long));
+    dram->stats = zalloc(dram->num_banks, sizeof(DramStats));
+    dram_reset(dram);
+    return dram;
+}
+
+void dram_destroy(Dram *dram) {
+    if (!dram)
+        return;
+    free(dram->banks);
+    free(dram->bus_ready);
+    free(dram->stats);
+    free(dram);
+}
+
+void dram_reset(Dram *dram) {
+    memset(dram->banks, 0, dram->num_banks * sizeof(Bank));
+    for (unsigned long i = 0; i < dram->num_banks; i++)
+        dram->banks[i].row = dram->banks[i].prev_row = NO_ROW;
+    memset(dram->bus_ready, 0, dram->config.channels * sizeof(unsigned long));
+}
+
+void dram_clear_stats(Dram *dram) {
+    memset(dram->stats, 0, dram->num_banks * sizeof(DramStats));
+}
+
+static inline unsigned long later(unsigned long a, unsigned long b) {
+    return a > b ? a : b;
+}
+
+unsigned long dram_access(Dram *dram, uint64_t paddr, unsigned long now, int write, int count) {
+    const DramConfig *c = &dram->config;
+    uint64_t block = paddr / c->row_size;
+    unsigned long channel = block % c->channels;
+    block /= c->channels;
+    unsigned long bank = block % c->banks;
+    block /= c->banks;
+    unsigned long rank = block % c->ranks;
+    uint64_t row = block / c->ranks;
+    unsigned long index = (channel * c->ranks + rank) * c->banks + bank;
+    Bank *b = &dram->banks[index];
+    DramStats *s = &dram->stats[index];
+
+    unsigned long cas;
+    if (b->row != row && b->prev_row == row && now < b->change && b->overtaken < c->frfcfs_cap) {
+        // FR-FCFS: a hit to the row still open goes first, the queued change waits a burst
+        cas = later(now, b->prev_ready);
+        b->prev_ready = cas + c->tburst;
+        b->change += c->tburst;
+        b->ready += c->tburst;
+        b->overtaken++;
+        s->row_hits += count;
+    } else {
+        unsigned long start = later(now, b->ready);
+        if (b->row == row) {
+            cas = start;
+            s->row_hits += count;
+        } else {
+            if (b->row == NO_ROW) {
+                cas = start + c->trcd;
+                s->row_empty += count;
+            } else {
+                cas = start + c->trp + c->trcd;
+                s->row_conflicts += count;
+            }
+            b->prev_row = b->row;
+            b->prev_ready = b->ready;
+            b->change = start;
+            b->overtaken = 0;
+        }
+        if (c->page_policy == DRAM_CLOSED_PAGE) {
+            b->row = b->prev_row = NO_ROW;
+            b->ready = cas + c->tburst + c->trp;
+        } else {
+            b->row = row;
+            b->ready = cas + c->tburst;
+        }
+    }
+    unsigned long *bus = &dram->bus_ready[channel];
+    unsigned long done = later(cas + c->tcas, *bus) + c->tburst;
+    *bus = done;
+    if (write) {
+        s->writes += count;
+        return 0;
+    }
+    unsigned long latency = done - now + c->latency;
+    s->reads += count;
+    s->read_latency += count ? latency : 0;
+    return latency;
+}
+
+unsigned long dram_num_banks(const Dram *dram) {
+    return dram->num_banks;
+}
+
+const DramStats *dram_bank_stats(const Dram *dram, unsigned long bank) {
+    return &dram->stats[bank];
+}
+
+void dram_totals(const Dram *dram, DramStats *total) {
+    memset(total, 0, sizeof(*total));
+    for (unsigned long i = 0; i < dram->num_banks; i++) {
+        const DramStats *s = &dram->stats[i];
+        total->reads += s->reads;
+        total->writes += s->writes;
+        total->row_hits += s->row_hits;
+        total->row_empty += s->row_empty;
+        total->row_conflicts += s->row_conflicts;
+        total->read_latency += s->read_latency;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef DRAM_H
+#define DRAM_H
+
+#include <stdint.h>
+
+// DRAM timing backend (MEM_MODEL=DRAM), in place of a fixed MEM_LATENCY per access.
+// Physical addresses map row:rank:bank:channel:column, low bits first, so consecutive
+// lines share a row and consecutive rows spread over channels and banks first.
+//
+// Every bank keeps the row its last command left open, and when it can take the next
+// command. A read is a row hit (tCAS), a row miss to a precharged bank (tRCD + tCAS) or a
+// row conflict (tRP + tRCD + tCAS), then a burst of tBURST on its channel's data bus, plus
+// the controller's fixed latency. The closed-page policy precharges after each access.
+// Requests are scheduled as they arrive, in order, with one FR-FCFS reordering: a row hit
+// to the row still open may go ahead of a row change queued at its bank, up to frfcfs_cap
+// times in a row. Writes are posted: they take the bank and the bus, and nothing waits on them.
+
+typedef enum {
+    DRAM_OPEN_PAGE,
+    DRAM_CLOSED_PAGE
+} DramPagePolicy;
+
+typedef struct {
+    unsigned long channels;
+    unsigned long ranks;        // per channel
+    unsigned long banks;        // per rank
+    unsigned long row_size;     // bytes
+    unsigned long tcas;         // cycles, like every timing here
+    unsigned long trcd;
+    unsigned long trp;
+    unsigned long tburst;       // one line on the data bus
+    unsigned long latency;      // controller and interconnect, on every read
+    unsigned long frfcfs_cap;   // row hits that may overtake one queued row change, 0 = FCFS
+    DramPagePolicy page_policy;
+} DramConfig;
+
+// per bank, counted while the caller says so
+typedef struct {
+    unsigned long reads;
+    unsigned long writes;
+    unsigned long row_hits;
+    unsigned long row_empty;     // the bank was precharged
+    unsigned long row_conflicts; // another row was open
+    unsigned long read_latency;  // summed over the reads
+} DramStats;
+
+typedef struct Dram Dram;
+
+void dram_defaults(DramConfig *config);
+// sets the DRAM_<field> key, returns 0 for an unknown field
+int dram_config_key(DramConfig *config, const char *field, const char *value);
+const char *dram_page_policy_name(DramPagePolicy policy);
+
+Dram *dram_create(const DramConfig *config);
+void dram_destroy(Dram *dram);
+// forgets open rows and bank timings
+void dram_reset(Dram *dram);
+void dram_clear_stats(Dram *dram);
+
+// A read (or posted write) of paddr's line arriving at cycle now. Returns the cycles until
+// a read's data is back, 0 for a write. count adds it to the bank's DramStats.
+unsigned long dram_access(Dram *dram, uint64_t paddr, unsigned long now, int write, int count);
+
+// banks are numbered channel-major: (channel * ranks + rank) * banks + bank
+unsigned long dram_num_banks(const Dram *dram);
+const DramStats *dram_bank_stats(const Dram *dram, unsigned long bank);
+void dram_totals(const Dram *dram, DramStats *total);
+
+#endif
@@ -0,0 +1,404 @@
+#include "import.h"
+#include <pthread.h>
+
+#define CHUNK_BYTES (4UL << 20)
+#define CHAMPSIM_RECORD_BYTES 64 // sizeof(input_instr)
+
+static const char *format_names[IMPORT_NUM_FORMATS] = {
+    [IMPORT_LACKEY] = "lackey",
+    [IMPORT_DRCACHESIM] = "drcachesim",
+    [IMPORT_CHAMPSIM] = "champsim",
+};
+
+ImportFormat import_format(const char *name) {
+    for (int f = 0; f < IMPORT_NUM_FORMATS; f++) {
+        if (strcmp(name, format_names[f]) == 0)
+            return (ImportFormat)f;
+    }
+    return IMPORT_NUM_FORMATS;
+}
+
+const char *import_format_name(ImportFormat format) {
+    return format < IMPORT_NUM_FORMATS ? format_names[format] : "unknown";
+}
+
+// growable record array owned by a chunk slot
+typedef struct {
+    TraceRecord *records;
+    unsigned long count;
+    unsigned long capacity;
+} RecordBuffer;
+
+static void emit_core(RecordBuffer *out, uint64_t addr, uint32_t access_type, uint32_t core, TraceOp op) {
+    if (out->count == out->capacity) {
+        out->capacity = out->capacity ? 2 * out->capacity : 65536;
+        out->records = realloc(out->records, out->capacity * sizeof(TraceRecord));
+        if (!out->records) { perror("realloc"); exit(1); }
+    }
+    TraceRecord *r = &out->records[out->count++];
+    r->vaddr = addr;
+    r->paddr = addr;
+    r->access_type = access_type;
+    r->core = core;
+    r->op = op;
+}
+
+static inline void emit(RecordBuffer *out, uint64_t addr, uint32_t access_type, TraceOp op) {
+    emit_core(out, addr, access_type, 0, op);
+}
+
+static inline int hex_digit(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// parses hex digits (after an optional 0x) at p, returns the end or NULL if there are none
+static const char *parse_hex(const char *p, const char *end, uint64_t *value) {
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+        p += 2;
+    const char *start = p;
+    uint64_t v = 0;
+    int d;
+    while (p < end && (d = hex_digit(*p)) >= 0) {
+        v = (v << 4) | (uint64_t)d;
+        p++;
+    }
+    *value = v;
+    return p == start ? NULL : p;
+}
+
+static inline const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t'))
+        p++;
+    return p;
+}
+
+// "I  0023C790,2", " L BE801950,4", " S ...", " M ..."; valgrind's "==pid==" lines are skipped
+static void parse_lackey_line(const char *p, const char *end, RecordBuffer *out) {
+    p = skip_blanks(p, end);
+    if (end - p < 3 || (p[1] != ' ' && p[1] != '\t'))
+        return;
+    char kind = p[0];
+    uint64_t addr;
+    if (!parse_hex(skip_blanks(p + 1, end), end, &addr))
+        return;
+    switch (kind) {
+        case 'I': emit(out, addr, 1, TRACE_ACCESS); break;
+        case 'L': emit(out, addr, 0, TRACE_ACCESS); break;
+        case 'S': emit(out, addr, 2, TRACE_ACCESS); break;
+        case 'M': // read-modify-write
+            emit(out, addr, 0, TRACE_ACCESS);
+            emit(out, addr, 2, TRACE_ACCESS);
+            break;
+    }
+}
+
+typedef struct {
+    const char *name;
+    uint32_t access_type;
+    TraceOp op;
+} DrType;
+
+// drmemtrace type names as printed by its text views
+static const DrType dr_types[] = {
+    { "ifetch",              1, TRACE_ACCESS },
+    { "read",                0, TRACE_ACCESS },
+    { "write",               2, TRACE_ACCESS },
+    { "prefetch",            0, TRACE_PREFETCH },
+    { "prefetch_read",       0, TRACE_PREFETCH },
+    { "prefetch_instr",      1, TRACE_PREFETCH },
+    { "prefetcht0",          0, TRACE_PREFETCH_T0 },
+    { "prefetch_read_l1",    0, TRACE_PREFETCH_T0 },
+    { "prefetcht1",          0, TRACE_PREFETCH_T1 },
+    { "prefetch_read_l2",    0, TRACE_PREFETCH_T1 },
+    { "prefetcht2",          0, TRACE_PREFETCH_T2 },
+    { "prefetch_read_l3",    0, TRACE_PREFETCH_T2 },
+    { "prefetchnta",         0, TRACE_PREFETCH_NTA },
+    { "prefetch_read_l1_nt", 0, TRACE_PREFETCH_NTA },
+    { "prefetch_write",      0, TRACE_PREFETCH_W },
+    { "prefetchw",           0, TRACE_PREFETCH_W },
+    { "data_flush",          0, TRACE_FLUSH },
+    { "flush",               0, TRACE_FLUSH },
+    { "instr_flush",         1, TRACE_FLUSH },
+    { "iflush",              1, TRACE_FLUSH },
+};
+
+static const DrType *dr_lookup(const char *word, size_t length) {
+    for (size_t i = 0; i < sizeof(dr_types) / sizeof(dr_types[0]); i++) {
+        if (strlen(dr_types[i].name) == length && memcmp(dr_types[i].name, word, length) == 0)
+            return &dr_types[i];
+    }
+    return NULL;
+}
+
+// "   12    3:   T9295 ifetch   3 byte(s) @ 0x00007f6fdd3ec0c3 non-branch": the thread id
+// ahead of the first word naming a type, which becomes the record's core, then the address
+// after "@" (or the first 0x word after the type)
+static void parse_drcachesim_line(const char *p, const char *end, RecordBuffer *out) {
+    const DrType *type = NULL;
+    const char *addr_word = NULL;
+    uint32_t tid = 0;
+    while ((p = skip_blanks(p, end)) < end) {
+        const char *word = p;
+        while (p < end && *p != ' ' && *p != '\t')
+            p++;
+        size_t length = p - word;
+        if (!type) {
+            type = dr_lookup(word, length);
+            if (!type && length > 1 && word[0] == 'T' && word[1] >= '0' && word[1] <= '9')
+                tid = strtoul(word + 1, NULL, 10);
+        } else if (length == 1 && word[0] == '@') {
+            addr_word = skip_blanks(p, end);
+            break;
+        } else if (!addr_word && length > 2 && word[0] == '0' && word[1] == 'x') {
+            addr_word = word;
+        }
+    }
+    uint64_t addr;
+    if (type && addr_word && parse_hex(addr_word, end, &addr))
+        emit_core(out, addr, type->access_type, tid & 0xffff, type->op);
+}
+
+static void parse_text(const char *text, size_t bytes, ImportFormat format, RecordBuffer *out) {
+    const char *p = text, *end = text + bytes;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol)
+            eol = end;
+        if (format == IMPORT_LACKEY)
+            parse_lackey_line(p, eol, out);
+        else
+            parse_drcachesim_line(p, eol, out);
+        p = eol + 1;
+    }
+}
+
+// struct input_instr { u64 ip; u8 is_branch, branch_taken, dst_regs[2], src_regs[4];
+//                      u64 destination_memory[2]; u64 source_memory[4]; }
+static void parse_champsim(const char *data, size_t bytes, RecordBuffer *out) {
+    for (size_t off = 0; off + CHAMPSIM_RECORD_BYTES <= bytes; off += CHAMPSIM_RECORD_BYTES) {
+        uint64_t ip, dst[2], src[4];
+        memcpy(&ip, data + off, sizeof(ip));
+        memcpy(dst, data + off + 16, sizeof(dst));
+        memcpy(src, data + off + 32, sizeof(src));
+        emit(out, ip, 1, TRACE_ACCESS);
+        for (int i = 0; i < 4; i++)
+            if (src[i]) emit(out, src[i], 0, TRACE_ACCESS);
+        for (int i = 0; i < 2; i++)
+            if (dst[i]) emit(out, dst[i], 2, TRACE_ACCESS);
+    }
+}
+
+
+// one chunk in flight between the file and the caller
+typedef enum { SLOT_FREE, SLOT_PARSING, SLOT_READY } SlotState;
+
+typedef struct {
+    SlotState state;
+    unsigned long seq;
+    char *data;   // CHUNK_BYTES
+    size_t bytes;
+    RecordBuffer out;
+} ChunkSlot;
+
+struct TraceImporter {
+    FILE *fp;
+    const char *path;
+    ImportFormat format;
+
+    char *carry;        // partial line (or record) left over from the previous chunk
+    size_t carry_bytes;
+
+    ChunkSlot *slots;
+    unsigned long num_slots;
+    unsigned long read_seq;
+    unsigned long consume_seq;
+    unsigned long end_seq;
+    int at_end;
+    ChunkSlot *held;
+
+    unsigned long num_threads;
+    pthread_t *threads;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    pthread_cond_t space;
+    int stop;
+};
+
+// Fills slot with the next chunk, cut after its last complete line or record. Returns 0 at
+// the end of the input.
+static int read_chunk(TraceImporter *importer, ChunkSlot *slot) {
+    memcpy(slot->data, importer->carry, importer->carry_bytes);
+    size_t bytes = importer->carry_bytes;
+    bytes += fread(slot->data + bytes, 1, CHUNK_BYTES - bytes, importer->fp);
+    if (ferror(importer->fp)) { perror(importer->path); exit(1); }
+    int eof = bytes < CHUNK_BYTES;
+
+    size_t cut = bytes;
+    if (importer->format == IMPORT_CHAMPSIM) {
+        cut -= bytes % CHAMPSIM_RECORD_BYTES;
+        if (eof && cut != bytes)
+            fprintf(stderr, "%s: ignoring %zu trailing bytes\n", importer->path, bytes - cut);
+    } else if (!eof) {
+        while (cut > 0 && slot->data[cut - 1] != '\n')
+            cut--;
+        if (cut == 0) {
+            fprintf(stderr, "%s: line longer than %lu bytes\n", importer->path, CHUNK_BYTES);
+            exit(1);
+        }
+    }
+    importer->carry_bytes = eof ? 0 : bytes - cut;
+    memcpy(importer->carry, slot->data + cut, importer->carry_bytes);
+    slot->bytes = cut;
+    return cut > 0 || !eof;
+}
+
+static void parse_slot(TraceImporter *importer, ChunkSlot *slot) {
+    slot->out.count = 0;
+    if (importer->format == IMPORT_CHAMPSIM)
+        parse_champsim(slot->data, slot->bytes, &slot->out);
+    else
+        parse_text(slot->data, slot->bytes, importer->format, &slot->out);
+}
+
+// same scheme as the ctrace decoder threads: chunks are read in order under the lock
+// and parsed unlocked
+static void *parser_thread(void *arg) {
+    TraceImporter *importer = arg;
+    pthread_mutex_lock(&importer->lock);
+    for (;;) {
+        ChunkSlot *slot = &importer->slots[importer->read_seq % importer->num_slots];
+        while (!importer->stop && !importer->at_end && slot->state != SLOT_FREE) {
+            pthread_cond_wait(&importer->space, &importer->lock);
+            slot = &importer->slots[importer->read_seq % importer->num_slots];
+        }
+        if (importer->stop || importer->at_end)
+            break;
+        if (!read_chunk(importer, slot)) {
+            importer->at_end = 1;
+            importer->end_seq = importer->read_seq;
+            pthread_cond_broadcast(&importer->ready);
+            break;
+        }
+        slot->seq = importer->read_seq++;
+        slot->state = SLOT_PARSING;
+        pthread_mutex_unlock(&importer->lock);
+
+        parse_slot(importer, slot);
+
+        pthread_mutex_lock(&importer->lock);
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&importer->ready);
+    }
+    pthread_mutex_unlock(&importer->lock);
+    return NULL;
+}
+
+TraceImporter *import_open(const char *path, ImportFormat format, unsigned long threads) {
+    if (format >= IMPORT_NUM_FORMATS) {
+        fprintf(stderr, "import: unknown trace format\n");
+        exit(1);
+    }
+    TraceImporter *importer = calloc(1, sizeof(TraceImporter));
+    if (!importer) { perror("calloc"); exit(1); }
+    importer->path = path;
+    importer->format = format;
+    importer->fp = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!importer->fp) { perror(path); exit(1); }
+    importer->carry = malloc(CHUNK_BYTES);
+    if (!importer->carry) { perror("malloc"); exit(1); }
+
+    importer->num_threads = threads;
+    importer->num_slots = threads ? 2 * threads + 1 : 1;
+    importer->slots = calloc(importer->num_slots, sizeof(ChunkSlot));
+    if (!importer->slots) { perror("calloc"); exit(1); }
+    for (unsigned long i = 0; i < importer->num_slots; i++) {
+        importer->slots[i].data = malloc(CHUNK_BYTES);
+        if (!importer->slots[i].data) { perror("malloc"); exit(1); }
+    }
+
+    pthread_mutex_init(&importer->lock, NULL);
+    pthread_cond_init(&importer->ready, NULL);
+    pthread_cond_init(&importer->space, NULL);
+    if (threads) {
+        importer->threads = malloc(threads * sizeof(pthread_t));
+        if (!importer->threads) { perror("malloc"); exit(1); }
+        for (unsigned long i = 0; i < threads; i++) {
+            if (pthread_create(&importer->threads[i], NULL, parser_thread, importer) != 0) {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+    }
+    return importer;
+}
+
+// next chunk in input order, NULL at the end
+static ChunkSlot *next_chunk(TraceImporter *importer) {
+    if (importer->num_threads == 0) {
+        ChunkSlot *slot = &importer->slots[0];
+        if (importer->at_end || !read_chunk(importer, slot)) {
+            importer->at_end = 1;
+            return NULL;
+        }
+        parse_slot(importer, slot);
+        return slot;
+    }
+
+    pthread_mutex_lock(&importer->lock);
+    if (importer->held) {
+        importer->held->state = SLOT_FREE;
+        importer->held = NULL;
+        pthread_cond_broadcast(&importer->space);
+    }
+    ChunkSlot *slot = &importer->slots[importer->consume_seq % importer->num_slots];
+    while (!(slot->state == SLOT_READY && slot->seq == importer->consume_seq) &&
+           !(importer->at_end && importer->consume_seq == importer->end_seq))
+        pthread_cond_wait(&importer->ready, &importer->lock);
+    if (slot->state == SLOT_READY && slot->seq == importer->consume_seq) {
+        importer->held = slot;
+        importer->consume_seq++;
+    } else {
+        slot = NULL;
+    }
+    pthread_mutex_unlock(&importer->lock);
+    return slot;
+}
+
+unsigned long import_next(TraceImporter *importer, const TraceRecord **records) {
+    ChunkSlot *slot;
+    while ((slot = next_chunk(importer)) != NULL) {
+        if (slot->out.count) { // chunks of only skipped lines are passed over
+            *records = slot->out.records;
+            return slot->out.count;
+        }
+    }
+    return 0;
+}
+
+void import_close(TraceImporter *importer) {
+    if (!importer)
+        return;
+    pthread_mutex_lock(&importer->lock);
+    importer->stop = 1;
+    pthread_cond_broadcast(&importer->space);
+    pthread_mutex_unlock(&importer->lock);
+    for (unsigned long i = 0; i < importer->num_threads; i++)
+        pthread_join(importer->threads[i], NULL);
+
+    if (importer->fp != stdin)
+        fclose(importer->fp);
+    for (unsigned long i = 0; i < importer->num_slots; i++) {
+        free(importer->slots[i].data);
+        free(importer->slots[i].out.records);
+    }
+    pthread_mutex_destroy(&importer->lock);
+    pthread_cond_destroy(&importer->ready);
+    pthread_cond_destroy(&importer->space);
+    free(importer->slots);
+    free(importer->threads);
+    free(importer->carry);
+    free(importer);
+}
@@ -0,0 +1,42 @@
+#ifndef IMPORT_H
+#define IMPORT_H
+
+#include "trace.h"
+
+// Readers for traces from other tools, producing trace.h records:
+//
+//   lackey      valgrind --tool=lackey --trace-mem=yes output. I is an instruction
+//               fetch, L a load, S a store, M a load followed by a store.
+//   drcachesim  DynamoRIO drcachesim/drmemtrace text views. ifetch, read, write, the
+//               prefetch kinds and the data/instruction flushes are imported, markers
+//               and other lines are skipped. The low 16 bits of the thread id (T<tid>)
+//               become the record's core.
+//   champsim    ChampSim binary traces (64-byte input_instr records, uncompressed).
+//               Every instruction becomes a fetch of its ip, then its loads, then its
+//               stores.
+//
+// None of these carry physical addresses, so paddr = vaddr. Access sizes are ignored.
+// Stores are imported as access type 2, which only multi-core hierarchies tell apart.
+
+typedef enum {
+    IMPORT_LACKEY,
+    IMPORT_DRCACHESIM,
+    IMPORT_CHAMPSIM,
+    IMPORT_NUM_FORMATS
+} ImportFormat;
+
+// IMPORT_NUM_FORMATS for an unknown name
+ImportFormat import_format(const char *name);
+const char *import_format_name(ImportFormat format);
+
+// The input is split into chunks on line (or record) boundaries. With threads == 0 the
+// caller parses each chunk, otherwise that many threads parse chunks in parallel and
+// they are still returned in input order. path "-" reads stdin.
+typedef struct TraceImporter TraceImporter;
+
+TraceImporter *import_open(const char *path, ImportFormat format, unsigned long threads);
+// records of the next chunk, valid until the next call; returns the record count, 0 at the end
+unsigned long import_next(TraceImporter *importer, const TraceRecord **records);
+void import_close(TraceImporter *importer);
+
+#endif
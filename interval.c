@@ -0,0 +1,123 @@
+#include "interval.h"
+#include "pause.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct IntervalLog {
+    FILE *fp;
+    char *path;
+    int binary;
+    unsigned long num_fields;
+    uint64_t *rows;         // [slots][num_fields]
+    unsigned long slots;
+    unsigned long head;     // atomic, rows committed by the simulating thread
+    unsigned long tail;     // atomic, rows written out
+    unsigned long stalls;
+    int stop;               // atomic
+    pthread_t writer;
+};
+
+static void write_row(IntervalLog *log, const uint64_t *row) {
+    if (log->binary) {
+        if (fwrite(row, sizeof(uint64_t), log->num_fields, log->fp) != log->num_fields) {
+            perror(log->path);
+            exit(1);
+        }
+        return;
+    }
+    for (unsigned long i = 0; i < log->num_fields; i++)
+        fprintf(log->fp, i ? ",%llu" : "%llu", (unsigned long long)row[i]);
+    fputc('\n', log->fp);
+}
+
+// writes rows as they are committed; on stop, exits once every row is out
+static void *write_rows(void *arg) {
+    IntervalLog *log = arg;
+    unsigned long polls = 0;
+    for (;;) {
+        int stop = __atomic_load_n(&log->stop, __ATOMIC_ACQUIRE);
+        unsigned long tail = log->tail;
+        unsigned long head = __atomic_load_n(&log->head, __ATOMIC_ACQUIRE);
+        if (head != tail) {
+            for (; tail != head; tail++)
+                write_row(log, log->rows + (tail % log->slots) * log->num_fields);
+            __atomic_store_n(&log->tail, tail, __ATOMIC_RELEASE);
+            polls = 0;
+            continue;
+        }
+        if (stop)
+            break;
+        fflush(log->fp); // idle, let readers of the file see the rows so far
+        pause_briefly(polls++);
+    }
+    return NULL;
+}
+
+IntervalLog *interval_open(const char *path, int binary, const char (*names)[INTERVAL_NAME_SIZE],
+                           unsigned long num_fields, unsigned long slots) {
+    IntervalLog *log = calloc(1, sizeof(IntervalLog));
+    if (!log) { perror("calloc"); exit(1); }
+    log->fp = fopen(path, binary ? "wb" : "w");
+    if (!log->fp) {
+        perror(path);
+        exit(1);
+    }
+    setvbuf(log->fp, NULL, _IOFBF, 1 << 16);
+    log->path = strdup(path);
+    log->binary = binary;
+    log->num_fields = num_fields;
+    log->slots = slots ? slots : 1;
+    log->rows = malloc(log->slots * num_fields * sizeof(uint64_t));
+    if (!log->path || !log->rows) { perror("malloc"); exit(1); }
+    if (binary) {
+        IntervalHeader header = { INTERVAL_MAGIC, INTERVAL_VERSION, (uint32_t)num_fields };
+        if (fwrite(&header, sizeof(header), 1, log->fp) != 1 ||
+            fwrite(names, INTERVAL_NAME_SIZE, num_fields, log->fp) != num_fields) {
+            perror(path);
+            exit(1);
+        }
+    } else {
+        for (unsigned long i = 0; i < num_fields; i++)
+            fprintf(log->fp, i ? ",%s" : "%s", names[i]);
+        fputc('\n', log->fp);
+    }
+    if (pthread_create(&log->writer, NULL, write_rows, log) != 0) {
+        perror("pthread_create");
+        exit(1);
+    }
+    return log;
+}
+
+uint64_t *interval_slot(IntervalLog *log) {
+    unsigned long head = log->head;
+    if (head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) == log->slots) {
+        log->stalls++;
+        for (unsigned long polls = 0; head - __atomic_load_n(&log->tail, __ATOMIC_ACQUIRE) == log->slots; polls++)
+            pause_briefly(polls);
+    }
+    return log->rows + (head % log->slots) * log->num_fields;
+}
+
+void interval_commit(IntervalLog *log) {
+    __atomic_store_n(&log->head, log->head + 1, __ATOMIC_RELEASE);
+}
+
+void interval_close(IntervalLog *log) {
+    if (!log)
+        return;
+    __atomic_store_n(&log->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(log->writer, NULL);
+    if (fclose(log->fp) != 0) {
+        perror(log->path);
+        exit(1);
+    }
+    free(log->rows);
+    free(log->path);
+    free(log);
+}
+
+unsigned long interval_stalls(const IntervalLog *log) {
+    return log->stalls;
+}
@@ -0,0 +1,40 @@
+#ifndef INTERVAL_H
+#define INTERVAL_H
+
+#include <stdint.h>
+
+// Interval statistics log. The simulating thread copies each snapshot, a fixed row of
+// num_fields counters, into a preallocated ring of slots, and a writer thread formats the
+// rows and writes them out in the background. The simulating thread only waits when the
+// ring is full.
+//
+// CSV: a header line of the field names, then one line per row.
+// Binary: an IntervalHeader, num_fields names of INTERVAL_NAME_SIZE bytes, NUL padded,
+// then rows of num_fields uint64_t, all in host byte order. The row count is implied by
+// the file size.
+
+#define INTERVAL_MAGIC "CSIMIVL"
+#define INTERVAL_VERSION 1
+#define INTERVAL_NAME_SIZE 32
+
+typedef struct {
+    char magic[8];       // INTERVAL_MAGIC, NUL padded
+    uint32_t version;    // INTERVAL_VERSION
+    uint32_t num_fields;
+} IntervalHeader;
+
+typedef struct IntervalLog IntervalLog;
+
+// creates path (truncating it) and starts the writer; slots is the ring size in rows
+IntervalLog *interval_open(const char *path, int binary, const char (*names)[INTERVAL_NAME_SIZE],
+                           unsigned long num_fields, unsigned long slots);
+// the next row to fill, waiting for the writer while the ring is full
+uint64_t *interval_slot(IntervalLog *log);
+// hands the row from interval_slot to the writer
+void interval_commit(IntervalLog *log);
+// writes out the rows left, stops the writer and closes the file
+void interval_close(IntervalLog *log);
+// times interval_slot found the ring full
+unsigned long interval_stalls(const IntervalLog *log);
+
+#endif
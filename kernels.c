@@ -0,0 +1,138 @@
+#include "cache.h"
+
+// Access kernels specialized at compile time for one associativity and replacement
+// policy. Ways are matched with the level's SIMD match_ways routine; the victim loop
+// has a constant trip count and is fully unrolled, and the policy code is inlined
+// instead of going through update_policy/find_victim.
+// Set and tag come from set_ref(), which uses shift/mask indexing for power-of-two
+// geometries; select_kernels() only hands these out to such levels.
+
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
+ALWAYS_INLINE unsigned long kernel_probe(SimContext *ctx, CacheLevel *cache, SetRef *ref, const unsigned long assoc, const ReplacementPolicy policy) {
+    const unsigned int *tags = cache->tags + ref->index * assoc;
+    uint64_t hits = 0;
+    if (assoc < 4) { // select_way_match keeps these scalar, so skip the indirect call
+        for (unsigned long i = 0; i < assoc; i++)
+            hits |= (uint64_t)(tags[i] == ref->tag) << i;
+    } else {
+        hits = cache->match_ways(tags, assoc, ref->tag);
+    }
+    hits &= cache->valid[ref->index];
+    if (!hits)
+        return WAY_NONE;
+    unsigned long way = __builtin_ctzll(hits);
+    switch (policy) {
+        case POLICY_LRU:
+        case POLICY_BIP: // hits promote to MRU
+            cache->ages[ref->index * assoc + way] = ctx->current_time;
+            break;
+        case POLICY_PLRU_TREE:
+            cache->plru[ref->index] = plru_tree_touch(cache->plru[ref->index], way, assoc);
+            break;
+        case POLICY_PLRU_BIT:
+            cache->plru[ref->index] = plru_bit_touch(cache->plru[ref->index], way, assoc);
+            break;
+        default: // RANDOM; the RRIP and dueling policies have no kernels
+            break;
+    }
+    return way;
+}
+
+ALWAYS_INLINE void kernel_fill(SimContext *ctx, CacheLevel *cache, SetRef *ref, const unsigned long assoc, const ReplacementPolicy policy) {
+    unsigned long victim = 0;
+    if (policy == POLICY_RANDOM) {
+        victim = sim_rand(ctx) % assoc;
+    } else if (policy == POLICY_PLRU_TREE || policy == POLICY_PLRU_BIT) { // invalid ways first
+        uint64_t invalid = ~cache->valid[ref->index] & way_mask(assoc);
+        if (invalid)
+            victim = __builtin_ctzll(invalid);
+        else if (policy == POLICY_PLRU_TREE)
+            victim = plru_tree_victim(cache->plru[ref->index], assoc);
+        else
+            victim = plru_bit_victim(cache->plru[ref->index], assoc);
+    } else { // LRU and BIP both evict the oldest way, first one on ties
+        const unsigned long *ages = cache->ages + ref->index * assoc;
+        unsigned long min_time = ages[0];
+#pragma GCC unroll 16
+        for (unsigned long i = 1; i < assoc; i++) {
+            if (ages[i] < min_time) {
+                min_time = ages[i];
+                victim = i;
+            }
+        }
+    }
+    cache->evicted_valid = (cache->valid[ref->index] >> victim) & 1;
+    cache->evicted_tag = cache->tags[ref->index * assoc + victim];
+    cache->evicted_way = victim;
+    cache->tags[ref->index * assoc + victim] = ref->tag;
+    cache->valid[ref->index] |= (uint64_t)1 << victim;
+    if (policy == POLICY_PLRU_TREE)
+        cache->plru[ref->index] = plru_tree_touch(cache->plru[ref->index], victim, assoc);
+    else if (policy == POLICY_PLRU_BIT)
+        cache->plru[ref->index] = plru_bit_touch(cache->plru[ref->index], victim, assoc);
+    else if (policy == POLICY_BIP) // same insertion as update_policy_bip
+        cache->ages[ref->index * assoc + victim] = (sim_rand(ctx) % 32 == 0) ? ctx->current_time : 0;
+    else
+        cache->ages[ref->index * assoc + victim] = ctx->current_time;
+}
+
+#define DEFINE_KERNELS(POLICY, ASSOC)                                               \
+    static unsigned long probe_##POLICY##_##ASSOC(SimContext *ctx, CacheLevel *cache, SetRef *ref) { \
+        return kernel_probe(ctx, cache, ref, ASSOC, POLICY_##POLICY);                    \
+    }                                                                               \
+    static void fill_##POLICY##_##ASSOC(SimContext *ctx, CacheLevel *cache, SetRef *ref) {           \
+        kernel_fill(ctx, cache, ref, ASSOC, POLICY_##POLICY);                            \
+    }
+
+#define DEFINE_POLICY_KERNELS(POLICY) \
+    DEFINE_KERNELS(POLICY, 1)         \
+    DEFINE_KERNELS(POLICY, 2)         \
+    DEFINE_KERNELS(POLICY, 4)         \
+    DEFINE_KERNELS(POLICY, 8)         \
+    DEFINE_KERNELS(POLICY, 16)        \
+    DEFINE_KERNELS(POLICY, 32)        \
+    DEFINE_KERNELS(POLICY, 64)
+
+DEFINE_POLICY_KERNELS(LRU)
+DEFINE_POLICY_KERNELS(BIP)
+DEFINE_POLICY_KERNELS(RANDOM)
+DEFINE_POLICY_KERNELS(PLRU_TREE)
+DEFINE_POLICY_KERNELS(PLRU_BIT)
+
+typedef struct {
+    unsigned long (*probe)(SimContext *ctx, CacheLevel *cache, SetRef *ref);
+    void (*fill)(SimContext *ctx, CacheLevel *cache, SetRef *ref);
+    const char *name;
+} Kernel;
+
+#define KERNEL_ENTRY(POLICY, ASSOC) { probe_##POLICY##_##ASSOC, fill_##POLICY##_##ASSOC, #POLICY "/" #ASSOC "-way" }
+#define POLICY_ROW(POLICY) { KERNEL_ENTRY(POLICY, 1), KERNEL_ENTRY(POLICY, 2), KERNEL_ENTRY(POLICY, 4), \
+                             KERNEL_ENTRY(POLICY, 8), KERNEL_ENTRY(POLICY, 16), KERNEL_ENTRY(POLICY, 32), \
+                             KERNEL_ENTRY(POLICY, 64) }
+
+// indexed by ReplacementPolicy, then log2(associativity); the RRIP and dueling policies
+// after PLRU_BIT go through update_policy/find_victim in the generic pair
+static const Kernel kernels[][7] = {
+    [POLICY_LRU]       = POLICY_ROW(LRU),
+    [POLICY_BIP]       = POLICY_ROW(BIP),
+    [POLICY_RANDOM]    = POLICY_ROW(RANDOM),
+    [POLICY_PLRU_TREE] = POLICY_ROW(PLRU_TREE),
+    [POLICY_PLRU_BIT]  = POLICY_ROW(PLRU_BIT),
+};
+
+void select_kernels(CacheLevel *cache) {
+    cache->probe = probe_generic;
+    cache->fill = fill_generic;
+    cache->kernel_name = "generic";
+
+    unsigned long assoc = cache->associativity;
+    if (!cache->pow2_geometry || assoc == 0 || assoc > 64 || (assoc & (assoc - 1)) != 0)
+        return;
+    if ((unsigned long)cache->policy >= sizeof(kernels) / sizeof(kernels[0]))
+        return;
+    const Kernel *k = &kernels[cache->policy][__builtin_ctzl(assoc)];
+    cache->probe = k->probe;
+    cache->fill = k->fill;
+    cache->kernel_name = k->name;
+}
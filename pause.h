@@ -0,0 +1,22 @@
+#ifndef PAUSE_H
+#define PAUSE_H
+
+#include <sched.h>
+#include <time.h>
+
+// Backoff for threads that poll a lock-free ring: the async drainer and its producers,
+// and the interval writer and the simulating thread.
+
+#define IDLE_SPINS 64 // empty polls before a waiting thread starts sleeping
+
+// yields for the first polls of a wait, then sleeps between them
+static inline void pause_briefly(unsigned long polls) {
+    if (polls < IDLE_SPINS) {
+        sched_yield();
+        return;
+    }
+    struct timespec ts = {0, 20000};
+    nanosleep(&ts, NULL);
+}
+
+#endif
@@ -0,0 +1,316 @@
+#include "prefetch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RPT_ENTRIES 256
+#define RPT_CONFIDENT 2 // matching strides in a row before the entry predicts
+
+#define STREAMS 16
+#define STREAM_WINDOW 16 // lines from a tracker's last line that continue its stream
+
+#define SPP_PAGES 256
+#define SPP_SIGNATURE_BITS 12
+#define SPP_PATTERNS (1 << SPP_SIGNATURE_BITS)
+#define SPP_DELTAS 4
+#define SPP_COUNTER_MAX 15
+#define SPP_THRESHOLD 25 // percent
+
+typedef struct {
+    uint64_t key; // PC, or page without one
+    uint64_t last;
+    int64_t stride;
+    uint8_t confidence;
+    uint8_t used;
+} RptEntry;
+
+typedef struct {
+    uint64_t last; // line numbers
+    uint64_t head; // furthest line prefetched
+    uint64_t lru;
+    int dir;       // +1 / -1, 0 until a second miss
+    uint8_t confidence;
+    uint8_t used;
+} Stream;
+
+typedef struct {
+    uint64_t page;
+    uint16_t signature;
+    int16_t last_offset;
+    uint8_t used;
+} SppPage;
+
+typedef struct {
+    int16_t delta[SPP_DELTAS];
+    uint8_t count[SPP_DELTAS];
+    uint8_t total;
+} SppPattern;
+
+struct Prefetcher {
+    PrefetcherKind kind;
+    unsigned long degree;
+    unsigned long line_size;
+    unsigned long page_lines;
+    RptEntry *rpt;
+    Stream *streams;
+    uint64_t stream_clock;
+    SppPage *spp_pages;
+    SppPattern *spp_patterns;
+};
+
+static const char *const names[PREFETCHER_NUM_KINDS] = {
+    [PREFETCHER_NONE]      = "NONE",
+    [PREFETCHER_NEXT_LINE] = "NEXT_LINE",
+    [PREFETCHER_STRIDE]    = "STRIDE",
+    [PREFETCHER_STREAM]    = "STREAM",
+    [PREFETCHER_SPP]       = "SPP",
+};
+
+static const unsigned long default_degree[PREFETCHER_NUM_KINDS] = {
+    [PREFETCHER_NEXT_LINE] = 1,
+    [PREFETCHER_STRIDE]    = 2,
+    [PREFETCHER_STREAM]    = 4,
+    [PREFETCHER_SPP]       = 4,
+};
+
+PrefetcherKind prefetcher_kind(const char *name) {
+    for (int k = 0; k < PREFETCHER_NUM_KINDS; k++) {
+        if (strcmp(name, names[k]) == 0)
+            return k;
+    }
+    return PREFETCHER_NUM_KINDS;
+}
+
+const char *prefetcher_name(PrefetcherKind kind) {
+    return kind < PREFETCHER_NUM_KINDS ? names[kind] : "NONE";
+}
+
+static void *zalloc(size_t count, size_t size) {
+    void *p = calloc(count, size);
+    if (!p) { perror("calloc"); exit(1); }
+    return p;
+}
+
+Prefetcher *prefetcher_create(PrefetcherKind kind, unsigned long line_size, unsigned long degree) {
+    Prefetcher *pf = zalloc(1, sizeof(Prefetcher));
+    pf->kind = kind;
+    pf->degree = degree ? degree : default_degree[kind];
+    if (pf->degree > PREFETCH_MAX_DEGREE)
+        pf->degree = PREFETCH_MAX_DEGREE;
+    pf->line_size = line_size;
+    pf->page_lines = line_size < PREFETCH_PAGE ? PREFETCH_PAGE / line_size : 1;
+    if (kind == PREFETCHER_STRIDE)
+        pf->rpt = zalloc(RPT_ENTRIES, sizeof(RptEntry));
+    if (kind == PREFETCHER_STREAM)
+        pf->streams = zalloc(STREAMS, sizeof(Stream));
+    if (kind == PREFETCHER_SPP) {
+        pf->spp_pages = zalloc(SPP_PAGES, sizeof(SppPage));
+        pf->spp_patterns = zalloc(SPP_PATTERNS, sizeof(SppPattern));
+    }
+    return pf;
+}
+
+void prefetcher_destroy(Prefetcher *pf) {
+    if (!pf)
+        return;
+    free(pf->rpt);
+    free(pf->streams);
+    free(pf->spp_pages);
+    free(pf->spp_patterns);
+    free(pf);
+}
+
+void prefetcher_reset(Prefetcher *pf) {
+    if (pf->rpt)
+        memset(pf->rpt, 0, RPT_ENTRIES * sizeof(RptEntry));
+    if (pf->streams)
+        memset(pf->streams, 0, STREAMS * sizeof(Stream));
+    if (pf->spp_pages) {
+        memset(pf->spp_pages, 0, SPP_PAGES * sizeof(SppPage));
+        memset(pf->spp_patterns, 0, SPP_PATTERNS * sizeof(SppPattern));
+    }
+    pf->stream_clock = 0;
+}
+
+PrefetcherKind prefetcher_get_kind(const Prefetcher *pf) {
+    return pf->kind;
+}
+
+unsigned long prefetcher_degree(const Prefetcher *pf) {
+    return pf->degree;
+}
+
+static inline unsigned long table_index(uint64_t key, unsigned long bits) {
+    return (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+}
+
+static unsigned long next_line(const Prefetcher *pf, uint64_t line, PrefetchEvent event, uint64_t *lines) {
+    if (event == PREFETCH_HIT)
+        return 0;
+    for (unsigned long k = 1; k <= pf->degree; k++)
+        lines[k - 1] = (line + k) * pf->line_size;
+    return pf->degree;
+}
+
+static unsigned long stride(Prefetcher *pf, uint64_t addr, uint64_t pc, uint64_t *lines) {
+    uint64_t key = pc ? pc : addr / PREFETCH_PAGE;
+    RptEntry *e = &pf->rpt[table_index(key, 8)];
+    if (!e->used || e->key != key) {
+        e->used = 1;
+        e->key = key;
+        e->last = addr;
+        e->stride = 0;
+        e->confidence = 0;
+        return 0;
+    }
+    int64_t seen = (int64_t)(addr - e->last);
+    if (seen == 0)
+        return 0;
+    if (seen == e->stride) {
+        if (e->confidence < 3)
+            e->confidence++;
+    } else if (e->confidence > 0) {
+        e->confidence--;
+    } else {
+        e->stride = seen;
+    }
+    e->last = addr;
+    if (e->confidence < RPT_CONFIDENT)
+        return 0;
+    // strides within a line step a line at a time
+    int64_t step = e->stride;
+    if (step > 0 && (uint64_t)step < pf->line_size)
+        step = pf->line_size;
+    else if (step < 0 && (uint64_t)-step < pf->line_size)
+        step = -(int64_t)pf->line_size;
+    for (unsigned long k = 1; k <= pf->degree; k++) {
+        uint64_t target = addr + (uint64_t)(step * (int64_t)k);
+        lines[k - 1] = target / pf->line_size * pf->line_size;
+    }
+    return pf->degree;
+}
+
+static unsigned long stream(Prefetcher *pf, uint64_t line, PrefetchEvent event, uint64_t *lines) {
+    if (event == PREFETCH_HIT)
+        return 0;
+    Stream *s = NULL, *victim = NULL; // a free tracker, else the least recently advanced
+    for (unsigned long i = 0; i < STREAMS && !s; i++) {
+        Stream *t = &pf->streams[i];
+        uint64_t distance = line > t->last ? line - t->last : t->last - line;
+        if (t->used && distance && distance <= STREAM_WINDOW)
+            s = t;
+        else if (!victim || (victim->used && (!t->used || t->lru < victim->lru)))
+            victim = t;
+    }
+    if (!s) {
+        if (event != PREFETCH_MISS)
+            return 0;
+        memset(victim, 0, sizeof(*victim));
+        victim->used = 1;
+        victim->last = victim->head = line;
+        victim->lru = ++pf->stream_clock;
+        return 0;
+    }
+    int dir = line > s->last ? 1 : -1;
+    if (s->dir != dir) {
+        s->dir = dir;
+        s->confidence = 1;
+        s->head = line;
+    } else if (s->confidence < 3) {
+        s->confidence++;
+    }
+    s->last = line;
+    s->lru = ++pf->stream_clock;
+    if (s->confidence < 2)
+        return 0;
+    // stay degree lines ahead, issuing only the lines beyond the head
+    uint64_t target = line + (uint64_t)(dir * (int64_t)pf->degree);
+    uint64_t from = dir > 0 ? (s->head > line ? s->head : line) : (s->head < line ? s->head : line);
+    unsigned long n = 0;
+    for (uint64_t l = from + dir; n < PREFETCH_MAX_DEGREE && (dir > 0 ? l <= target : l >= target); l += dir)
+        lines[n++] = l * pf->line_size;
+    if (n)
+        s->head = target;
+    return n;
+}
+
+static inline uint16_t spp_next_signature(uint16_t signature, int delta) {
+    unsigned long encoded = delta < 0 ? (1 << 6) | (-delta & 0x3F) : (delta & 0x3F);
+    return ((signature << 3) ^ encoded) & (SPP_PATTERNS - 1);
+}
+
+static void spp_learn(SppPattern *p, int delta) {
+    unsigned long slot = 0;
+    for (unsigned long i = 0; i < SPP_DELTAS; i++) {
+        if (p->count[i] && p->delta[i] == delta) {
+            slot = i;
+            goto found;
+        }
+        if (p->count[i] < p->count[slot])
+            slot = i;
+    }
+    p->delta[slot] = delta;
+    p->count[slot] = 0;
+found:
+    p->count[slot]++;
+    p->total++;
+    if (p->count[slot] >= SPP_COUNTER_MAX || p->total >= SPP_COUNTER_MAX) {
+        p->total = 0;
+        for (unsigned long i = 0; i < SPP_DELTAS; i++) {
+            p->count[i] /= 2;
+            p->total += p->count[i];
+        }
+    }
+}
+
+static unsigned long spp(Prefetcher *pf, uint64_t addr, uint64_t *lines) {
+    uint64_t page = addr / PREFETCH_PAGE;
+    int offset = (int)(addr % PREFETCH_PAGE / pf->line_size);
+    SppPage *e = &pf->spp_pages[table_index(page, 8)];
+    if (!e->used || e->page != page) {
+        e->used = 1;
+        e->page = page;
+        e->signature = 0;
+        e->last_offset = offset;
+        return 0;
+    }
+    int delta = offset - e->last_offset;
+    if (delta == 0)
+        return 0;
+    spp_learn(&pf->spp_patterns[e->signature], delta);
+    e->signature = spp_next_signature(e->signature, delta);
+    e->last_offset = offset;
+
+    // lookahead along the most likely deltas
+    unsigned long n = 0, confidence = 100;
+    uint16_t signature = e->signature;
+    while (n < pf->degree) {
+        const SppPattern *p = &pf->spp_patterns[signature];
+        if (!p->total)
+            break;
+        unsigned long best = 0;
+        for (unsigned long i = 1; i < SPP_DELTAS; i++) {
+            if (p->count[i] > p->count[best])
+                best = i;
+        }
+        confidence = confidence * p->count[best] / p->total;
+        if (confidence < SPP_THRESHOLD)
+            break;
+        offset += p->delta[best];
+        if (offset < 0 || (unsigned long)offset >= pf->page_lines)
+            break;
+        lines[n++] = page * PREFETCH_PAGE + (uint64_t)offset * pf->line_size;
+        signature = spp_next_signature(signature, p->delta[best]);
+    }
+    return n;
+}
+
+unsigned long prefetcher_train(Prefetcher *pf, uint64_t addr, uint64_t pc, PrefetchEvent event, uint64_t *lines) {
+    switch (pf->kind) {
+        case PREFETCHER_NEXT_LINE: return next_line(pf, addr / pf->line_size, event, lines);
+        case PREFETCHER_STRIDE:    return stride(pf, addr, pc, lines);
+        case PREFETCHER_STREAM:    return stream(pf, addr / pf->line_size, event, lines);
+        case PREFETCHER_SPP:       return spp(pf, addr, lines);
+        default:                   return 0;
+    }
+}
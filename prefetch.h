@@ -0,0 +1,56 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+
+// Hardware prefetchers attached to a cache level (L<n>_PREFETCHER). A prefetcher sees the
+// demand accesses that reach its level, by physical address, and proposes lines to bring
+// into the level; cache.c drops those outside the trigger's 4 KB page or already present,
+// and fills the rest through the level's fill path.
+//
+//   NEXT_LINE  the `degree` lines after a miss or a first hit on a prefetched line
+//   STRIDE     reference prediction table (Chen & Baer): per PC, or per page when the
+//              access has no PC, the last address and a stride confirmed twice in a row
+//   STREAM     16 stream trackers: misses close to a tracker's last line set a direction,
+//              and a confirmed stream stays `degree` lines ahead of the demand accesses
+//   SPP        signature path prefetching: per page, a signature of the last few line
+//              deltas indexes a table of the deltas that followed it; lookahead follows the
+//              most likely delta while the path's confidence stays above 25%
+
+#define PREFETCH_PAGE 4096
+#define PREFETCH_MAX_DEGREE 16
+
+typedef enum {
+    PREFETCHER_NONE,
+    PREFETCHER_NEXT_LINE,
+    PREFETCHER_STRIDE,
+    PREFETCHER_STREAM,
+    PREFETCHER_SPP,
+    PREFETCHER_NUM_KINDS
+} PrefetcherKind;
+
+// what the demand access found in the level
+typedef enum {
+    PREFETCH_MISS,
+    PREFETCH_HIT,
+    PREFETCH_USEFUL_HIT // the first demand hit on a line a prefetch brought in
+} PrefetchEvent;
+
+typedef struct Prefetcher Prefetcher;
+
+// PREFETCHER_NUM_KINDS for an unknown name
+PrefetcherKind prefetcher_kind(const char *name);
+const char *prefetcher_name(PrefetcherKind kind);
+
+// degree 0 picks the kind's default, larger ones are capped at PREFETCH_MAX_DEGREE
+Prefetcher *prefetcher_create(PrefetcherKind kind, unsigned long line_size, unsigned long degree);
+void prefetcher_destroy(Prefetcher *pf);
+void prefetcher_reset(Prefetcher *pf);
+PrefetcherKind prefetcher_get_kind(const Prefetcher *pf);
+unsigned long prefetcher_degree(const Prefetcher *pf);
+
+// Trains on one demand access to addr (pc 0 when unknown) and writes up to
+// PREFETCH_MAX_DEGREE line addresses to prefetch into lines, returning how many.
+unsigned long prefetcher_train(Prefetcher *pf, uint64_t addr, uint64_t pc, PrefetchEvent event, uint64_t *lines);
+
+#endif
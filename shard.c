@@ -0,0 +1,329 @@
+#include "shard.h"
+#include <pthread.h>
+
+#define SHARD_BATCH 65536       // records partitioned per round
+#define SHARD_ACCESS_BATCH 1024 // accesses handed to sim_access_batch at once
+#define PAGE_OFFSET_BITS 12
+#define NO_SHARED_BITS "no set-index bits are shared by every level"
+
+typedef struct {
+    struct ShardSim *sim;
+    unsigned long id;
+} ShardWorker;
+
+struct ShardSim {
+    CacheConfig config;
+    unsigned long num_shards;  // power of two
+    unsigned long shard_shift; // lowest shard bit
+    unsigned long shard_bits;
+    SimContext *shards[SHARD_MAX];
+    SimContext *merged;
+
+    // current round: chunk w is records [w * chunk, (w + 1) * chunk), and its record
+    // indices are grouped by shard in order[w * chunk ...], shard s from starts[w][s]
+    const TraceRecord *records;
+    unsigned long count;
+    unsigned long chunk;
+    uint32_t *order;
+    unsigned long (*starts)[SHARD_MAX + 1];
+
+    ShardWorker workers[SHARD_MAX];
+    pthread_t threads[SHARD_MAX];
+    pthread_barrier_t start, partitioned, done;
+    int stop;
+};
+
+static int is_pow2(unsigned long x) {
+    return x != 0 && (x & (x - 1)) == 0;
+}
+
+static unsigned long log2_pow2(unsigned long x) {
+    return __builtin_ctzl(x);
+}
+
+// Set-index bits [*lo, *hi) shared by every enabled level, or a reason they cannot be used.
+static const char *common_index_bits(const CacheConfig *config, unsigned long *lo, unsigned long *hi) {
+    if (config->cores > 1)
+        return "the cores of a multi-core hierarchy (CORES) share one directory";
+    if (config->sample_period)
+        return "SMARTS sampling (SAMPLE_PERIOD) counts accesses across the whole stream";
+    if (config->issue_window)
+        return "the timing model (ISSUE_WINDOW) overlaps accesses of every shard";
+    if (config->use_dram)
+        return "the DRAM model (MEM_MODEL=DRAM) maps full physical addresses to banks";
+    if (config->use_tlb)
+        return "the TLBs (USE_TLB) translate the accesses of every shard";
+    if (config->interval_accesses || config->interval_cycles)
+        return "interval statistics (INTERVAL_ACCESSES, INTERVAL_CYCLES) follow one context's counters";
+    *lo = 0;
+    *hi = 64;
+    int any = 0;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        const LevelConfig *lc = &config->levels[n];
+        if (!lc->use)
+            continue;
+        unsigned long sets = lc->size / (lc->line * lc->assoc);
+        if (!is_pow2(lc->line) || !is_pow2(sets))
+            return "a level has a non-power-of-two line size or set count";
+        if (lc->sample_sets && lc->sample_sets < sets)
+            return "set sampling (L<n>_SAMPLE_SETS) selects sets by their full index";
+        ReplacementPolicy policy = parse_policy(lc->policy_str);
+        if (policy == POLICY_DIP || policy == POLICY_DRRIP || policy == POLICY_SHIP)
+            return "a level's policy (DIP, DRRIP, SHIP) learns from all of its sets";
+        if (strcmp(lc->prefetcher_str, "NONE") != 0)
+            return "a prefetcher (L<n>_PREFETCHER) fills lines of other shards";
+        unsigned long line_shift = log2_pow2(lc->line);
+        if (line_shift > *lo)
+            *lo = line_shift;
+        if (line_shift + log2_pow2(sets) < *hi)
+            *hi = line_shift + log2_pow2(sets);
+        if (n == 0 && PAGE_OFFSET_BITS < *hi) // L1 is indexed by vaddr
+            *hi = PAGE_OFFSET_BITS;
+        any = 1;
+    }
+    if (!any)
+        return "no cache levels";
+    if (*hi <= *lo)
+        return NO_SHARED_BITS;
+    return NULL;
+}
+
+// addr without the shard bits
+static inline unsigned long squeeze(const ShardSim *sim, unsigned long addr) {
+    unsigned long low = addr & ((1UL << sim->shard_shift) - 1);
+    return ((addr >> (sim->shard_shift + sim->shard_bits)) << sim->shard_shift) | low;
+}
+
+static inline unsigned long shard_of(const ShardSim *sim, unsigned long paddr) {
+    return (paddr >> sim->shard_shift) & (sim->num_shards - 1);
+}
+
+// groups the record indices of chunk w by shard, keeping trace order within each group
+static void partition_chunk(ShardSim *sim, unsigned long w) {
+    unsigned long begin = w * sim->chunk, end = begin + sim->chunk;
+    if (end > sim->count)
+        end = sim->count;
+    if (begin > end)
+        begin = end;
+    unsigned long *starts = sim->starts[w];
+    unsigned long counts[SHARD_MAX] = {0};
+    for (unsigned long i = begin; i < end; i++)
+        counts[shard_of(sim, sim->records[i].paddr)]++;
+    unsigned long next[SHARD_MAX];
+    starts[0] = begin;
+    for (unsigned long s = 0; s < sim->num_shards; s++) {
+        next[s] = starts[s];
+        starts[s + 1] = starts[s] + counts[s];
+    }
+    for (unsigned long i = begin; i < end; i++)
+        sim->order[next[shard_of(sim, sim->records[i].paddr)]++] = i;
+}
+
+// replays shard s's records of every chunk, in trace order
+static void simulate_shard(ShardSim *sim, unsigned long s) {
+    SimContext *ctx = sim->shards[s];
+    MemoryAccess batch[SHARD_ACCESS_BATCH];
+    unsigned long pending = 0;
+    for (unsigned long w = 0; w < sim->num_shards; w++) {
+        for (unsigned long j = sim->starts[w][s]; j < sim->starts[w][s + 1]; j++) {
+            const TraceRecord *r = &sim->records[sim->order[j]];
+            if (r->op == TRACE_ACCESS) {
+                batch[pending].vaddr = squeeze(sim, r->vaddr);
+                batch[pending].paddr = squeeze(sim, r->paddr);
+                batch[pending].access_type = r->access_type;
+                batch[pending].core = r->core;
+                if (++pending == SHARD_ACCESS_BATCH) {
+                    sim_access_batch(ctx, batch, pending, NULL);
+                    pending = 0;
+                }
+                continue;
+            }
+            if (pending) {
+                sim_access_batch(ctx, batch, pending, NULL);
+                pending = 0;
+            }
+            TraceRecord op = *r;
+            op.vaddr = squeeze(sim, r->vaddr);
+            op.paddr = squeeze(sim, r->paddr);
+            sim_replay_op(ctx, &op);
+        }
+    }
+    if (pending)
+        sim_access_batch(ctx, batch, pending, NULL);
+}
+
+static void *shard_worker(void *arg) {
+    ShardWorker *worker = arg;
+    ShardSim *sim = worker->sim;
+    for (;;) {
+        pthread_barrier_wait(&sim->start);
+        if (sim->stop)
+            break;
+        partition_chunk(sim, worker->id);
+        pthread_barrier_wait(&sim->partitioned);
+        simulate_shard(sim, worker->id);
+        pthread_barrier_wait(&sim->done);
+    }
+    return NULL;
+}
+
+ShardSim *shard_create(const CacheConfig *config, unsigned long threads, const char **reason) {
+    ShardSim *sim = calloc(1, sizeof(ShardSim));
+    if (!sim) { perror("calloc"); exit(1); }
+    sim->config = *config;
+    if (reason)
+        *reason = NULL;
+
+    unsigned long lo = 0, hi = 0, shards = 1;
+    while (shards * 2 <= threads && shards * 2 <= SHARD_MAX)
+        shards *= 2;
+    if (shards > 1) {
+        const char *why = common_index_bits(config, &lo, &hi);
+        if (why) {
+            if (reason)
+                *reason = why;
+            shards = 1;
+        }
+        while (shards > 1 && log2_pow2(shards) > hi - lo)
+            shards /= 2;
+        if (shards == 1 && reason && !*reason) // more than one was asked for
+            *reason = NO_SHARED_BITS;
+    }
+    sim->num_shards = shards;
+    sim->shard_shift = lo;
+    sim->shard_bits = log2_pow2(shards);
+    if (shards == 1) {
+        sim->shards[0] = sim_create_from_config(config);
+        return sim;
+    }
+
+    // every level keeps 1/shards of its sets
+    CacheConfig shard_config = *config;
+    for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+        LevelConfig *lc = &shard_config.levels[n];
+        if (lc->use)
+            lc->size = lc->size / (lc->line * lc->assoc) / shards * lc->line * lc->assoc;
+    }
+    for (unsigned long s = 0; s < shards; s++) {
+        shard_config.seed = config->seed + s;
+        sim->shards[s] = sim_create_from_config(&shard_config);
+    }
+
+    sim->order = malloc(SHARD_BATCH * sizeof(uint32_t));
+    sim->starts = malloc(shards * sizeof(*sim->starts));
+    if (!sim->order || !sim->starts) { perror("malloc"); exit(1); }
+    pthread_barrier_init(&sim->start, NULL, shards);
+    pthread_barrier_init(&sim->partitioned, NULL, shards);
+    pthread_barrier_init(&sim->done, NULL, shards);
+    for (unsigned long s = 1; s < shards; s++) { // the caller works as shard 0
+        sim->workers[s].sim = sim;
+        sim->workers[s].id = s;
+        if (pthread_create(&sim->threads[s], NULL, shard_worker, &sim->workers[s]) != 0) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    return sim;
+}
+
+unsigned long shard_count(const ShardSim *sim) {
+    return sim->num_shards;
+}
+
+void shard_start(ShardSim *sim) {
+    for (unsigned long s = 0; s < sim->num_shards; s++)
+        sim_start(sim->shards[s]);
+}
+
+void shard_stop(ShardSim *sim) {
+    for (unsigned long s = 0; s < sim->num_shards; s++)
+        sim_stop(sim->shards[s]);
+}
+
+static void shard_round(ShardSim *sim, const TraceRecord *records, unsigned long count) {
+    sim->records = records;
+    sim->count = count;
+    sim->chunk = (count + sim->num_shards - 1) / sim->num_shards;
+    pthread_barrier_wait(&sim->start);
+    partition_chunk(sim, 0);
+    pthread_barrier_wait(&sim->partitioned);
+    simulate_shard(sim, 0);
+    pthread_barrier_wait(&sim->done);
+}
+
+void shard_replay(ShardSim *sim, const TraceRecord *records, unsigned long count) {
+    if (sim->num_shards == 1) {
+        sim_replay(sim->shards[0], records, count);
+        return;
+    }
+    // rounds of up to SHARD_BATCH records, cut at invalidate-alls, which go to every shard
+    unsigned long begin = 0;
+    while (begin < count) {
+        unsigned long end = begin;
+        while (end < count && end - begin < SHARD_BATCH && records[end].op != TRACE_INVALIDATE_ALL)
+            end++;
+        if (end > begin)
+            shard_round(sim, records + begin, end - begin);
+        if (end < count && records[end].op == TRACE_INVALIDATE_ALL) {
+            for (unsigned long s = 0; s < sim->num_shards; s++)
+                sim_invalidate_all(sim->shards[s]);
+            end++;
+        }
+        begin = end;
+    }
+}
+
+SimContext *shard_merge(ShardSim *sim) {
+    if (sim->num_shards == 1)
+        return sim->shards[0];
+    if (!sim->merged)
+        sim->merged = sim_create_from_config(&sim->config);
+    SimContext *merged = sim->merged;
+    sim_start(merged); // zeroes the counters
+    sim_stop(merged);
+    for (unsigned long s = 0; s < sim->num_shards; s++) {
+        const SimContext *ctx = sim->shards[s];
+        merged->mem_accesses += ctx->mem_accesses;
+        merged->instr_accesses += ctx->instr_accesses;
+        merged->data_accesses += ctx->data_accesses;
+        merged->total_latency_instr += ctx->total_latency_instr;
+        merged->total_latency_data += ctx->total_latency_data;
+        merged->mem_read_bytes += ctx->mem_read_bytes;
+        merged->mem_write_bytes += ctx->mem_write_bytes;
+        merged->bw_cycles += ctx->bw_cycles; // each shard keeps its own intervals, they are not merged
+        for (unsigned long n = 0; n < MAX_CACHE_LEVELS; n++) {
+            for (unsigned long side = 0; side < 2; side++) {
+                CacheLevel *cache = merged->levels[n][side];
+                if (!cache || (side == 1 && cache == merged->levels[n][0]))
+                    continue;
+                cache->accesses += ctx->levels[n][side]->accesses;
+                cache->hits += ctx->levels[n][side]->hits;
+                cache->writebacks += ctx->levels[n][side]->writebacks;
+                cache->write_throughs += ctx->levels[n][side]->write_throughs;
+                cache->inclusion_victims += ctx->levels[n][side]->inclusion_victims;
+                cache->victims_taken += ctx->levels[n][side]->victims_taken;
+            }
+        }
+    }
+    return merged;
+}
+
+void shard_destroy(ShardSim *sim) {
+    if (!sim)
+        return;
+    if (sim->num_shards > 1) {
+        sim->stop = 1;
+        pthread_barrier_wait(&sim->start);
+        for (unsigned long s = 1; s < sim->num_shards; s++)
+            pthread_join(sim->threads[s], NULL);
+        pthread_barrier_destroy(&sim->start);
+        pthread_barrier_destroy(&sim->partitioned);
+        pthread_barrier_destroy(&sim->done);
+    }
+    for (unsigned long s = 0; s < sim->num_shards; s++)
+        sim_destroy(sim->shards[s]);
+    sim_destroy(sim->merged);
+    free(sim->order);
+    free(sim->starts);
+    free(sim);
+}
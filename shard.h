@@ -0,0 +1,40 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "trace.h"
+
+// Set-sharded parallel simulation of one hierarchy.
+//
+// Address bits that lie inside the set index of every level split the hierarchy into
+// independent shards: addresses that differ in those bits never share a set at any level,
+// so neither their lookups nor their fill cascades interact. Each shard is a SimContext
+// with 1/K of every level's sets, owned by one thread. Addresses have the shard bits
+// squeezed out before they reach it, which maps the shard's sets one to one onto the
+// original ones and leaves tags unchanged. LRU, PLRU and SRRIP results are identical to a
+// serial run; BIP, BRRIP and RANDOM draw from a per-shard RNG, so they agree statistically.
+// DIP, DRRIP and SHiP learn from every set of a level and are simulated serially.
+//
+// Records are routed by paddr. L1 is looked up by vaddr, so while it is enabled the shard
+// bits stay below the 4 KB page offset, where vaddr and paddr agree.
+//
+// Each round, every thread partitions one chunk of the batch by shard, then simulates its
+// own shard's records from all chunks in trace order.
+
+#define SHARD_MAX 64
+
+typedef struct ShardSim ShardSim;
+
+// Up to `threads` shards (rounded down to a power of two). A configuration that cannot
+// be partitioned falls back to a single serial context; *reason then says why.
+ShardSim *shard_create(const CacheConfig *config, unsigned long threads, const char **reason);
+unsigned long shard_count(const ShardSim *sim);
+void shard_start(ShardSim *sim);
+void shard_replay(ShardSim *sim, const TraceRecord *records, unsigned long count);
+void shard_stop(ShardSim *sim);
+
+// a context holding the summed statistics of all shards, for sim_report/sim_get_stats;
+// owned by sim and refreshed on every call
+SimContext *shard_merge(ShardSim *sim);
+void shard_destroy(ShardSim *sim);
+
+#endif
@@ -0,0 +1,244 @@
+#include "stackdist.h"
+
+#define STACK_EMPTY UINT64_MAX
+#define MIN_STACK_CAPACITY 8
+
+enum { LEVEL_TIME, SET_TIME }; // index into LineEntry.time
+
+static inline uint64_t hash_line(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static void grow_lines(StackDist *sd) {
+    LineEntry *old = sd->lines;
+    unsigned long old_capacity = sd->lines_capacity;
+    sd->lines_capacity = old_capacity ? 2 * old_capacity : 1024;
+    sd->lines = calloc(sd->lines_capacity, sizeof(LineEntry));
+    if (!sd->lines) { perror("calloc"); exit(1); }
+    for (unsigned long i = 0; i < old_capacity; i++) {
+        if (!old[i].key)
+            continue;
+        unsigned long mask = sd->lines_capacity - 1, slot = hash_line(old[i].key) & mask;
+        while (sd->lines[slot].key)
+            slot = (slot + 1) & mask;
+        sd->lines[slot] = old[i];
+    }
+    free(old);
+}
+
+// entry for line, inserted if new (*is_new set); may grow the table
+static LineEntry *lookup_line(StackDist *sd, uint64_t line, int *is_new) {
+    if (2 * (sd->lines_count + 1) > sd->lines_capacity)
+        grow_lines(sd);
+    uint64_t key = line + 1;
+    unsigned long mask = sd->lines_capacity - 1, slot = hash_line(key) & mask;
+    while (sd->lines[slot].key && sd->lines[slot].key != key)
+        slot = (slot + 1) & mask;
+    *is_new = !sd->lines[slot].key;
+    if (*is_new) {
+        sd->lines[slot].key = key;
+        sd->lines_count++;
+    }
+    return &sd->lines[slot];
+}
+
+// entry of line, or NULL if it was never referenced; never grows the table
+static LineEntry *probe_line(const StackDist *sd, uint64_t line) {
+    if (!sd->lines_capacity)
+        return NULL;
+    uint64_t key = line + 1;
+    unsigned long mask = sd->lines_capacity - 1, slot = hash_line(key) & mask;
+    while (sd->lines[slot].key && sd->lines[slot].key != key)
+        slot = (slot + 1) & mask;
+    return sd->lines[slot].key ? &sd->lines[slot] : NULL;
+}
+
+// entry of a line known to be in the table, never grows it
+static LineEntry *find_line(StackDist *sd, uint64_t line) {
+    uint64_t key = line + 1;
+    unsigned long mask = sd->lines_capacity - 1, slot = hash_line(key) & mask;
+    while (sd->lines[slot].key != key)
+        slot = (slot + 1) & mask;
+    return &sd->lines[slot];
+}
+
+
+static inline void tree_add(ReuseStack *stack, unsigned long time, int32_t delta) {
+    for (unsigned long i = time + 1; i <= stack->capacity; i += i & -i)
+        stack->tree[i] += delta;
+}
+
+// marks at times [0, time)
+static inline unsigned long tree_prefix(const ReuseStack *stack, unsigned long time) {
+    unsigned long sum = 0;
+    for (unsigned long i = time; i > 0; i -= i & -i)
+        sum += stack->tree[i];
+    return sum;
+}
+
+// Renumbers the live lines 0..live-1 in reference order into arrays sized for at least
+// twice as many, and points their hash entries at the new times.
+static void compact_stack(StackDist *sd, ReuseStack *stack, int which) {
+    unsigned long capacity = 2 * stack->live > MIN_STACK_CAPACITY ? 2 * stack->live : MIN_STACK_CAPACITY;
+    uint64_t *owner = malloc(capacity * sizeof(uint64_t));
+    uint32_t *tree = calloc(capacity + 1, sizeof(uint32_t));
+    if (!owner || !tree) { perror("malloc"); exit(1); }
+
+    unsigned long time = 0;
+    for (unsigned long t = 0; t < stack->clock; t++) {
+        if (stack->owner[t] == STACK_EMPTY)
+            continue;
+        find_line(sd, stack->owner[t])->time[which] = time;
+        owner[time++] = stack->owner[t];
+    }
+    // linear-time Fenwick build over the all-ones prefix
+    for (unsigned long i = 1; i <= capacity; i++) {
+        tree[i] += i <= time;
+        unsigned long parent = i + (i & -i);
+        if (parent <= capacity)
+            tree[parent] += tree[i];
+    }
+
+    free(stack->owner);
+    free(stack->tree);
+    stack->owner = owner;
+    stack->tree = tree;
+    stack->capacity = capacity;
+    stack->clock = time;
+}
+
+// pushes line as the most recent reference, returns its time
+static inline unsigned long stack_push(StackDist *sd, ReuseStack *stack, int which, uint64_t line) {
+    if (stack->clock == stack->capacity)
+        compact_stack(sd, stack, which);
+    unsigned long time = stack->clock++;
+    stack->owner[time] = line;
+    tree_add(stack, time, 1);
+    stack->live++;
+    return time;
+}
+
+// distance of the line last referenced at time
+static inline unsigned long stack_distance(const ReuseStack *stack, unsigned long time) {
+    return stack->live - tree_prefix(stack, time + 1);
+}
+
+// distance of the line last referenced at time, which is then removed from the stack
+static inline unsigned long stack_pop(ReuseStack *stack, unsigned long time) {
+    unsigned long distance = stack_distance(stack, time);
+    tree_add(stack, time, -1);
+    stack->owner[time] = STACK_EMPTY;
+    stack->live--;
+    return distance;
+}
+
+static inline void hist_add(DistHistogram *hist, unsigned long distance) {
+    if (distance >= hist->length) {
+        unsigned long length = hist->length ? hist->length : 64;
+        while (length <= distance)
+            length *= 2;
+        hist->counts = realloc(hist->counts, length * sizeof(unsigned long));
+        if (!hist->counts) { perror("realloc"); exit(1); }
+        memset(hist->counts + hist->length, 0, (length - hist->length) * sizeof(unsigned long));
+        hist->length = length;
+    }
+    hist->counts[distance]++;
+}
+
+
+StackDist *stackdist_create(unsigned long num_sets) {
+    StackDist *sd = calloc(1, sizeof(StackDist));
+    if (!sd) { perror("calloc"); exit(1); }
+    sd->num_sets = num_sets;
+    sd->sets = calloc(num_sets, sizeof(ReuseStack));
+    if (!sd->sets) { perror("calloc"); exit(1); }
+    return sd;
+}
+
+void stackdist_free(StackDist *sd) {
+    if (!sd)
+        return;
+    for (unsigned long i = 0; i < sd->num_sets; i++) {
+        free(sd->sets[i].tree);
+        free(sd->sets[i].owner);
+    }
+    free(sd->sets);
+    free(sd->level.tree);
+    free(sd->level.owner);
+    free(sd->lines);
+    free(sd->level_hist.counts);
+    free(sd->set_hist.counts);
+    free(sd);
+}
+
+unsigned long stackdist_access(StackDist *sd, uint64_t line, unsigned long set) {
+    sd->accesses++;
+    int is_new;
+    LineEntry *entry = lookup_line(sd, line, &is_new);
+    ReuseStack *set_stack = &sd->sets[set];
+    unsigned long set_distance = STACKDIST_COLD;
+    if (is_new) {
+        sd->cold++;
+    } else {
+        hist_add(&sd->level_hist, stack_pop(&sd->level, entry->time[LEVEL_TIME]));
+        set_distance = stack_pop(set_stack, entry->time[SET_TIME]);
+        hist_add(&sd->set_hist, set_distance);
+    }
+    // a compaction inside stack_push only renumbers lines still in the stacks, and this
+    // line has just been popped, so entry stays valid
+    entry->time[LEVEL_TIME] = stack_push(sd, &sd->level, LEVEL_TIME, line);
+    entry->time[SET_TIME] = stack_push(sd, set_stack, SET_TIME, line);
+    return set_distance;
+}
+
+unsigned long stackdist_lookup(StackDist *sd, uint64_t line, unsigned long set) {
+    sd->accesses++;
+    const LineEntry *entry = probe_line(sd, line);
+    if (!entry) {
+        sd->cold++;
+        return STACKDIST_COLD;
+    }
+    hist_add(&sd->level_hist, stack_distance(&sd->level, entry->time[LEVEL_TIME]));
+    unsigned long set_distance = stack_distance(&sd->sets[set], entry->time[SET_TIME]);
+    hist_add(&sd->set_hist, set_distance);
+    return set_distance;
+}
+
+void stackdist_touch(StackDist *sd, uint64_t line, unsigned long set) {
+    int is_new;
+    LineEntry *entry = lookup_line(sd, line, &is_new);
+    if (!is_new) {
+        stack_pop(&sd->level, entry->time[LEVEL_TIME]);
+        stack_pop(&sd->sets[set], entry->time[SET_TIME]);
+    }
+    entry->time[LEVEL_TIME] = stack_push(sd, &sd->level, LEVEL_TIME, line);
+    entry->time[SET_TIME] = stack_push(sd, &sd->sets[set], SET_TIME, line);
+}
+
+static void hist_finish(DistHistogram *hist) {
+    for (unsigned long d = hist->length; d-- > 1;)
+        hist->counts[d - 1] += hist->counts[d];
+}
+
+void stackdist_finish(StackDist *sd) {
+    if (sd->finished)
+        return;
+    hist_finish(&sd->level_hist);
+    hist_finish(&sd->set_hist);
+    sd->finished = 1;
+}
+
+static unsigned long misses_at(const StackDist *sd, const DistHistogram *hist, unsigned long size) {
+    return sd->cold + (size < hist->length ? hist->counts[size] : 0);
+}
+
+unsigned long stackdist_set_misses(const StackDist *sd, unsigned long ways) {
+    return misses_at(sd, &sd->set_hist, ways);
+}
+
+unsigned long stackdist_level_misses(const StackDist *sd, unsigned long lines) {
+    return misses_at(sd, &sd->level_hist, lines);
+}
@@ -0,0 +1,76 @@
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include "cache.h"
+
+// LRU stack distances of one cache level's reference stream, in one pass.
+//
+// A line's distance is the number of distinct other lines referenced since its last
+// reference. It is tracked twice: over the whole level (fully associative, giving the
+// miss ratio for every capacity) and within the line's set (giving the miss ratio for
+// every associativity at the level's set count). An LRU cache of w ways misses exactly
+// when the set distance is >= w or the line is cold.
+//
+// Each stack numbers references with a clock and keeps a Fenwick tree with a 1 at the
+// last reference time of every live line, so a distance is one prefix sum. Clocks are
+// compacted when they run out of room, so memory stays proportional to distinct lines.
+
+#define STACKDIST_COLD ULONG_MAX
+
+// one LRU stack: a Fenwick tree over reference times
+typedef struct {
+    uint32_t *tree;    // 1-based Fenwick tree, capacity + 1 entries
+    uint64_t *owner;   // line referenced at each time, STACK_EMPTY once re-referenced
+    unsigned long capacity;
+    unsigned long clock;  // next time
+    unsigned long live;   // lines in the stack
+} ReuseStack;
+
+// distance histogram, counts[d] references at distance d (at distance >= d once finished)
+typedef struct {
+    unsigned long *counts;
+    unsigned long length;
+} DistHistogram;
+
+typedef struct {
+    uint64_t key;          // line + 1, 0 = empty slot
+    unsigned long time[2]; // last reference time in the level stack and in the set stack
+} LineEntry;
+
+typedef struct {
+    unsigned long num_sets;
+    ReuseStack level;   // all lines
+    ReuseStack *sets;   // num_sets stacks
+
+    LineEntry *lines;   // open addressing hash table
+    unsigned long lines_capacity; // power of two
+    unsigned long lines_count;
+
+    unsigned long accesses;
+    unsigned long cold;
+    DistHistogram level_hist;
+    DistHistogram set_hist;
+    int finished;
+} StackDist;
+
+StackDist *stackdist_create(unsigned long num_sets);
+void stackdist_free(StackDist *sd);
+
+// references line (unique within the level) in set, returns its set distance or STACKDIST_COLD
+unsigned long stackdist_access(StackDist *sd, uint64_t line, unsigned long set);
+
+// stackdist_access in two halves, for a level that is looked up under one line and filled
+// under another: lookup counts the reference and returns its set distance without moving
+// line, touch makes a line the most recent without counting a reference
+unsigned long stackdist_lookup(StackDist *sd, uint64_t line, unsigned long set);
+void stackdist_touch(StackDist *sd, uint64_t line, unsigned long set);
+
+// ends the stream, the histograms become cumulative for the miss queries
+void stackdist_finish(StackDist *sd);
+
+// misses of an LRU cache over the finished stream: with `ways` ways at num_sets sets,
+// or fully associative with room for `lines` lines
+unsigned long stackdist_set_misses(const StackDist *sd, unsigned long ways);
+unsigned long stackdist_level_misses(const StackDist *sd, unsigned long lines);
+
+#endif
@@ -0,0 +1,117 @@
+#include "sweep.h"
+#include <pthread.h>
+
+struct Sweep {
+    SimContext **contexts;
+    unsigned long num_contexts;
+
+    // current batch
+    const TraceRecord *records;
+    unsigned long count;
+    unsigned long generation; // bumped for every batch
+    unsigned long next;       // next context to claim, atomic; released after records/count are set
+    unsigned long done;       // contexts finished with the batch
+
+    unsigned long num_workers;
+    pthread_t *workers;
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t finished;
+    int stop;
+};
+
+// Replays the current batch into contexts until none are left to claim. A worker that
+// wakes late may claim from the following batch, which is fine: the acquire on next
+// makes that batch's records visible.
+static void run_batch(Sweep *sweep) {
+    unsigned long i, finished = 0;
+    while ((i = __atomic_fetch_add(&sweep->next, 1, __ATOMIC_ACQ_REL)) < sweep->num_contexts) {
+        sim_replay(sweep->contexts[i], sweep->records, sweep->count);
+        finished++;
+    }
+    if (finished) {
+        pthread_mutex_lock(&sweep->lock);
+        sweep->done += finished;
+        if (sweep->done == sweep->num_contexts)
+            pthread_cond_signal(&sweep->finished);
+        pthread_mutex_unlock(&sweep->lock);
+    }
+}
+
+static void *sweep_worker(void *arg) {
+    Sweep *sweep = arg;
+    unsigned long seen = 0;
+    pthread_mutex_lock(&sweep->lock);
+    for (;;) {
+        while (!sweep->stop && sweep->generation == seen)
+            pthread_cond_wait(&sweep->start, &sweep->lock);
+        if (sweep->stop)
+            break;
+        seen = sweep->generation;
+        pthread_mutex_unlock(&sweep->lock);
+        run_batch(sweep);
+        pthread_mutex_lock(&sweep->lock);
+    }
+    pthread_mutex_unlock(&sweep->lock);
+    return NULL;
+}
+
+Sweep *sweep_create(SimContext **contexts, unsigned long num_contexts, unsigned long threads) {
+    Sweep *sweep = calloc(1, sizeof(Sweep));
+    if (!sweep) { perror("calloc"); exit(1); }
+    sweep->contexts = contexts;
+    sweep->num_contexts = num_contexts;
+    pthread_mutex_init(&sweep->lock, NULL);
+    pthread_cond_init(&sweep->start, NULL);
+    pthread_cond_init(&sweep->finished, NULL);
+
+    // no point in more threads than contexts
+    if (threads > num_contexts)
+        threads = num_contexts;
+    sweep->num_workers = threads > 1 ? threads - 1 : 0;
+    if (sweep->num_workers) {
+        sweep->workers = malloc(sweep->num_workers * sizeof(pthread_t));
+        if (!sweep->workers) { perror("malloc"); exit(1); }
+        for (unsigned long i = 0; i < sweep->num_workers; i++) {
+            if (pthread_create(&sweep->workers[i], NULL, sweep_worker, sweep) != 0) {
+                perror("pthread_create");
+                exit(1);
+            }
+        }
+    }
+    return sweep;
+}
+
+void sweep_replay(Sweep *sweep, const TraceRecord *records, unsigned long count) {
+    pthread_mutex_lock(&sweep->lock);
+    sweep->records = records;
+    sweep->count = count;
+    sweep->done = 0;
+    __atomic_store_n(&sweep->next, 0, __ATOMIC_RELEASE);
+    sweep->generation++;
+    pthread_cond_broadcast(&sweep->start);
+    pthread_mutex_unlock(&sweep->lock);
+
+    run_batch(sweep);
+
+    pthread_mutex_lock(&sweep->lock);
+    while (sweep->done < sweep->num_contexts)
+        pthread_cond_wait(&sweep->finished, &sweep->lock);
+    pthread_mutex_unlock(&sweep->lock);
+}
+
+void sweep_destroy(Sweep *sweep) {
+    if (!sweep)
+        return;
+    pthread_mutex_lock(&sweep->lock);
+    sweep->stop = 1;
+    pthread_cond_broadcast(&sweep->start);
+    pthread_mutex_unlock(&sweep->lock);
+    for (unsigned long i = 0; i < sweep->num_workers; i++)
+        pthread_join(sweep->workers[i], NULL);
+    pthread_mutex_destroy(&sweep->lock);
+    pthread_cond_destroy(&sweep->start);
+    pthread_cond_destroy(&sweep->finished);
+    free(sweep->workers);
+    free(sweep);
+}
@@ -0,0 +1,17 @@
+#ifndef SWEEP_H
+#define SWEEP_H
+
+#include "trace.h"
+
+// Replays one record stream into many independent contexts at once. Each batch is
+// handed to every context, worker threads claim contexts one at a time, and
+// sweep_replay returns once all contexts have consumed the batch, so the caller can
+// then reuse or release it. The calling thread works on the batch too.
+typedef struct Sweep Sweep;
+
+// threads counts the caller, threads <= 1 replays everything on the caller
+Sweep *sweep_create(SimContext **contexts, unsigned long num_contexts, unsigned long threads);
+void sweep_replay(Sweep *sweep, const TraceRecord *records, unsigned long count);
+void sweep_destroy(Sweep *sweep);
+
+#endif
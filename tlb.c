@@ -0,0 +1,368 @@
+#include "tlb.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_NONE UINT64_MAX
+#define TABLE_SHIFT 9 // 512 entries of 8 bytes per page-table page
+
+static const unsigned page_shift[PAGE_NUM_SIZES] = { 12, 21, 30 };
+
+typedef struct {
+    uint64_t *keys; // sets * ways, KEY_NONE when invalid
+    unsigned long *ages;
+    unsigned long sets;
+    unsigned long ways;
+    unsigned long latency;
+    unsigned page_sizes;
+} Tlb;
+
+// page-table pages by (depth, address prefix), numbered in the order they are first walked
+typedef struct {
+    uint64_t *keys; // 0 when free
+    unsigned long *frames;
+    unsigned long capacity; // power of two
+    unsigned long used;
+} PageTable;
+
+struct Mmu {
+    MmuConfig config;
+    Tlb tlb[TLB_NUM_KINDS];
+    Tlb walk_cache;
+    PageTable table;
+    unsigned long clock; // LRU ages of every TLB
+    MmuStats stats;
+};
+
+void mmu_defaults(MmuConfig *config) {
+    // roughly a recent x86 core
+    config->tlb[TLB_ITLB] = (TlbConfig){ 128, 8, 0, 1 << PAGE_4K | 1 << PAGE_2M };
+    config->tlb[TLB_DTLB] = (TlbConfig){ 64, 4, 0, 1 << PAGE_4K | 1 << PAGE_2M | 1 << PAGE_1G };
+    config->tlb[TLB_STLB] = (TlbConfig){ 1536, 12, 8, 1 << PAGE_4K | 1 << PAGE_2M };
+    config->page_size = PAGE_4K;
+    config->huge_percent = 100;
+    config->walk_levels = 4;
+    config->walk_cache = 32;
+    config->page_table_base = 1ULL << 40;
+}
+
+static int parse_page_size(const char *value, PageSize *size) {
+    for (PageSize s = 0; s < PAGE_NUM_SIZES; s++) {
+        if (strcmp(value, page_size_name(s)) == 0) {
+            *size = s;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// a comma-separated list of page sizes
+static unsigned parse_page_sizes(const char *key, const char *value) {
+    char list[64];
+    unsigned sizes = 0;
+    strncpy(list, value, sizeof(list) - 1);
+    list[sizeof(list) - 1] = '\0';
+    for (char *save, *name = strtok_r(list, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        PageSize size;
+        if (parse_page_size(name, &size))
+            sizes |= 1u << size;
+        else
+            fprintf(stderr, "Warning: unknown page size %s in %s, ignored.\n", name, key);
+    }
+    return sizes;
+}
+
+int mmu_config_key(MmuConfig *config, const char *key, const char *value) {
+    static const char *const prefixes[TLB_NUM_KINDS] = { "ITLB_", "DTLB_", "STLB_" };
+    for (TlbKind k = 0; k < TLB_NUM_KINDS; k++) {
+        if (strncmp(key, prefixes[k], 5) != 0)
+            continue;
+        const char *field = key + 5;
+        TlbConfig *tlb = &config->tlb[k];
+        if (strcmp(field, "ENTRIES") == 0)
+            tlb->entries = strtoul(value, NULL, 10);
+        else if (strcmp(field, "ASSOC") == 0)
+            tlb->associativity = strtoul(value, NULL, 10);
+        else if (strcmp(field, "LATENCY") == 0)
+            tlb->latency = strtoul(value, NULL, 10);
+        else if (strcmp(field, "PAGE_SIZES") == 0)
+            tlb->page_sizes = parse_page_sizes(key, value);
+        else
+            return 0;
+        return 1;
+    }
+    if (strcmp(key, "PAGE_SIZE") == 0) {
+        if (!parse_page_size(value, &config->page_size)) {
+            fprintf(stderr, "Warning: unknown PAGE_SIZE %s, using 4K.\n", value);
+            config->page_size = PAGE_4K;
+        }
+    } else if (strcmp(key, "PAGE_HUGE_PERCENT") == 0) {
+        config->huge_percent = strtoul(value, NULL, 10);
+    } else if (strcmp(key, "PAGE_WALK_LEVELS") == 0) {
+        config->walk_levels = strtoul(value, NULL, 10);
+        if (config->walk_levels != 4 && config->walk_levels != 5) {
+            fprintf(stderr, "Warning: PAGE_WALK_LEVELS=%s, using 4.\n", value);
+            config->walk_levels = 4;
+        }
+    } else if (strcmp(key, "PAGE_WALK_CACHE") == 0) {
+        config->walk_cache = strtoul(value, NULL, 10);
+    } else if (strcmp(key, "PAGE_TABLE_BASE") == 0) {
+        config->page_table_base = strtoull(value, NULL, 0);
+    } else
+        return 0;
+    return 1;
+}
+
+const char *page_size_name(PageSize size) {
+    static const char *const names[PAGE_NUM_SIZES] = { "4K", "2M", "1G" };
+    return names[size];
+}
+
+static void *zalloc(size_t count, size_t size) {
+    void *p = calloc(count, size);
+    if (!p) { perror("calloc"); exit(1); }
+    return p;
+}
+
+static void tlb_init(Tlb *tlb, const char *name, unsigned long entries, unsigned long associativity,
+                     unsigned long latency, unsigned page_sizes) {
+    if (!entries)
+        return;
+    if (!associativity || associativity > entries)
+        associativity = entries;
+    if (entries % associativity) {
+        fprintf(stderr, "%s: %lu entries is not a multiple of the associativity %lu\n", name, entries, associativity);
+        exit(1);
+    }
+    tlb->sets = entries / associativity;
+    tlb->ways = associativity;
+    tlb->latency = latency;
+    tlb->page_sizes = page_sizes;
+    tlb->keys = zalloc(entries, sizeof(uint64_t));
+    tlb->ages = zalloc(entries, sizeof(unsigned long));
+}
+
+static void tlb_flush(Tlb *tlb) {
+    for (unsigned long i = 0; i < tlb->sets * tlb->ways; i++)
+        tlb->keys[i] = KEY_NONE;
+}
+
+// the size tlb caches a page of size as: its own, or splintered into the largest smaller
+// size the TLB holds; PAGE_NUM_SIZES when it holds none of them
+static inline PageSize entry_size(const Tlb *tlb, PageSize size) {
+    if (tlb->keys) {
+        for (int s = size; s >= 0; s--) {
+            if (tlb->page_sizes & (1u << s))
+                return s;
+        }
+    }
+    return PAGE_NUM_SIZES;
+}
+
+// looks key up in the set of index, touching it on a hit
+static int tlb_probe(Mmu *mmu, Tlb *tlb, uint64_t index, uint64_t key) {
+    unsigned long base = index % tlb->sets * tlb->ways;
+    for (unsigned long i = base; i < base + tlb->ways; i++) {
+        if (tlb->keys[i] == key) {
+            tlb->ages[i] = ++mmu->clock;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// puts key in the set of index, over its least recently used entry
+static void tlb_insert(Mmu *mmu, Tlb *tlb, uint64_t index, uint64_t key) {
+    unsigned long base = index % tlb->sets * tlb->ways, victim = base;
+    for (unsigned long i = base; i < base + tlb->ways; i++) {
+        if (tlb->keys[i] == KEY_NONE) {
+            victim = i;
+            break;
+        }
+        if (tlb->ages[i] < tlb->ages[victim])
+            victim = i;
+    }
+    tlb->keys[victim] = key;
+    tlb->ages[victim] = ++mmu->clock;
+}
+
+Mmu *mmu_create(const MmuConfig *config) {
+    static const char *const names[TLB_NUM_KINDS] = { "ITLB", "DTLB", "STLB" };
+    Mmu *mmu = zalloc(1, sizeof(Mmu));
+    mmu->config = *config;
+    if (mmu->config.huge_percent > 100)
+        mmu->config.huge_percent = 100;
+    for (TlbKind k = 0; k < TLB_NUM_KINDS; k++) {
+        const TlbConfig *c = &config->tlb[k];
+        tlb_init(&mmu->tlb[k], names[k], c->entries, c->associativity, c->latency, c->page_sizes);
+    }
+    tlb_init(&mmu->walk_cache, "page walk cache", config->walk_cache, 0, 0, 0);
+    mmu->table.capacity = 1024;
+    mmu->table.keys = zalloc(mmu->table.capacity, sizeof(uint64_t));
+    mmu->table.frames = zalloc(mmu->table.capacity, sizeof(unsigned long));
+    mmu_reset(mmu);
+    return mmu;
+}
+
+void mmu_destroy(Mmu *mmu) {
+    if (!mmu)
+        return;
+    for (TlbKind k = 0; k < TLB_NUM_KINDS; k++) {
+        free(mmu->tlb[k].keys);
+        free(mmu->tlb[k].ages);
+    }
+    free(mmu->walk_cache.keys);
+    free(mmu->walk_cache.ages);
+    free(mmu->table.keys);
+    free(mmu->table.frames);
+    free(mmu);
+}
+
+void mmu_reset(Mmu *mmu) {
+    for (TlbKind k = 0; k < TLB_NUM_KINDS; k++) {
+        if (mmu->tlb[k].keys)
+            tlb_flush(&mmu->tlb[k]);
+    }
+    if (mmu->walk_cache.keys)
+        tlb_flush(&mmu->walk_cache);
+}
+
+void mmu_clear_stats(Mmu *mmu) {
+    memset(&mmu->stats, 0, sizeof(mmu->stats));
+}
+
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    return x ^ (x >> 33);
+}
+
+static PageSize page_size_of(const MmuConfig *config, uint64_t vaddr) {
+    PageSize size = config->page_size;
+    if (size == PAGE_4K || config->huge_percent >= 100)
+        return size;
+    return mix(vaddr >> page_shift[size]) % 100 < config->huge_percent ? size : PAGE_4K;
+}
+
+// physical frame of the page-table page for (depth, prefix), allocated on first use
+static uint64_t table_frame(PageTable *table, uint64_t depth, uint64_t prefix) {
+    uint64_t key = (prefix << 3 | depth) + 1;
+    unsigned long mask = table->capacity - 1, i = mix(key) & mask;
+    while (table->keys[i] && table->keys[i] != key)
+        i = (i + 1) & mask;
+    if (table->keys[i])
+        return table->frames[i];
+    if (2 * (table->used + 1) > table->capacity) { // rehash at half full
+        uint64_t *keys = table->keys;
+        unsigned long *frames = table->frames, capacity = table->capacity;
+        table->capacity *= 2;
+        table->keys = zalloc(table->capacity, sizeof(uint64_t));
+        table->frames = zalloc(table->capacity, sizeof(unsigned long));
+        mask = table->capacity - 1;
+        for (unsigned long j = 0; j < capacity; j++) {
+            if (!keys[j])
+                continue;
+            unsigned long k = mix(keys[j]) & mask;
+            while (table->keys[k])
+                k = (k + 1) & mask;
+            table->keys[k] = keys[j];
+            table->frames[k] = frames[j];
+        }
+        free(keys);
+        free(frames);
+        i = mix(key) & mask;
+        while (table->keys[i])
+            i = (i + 1) & mask;
+    }
+    table->keys[i] = key;
+    table->frames[i] = table->used++;
+    return table->frames[i];
+}
+
+// the entry at depth d of a walk through levels covers vaddr >> entry_shift(levels, d)
+static inline unsigned entry_shift(unsigned long levels, unsigned long d) {
+    return page_shift[PAGE_4K] + TABLE_SHIFT * (levels - 1 - d);
+}
+
+// Writes the reads of a walk for vaddr's page of size to ptes, skipping the levels the
+// page walk cache holds, and returns their number.
+static unsigned long page_walk(Mmu *mmu, uint64_t vaddr, PageSize size, int count, uint64_t *ptes) {
+    const MmuConfig *c = &mmu->config;
+    unsigned long levels = c->walk_levels, leaf = levels - 1 - size, start = 0;
+    vaddr &= (1ULL << (page_shift[PAGE_4K] + TABLE_SHIFT * levels)) - 1;
+    if (mmu->walk_cache.keys) {
+        for (unsigned long d = leaf; d-- > 0;) {
+            uint64_t region = vaddr >> entry_shift(levels, d);
+            if (tlb_probe(mmu, &mmu->walk_cache, region, region << 3 | d)) {
+                start = d + 1;
+                break;
+            }
+        }
+        for (unsigned long d = start; d < leaf; d++) {
+            uint64_t region = vaddr >> entry_shift(levels, d);
+            tlb_insert(mmu, &mmu->walk_cache, region, region << 3 | d);
+        }
+        if (count)
+            mmu->stats.walk_cache_hits += start;
+    }
+    unsigned long n = 0;
+    for (unsigned long d = start; d <= leaf; d++) {
+        uint64_t frame = table_frame(&mmu->table, d, vaddr >> (entry_shift(levels, d) + TABLE_SHIFT));
+        uint64_t index = (vaddr >> entry_shift(levels, d)) & ((1 << TABLE_SHIFT) - 1);
+        ptes[n++] = c->page_table_base + (frame << page_shift[PAGE_4K]) + index * 8;
+    }
+    return n;
+}
+
+unsigned long mmu_translate(Mmu *mmu, uint64_t vaddr, int instr, int count, uint64_t *ptes, unsigned long *num_ptes) {
+    PageSize size = page_size_of(&mmu->config, vaddr);
+    Tlb *path[2] = { &mmu->tlb[instr ? TLB_ITLB : TLB_DTLB], &mmu->tlb[TLB_STLB] };
+    TlbStats *stats[2] = { &mmu->stats.tlb[instr ? TLB_ITLB : TLB_DTLB], &mmu->stats.tlb[TLB_STLB] };
+    uint64_t keys[2]; // virtual page number << 2 | size of the entry at each level, UINT64_MAX for none
+    unsigned long latency = 0;
+    *num_ptes = 0;
+    if (count)
+        mmu->stats.translations[size]++;
+    for (int i = 0; i < 2; i++) {
+        PageSize held = entry_size(path[i], size);
+        keys[i] = held == PAGE_NUM_SIZES ? KEY_NONE : (vaddr >> page_shift[held]) << 2 | held;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (keys[i] == KEY_NONE)
+            continue;
+        latency += path[i]->latency;
+        int hit = tlb_probe(mmu, path[i], keys[i] >> 2, keys[i]);
+        if (count) {
+            stats[i]->accesses++;
+            stats[i]->hits += hit;
+        }
+        if (hit) {
+            if (i == 1 && keys[0] != KEY_NONE) // refill the L1 TLB
+                tlb_insert(mmu, path[0], keys[0] >> 2, keys[0]);
+            return latency;
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (keys[i] != KEY_NONE)
+            tlb_insert(mmu, path[i], keys[i] >> 2, keys[i]);
+    }
+    *num_ptes = page_walk(mmu, vaddr, size, count, ptes);
+    if (count) {
+        mmu->stats.walks++;
+        mmu->stats.walk_reads += *num_ptes;
+    }
+    return latency;
+}
+
+void mmu_walk_done(Mmu *mmu, unsigned long cycles, unsigned long from_memory, int count) {
+    if (!count)
+        return;
+    mmu->stats.walk_cycles += cycles;
+    mmu->stats.walk_reads_memory += from_memory;
+}
+
+const MmuStats *mmu_stats(const Mmu *mmu) {
+    return &mmu->stats;
+}
@@ -0,0 +1,90 @@
+#ifndef TLB_H
+#define TLB_H
+
+#include <stdint.h>
+
+// Address translation (USE_TLB=1): L1 instruction and data TLBs, a shared second-level
+// TLB and a radix page-table walker. A TLB is set associative with LRU replacement, and
+// holds translations of the page sizes it is configured for. A page of a size a TLB does
+// not hold is splintered into entries of the largest smaller size it holds, and a TLB
+// holding none of those is passed over. A translation that misses every TLB walks the
+// page table from the root, one read per level, unless the page walk cache (paging-
+// structure cache) holds an upper-level entry of the address. The walk's reads are
+// physical addresses in a page table laid out here; cache.c sends them down the data
+// path below L1.
+//
+// Pages are PAGE_SIZE, or 4K outside the PAGE_HUGE_PERCENT of huge-page regions picked by
+// a hash of the region, which models partial huge-page (THP) adoption.
+
+typedef enum {
+    PAGE_4K,
+    PAGE_2M,
+    PAGE_1G,
+    PAGE_NUM_SIZES
+} PageSize;
+
+typedef enum {
+    TLB_ITLB,
+    TLB_DTLB,
+    TLB_STLB, // shared by instructions and data
+    TLB_NUM_KINDS
+} TlbKind;
+
+#define MMU_MAX_WALK 5 // reads of a 5-level walk
+
+typedef struct {
+    unsigned long entries;       // 0 = no such TLB
+    unsigned long associativity; // 0 = fully associative
+    unsigned long latency;       // cycles to look it up
+    unsigned page_sizes;         // bit (1 << PageSize) per page size it holds
+} TlbConfig;
+
+typedef struct {
+    TlbConfig tlb[TLB_NUM_KINDS];
+    PageSize page_size;
+    unsigned long huge_percent;   // regions mapped with page_size when it is a huge page
+    unsigned long walk_levels;    // 4 (48-bit) or 5 (57-bit virtual addresses)
+    unsigned long walk_cache;     // entries of the page walk cache, 0 = none
+    uint64_t page_table_base;     // physical address of the first page-table page
+} MmuConfig;
+
+typedef struct {
+    unsigned long accesses;
+    unsigned long hits;
+} TlbStats;
+
+// counted while the caller says so
+typedef struct {
+    TlbStats tlb[TLB_NUM_KINDS];
+    unsigned long translations[PAGE_NUM_SIZES];
+    unsigned long walks;             // misses in every TLB
+    unsigned long walk_cycles;       // summed over the walks
+    unsigned long walk_reads;        // page-table reads issued
+    unsigned long walk_reads_memory; // of those, served by memory
+    unsigned long walk_cache_hits;   // reads the page walk cache saved
+} MmuStats;
+
+typedef struct Mmu Mmu;
+
+void mmu_defaults(MmuConfig *config);
+// sets an ITLB_, DTLB_, STLB_ or PAGE_ key, returns 0 for an unknown one
+int mmu_config_key(MmuConfig *config, const char *key, const char *value);
+const char *page_size_name(PageSize size);
+
+Mmu *mmu_create(const MmuConfig *config);
+void mmu_destroy(Mmu *mmu);
+// flushes the TLBs and the page walk cache; the page table stays where it is
+void mmu_reset(Mmu *mmu);
+void mmu_clear_stats(Mmu *mmu);
+
+// Translates vaddr for an instruction fetch (instr) or a data access, filling the TLBs
+// on a miss. Returns the cycles of the TLB lookups. When every TLB misses, writes the
+// physical addresses the walk reads, root first, to ptes and their number to *num_ptes,
+// otherwise 0. count adds it to the MmuStats.
+unsigned long mmu_translate(Mmu *mmu, uint64_t vaddr, int instr, int count, uint64_t *ptes, unsigned long *num_ptes);
+// the walk the last mmu_translate asked for took cycles, from_memory of its reads missing the caches
+void mmu_walk_done(Mmu *mmu, unsigned long cycles, unsigned long from_memory, int count);
+
+const MmuStats *mmu_stats(const Mmu *mmu);
+
+#endif
@@ -0,0 +1,144 @@
+#include "trace.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void trace_map(const char *path, TraceMap *map) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) { perror(path); exit(1); }
+    struct stat st;
+    if (fstat(fd, &st) < 0) { perror("fstat"); exit(1); }
+    if ((size_t)st.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "%s: not a trace file\n", path);
+        exit(1);
+    }
+
+    map->length = st.st_size;
+    map->base = mmap(NULL, map->length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map->base == MAP_FAILED) { perror("mmap"); exit(1); }
+    close(fd);
+    madvise(map->base, map->length, MADV_SEQUENTIAL);
+    madvise(map->base, map->length, MADV_WILLNEED);
+
+    const TraceHeader *header = map->base;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+        header->version != TRACE_VERSION || header->record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "%s: not a version %d trace file\n", path, TRACE_VERSION);
+        exit(1);
+    }
+    map->records = (const TraceRecord *)(header + 1);
+    map->count = (map->length - sizeof(TraceHeader)) / sizeof(TraceRecord);
+}
+
+void trace_unmap(TraceMap *map) {
+    munmap(map->base, map->length);
+    map->base = NULL;
+    map->records = NULL;
+    map->count = 0;
+}
+
+#define REPLAY_BATCH 1024
+
+void sim_replay_op(SimContext *ctx, const TraceRecord *r) {
+    switch (r->op) {
+        case TRACE_ACCESS:         sim_access_core(ctx, r->core, r->vaddr, r->paddr, r->access_type); break;
+        case TRACE_PREFETCH:       sim_prefetch(ctx, r->vaddr, r->paddr, r->access_type); break;
+        case TRACE_PREFETCH_T0:    sim_prefetch_t0(ctx, r->vaddr, r->paddr, r->access_type); break;
+        case TRACE_PREFETCH_T1:    sim_prefetch_t1(ctx, r->vaddr, r->paddr, r->access_type); break;
+        case TRACE_PREFETCH_T2:    sim_prefetch_t2(ctx, r->vaddr, r->paddr, r->access_type); break;
+        case TRACE_PREFETCH_NTA:   sim_prefetch_nta(ctx, r->vaddr, r->paddr, r->access_type); break;
+        case TRACE_PREFETCH_W:     sim_prefetch_w(ctx, r->vaddr, r->paddr, r->access_type); break;
+        case TRACE_FLUSH:
+            if (r->access_type == 1)
+                sim_flush_instruction(ctx, r->paddr);
+            else
+                sim_flush_data(ctx, r->paddr);
+            break;
+        case TRACE_INVALIDATE:     sim_invalidate(ctx, r->paddr); break;
+        case TRACE_INVALIDATE_ALL: sim_invalidate_all(ctx); break;
+        default: break; // unknown ops are skipped
+    }
+}
+
+void sim_replay(SimContext *ctx, const TraceRecord *records, unsigned long count) {
+    MemoryAccess batch[REPLAY_BATCH];
+    unsigned long pending = 0;
+
+    for (unsigned long i = 0; i < count; i++) {
+        const TraceRecord *r = &records[i];
+        if (r->op == TRACE_ACCESS) {
+            batch[pending].vaddr = r->vaddr;
+            batch[pending].paddr = r->paddr;
+            batch[pending].access_type = r->access_type;
+            batch[pending].core = r->core;
+            if (++pending == REPLAY_BATCH) {
+                sim_access_batch(ctx, batch, pending, NULL);
+                pending = 0;
+            }
+            continue;
+        }
+
+        // everything else keeps its place relative to the accesses around it
+        if (pending) {
+            sim_access_batch(ctx, batch, pending, NULL);
+            pending = 0;
+        }
+        sim_replay_op(ctx, r);
+    }
+    if (pending)
+        sim_access_batch(ctx, batch, pending, NULL);
+}
+
+
+#define WRITER_BUFFER 4096 // records
+
+struct TraceWriter {
+    FILE *fp;
+    unsigned long pending;
+    TraceRecord buffer[WRITER_BUFFER];
+};
+
+static void writer_flush(TraceWriter *writer) {
+    if (writer->pending && fwrite(writer->buffer, sizeof(TraceRecord), writer->pending, writer->fp) != writer->pending) {
+        perror("fwrite");
+        exit(1);
+    }
+    writer->pending = 0;
+}
+
+TraceWriter *trace_writer_open(const char *path) {
+    TraceWriter *writer = malloc(sizeof(TraceWriter));
+    if (!writer) { perror("malloc"); exit(1); }
+    writer->fp = fopen(path, "wb");
+    if (!writer->fp) { perror(path); exit(1); }
+    writer->pending = 0;
+
+    TraceHeader header = { .magic = TRACE_MAGIC, .version = TRACE_VERSION, .record_size = sizeof(TraceRecord) };
+    if (fwrite(&header, sizeof(header), 1, writer->fp) != 1) { perror("fwrite"); exit(1); }
+    return writer;
+}
+
+void trace_write(TraceWriter *writer, unsigned long vaddr, unsigned long paddr, unsigned long access_type, TraceOp op) {
+    trace_write_core(writer, 0, vaddr, paddr, access_type, op);
+}
+
+void trace_write_core(TraceWriter *writer, unsigned long core, unsigned long vaddr, unsigned long paddr,
+                      unsigned long access_type, TraceOp op) {
+    TraceRecord *r = &writer->buffer[writer->pending];
+    r->vaddr = vaddr;
+    r->paddr = paddr;
+    r->access_type = access_type;
+    r->core = core;
+    r->op = op;
+    if (++writer->pending == WRITER_BUFFER)
+        writer_flush(writer);
+}
+
+void trace_writer_close(TraceWriter *writer) {
+    if (!writer)
+        return;
+    writer_flush(writer);
+    if (fclose(writer->fp) != 0) { perror("fclose"); exit(1); }
+    free(writer);
+}
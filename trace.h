@@ -0,0 +1,70 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "cache.h"
+
+// Binary trace format: a TraceHeader followed by fixed-width TraceRecords in
+// host byte order. The record count is implied by the file size, so a trace can
+// be appended to and a truncated capture still replays up to its last full record.
+
+#define TRACE_MAGIC "CSIMTRC"
+#define TRACE_VERSION 1
+
+typedef struct {
+    char magic[8];        // TRACE_MAGIC, NUL padded
+    uint32_t version;     // TRACE_VERSION
+    uint32_t record_size; // sizeof(TraceRecord)
+} TraceHeader;
+
+// what a record does, each maps to one simulator call
+typedef enum {
+    TRACE_ACCESS,         // sim_access
+    TRACE_PREFETCH,       // sim_prefetch
+    TRACE_PREFETCH_T0,
+    TRACE_PREFETCH_T1,
+    TRACE_PREFETCH_T2,
+    TRACE_PREFETCH_NTA,
+    TRACE_PREFETCH_W,
+    TRACE_FLUSH,          // sim_flush_instruction if access_type is 1, else sim_flush_data
+    TRACE_INVALIDATE,     // sim_invalidate(paddr)
+    TRACE_INVALIDATE_ALL,
+    TRACE_NUM_OPS
+} TraceOp;
+
+// core was added in what used to be the high half of a 32-bit access_type, so earlier
+// (little-endian) traces read as core 0
+typedef struct {
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint16_t access_type; // 1 = instruction, 2 = data write, otherwise data read
+    uint16_t core;        // issuing core or thread, taken modulo CORES
+    uint32_t op;          // TraceOp
+} TraceRecord;
+
+// read-only mapping of a trace file
+typedef struct {
+    void *base;
+    size_t length;
+    const TraceRecord *records;
+    unsigned long count;
+} TraceMap;
+
+void trace_map(const char *path, TraceMap *map);
+void trace_unmap(TraceMap *map);
+
+// feeds records to ctx in order, runs of accesses go through sim_access_batch
+void sim_replay(SimContext *ctx, const TraceRecord *records, unsigned long count);
+
+// the simulator call of a single record
+void sim_replay_op(SimContext *ctx, const TraceRecord *r);
+
+// buffered trace capture, for instrumentation tools
+typedef struct TraceWriter TraceWriter;
+
+TraceWriter *trace_writer_open(const char *path);
+void trace_write(TraceWriter *writer, unsigned long vaddr, unsigned long paddr, unsigned long access_type, TraceOp op);
+void trace_write_core(TraceWriter *writer, unsigned long core, unsigned long vaddr, unsigned long paddr,
+                      unsigned long access_type, TraceOp op);
+void trace_writer_close(TraceWriter *writer);
+
+#endif
@@ -0,0 +1,53 @@
+// Converts lackey, drcachesim and ChampSim traces (import.h) to raw or compressed native traces.
+// build: gcc -O2 -o traceimport traceimport.c import.c ctrace.c trace.c cache.c coherence.c waymatch.c kernels.c prefetch.c dram.c tlb.c interval.c -lpthread
+// usage: ./traceimport -f lackey|drcachesim|champsim [-j threads] [-z] [-b block_records] in out
+//        ("-" reads stdin, e.g. xz -dc trace.champsimtrace.xz | ./traceimport -f champsim - out.bin)
+#include "import.h"
+#include "ctrace.h"
+#include <unistd.h>
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s -f lackey|drcachesim|champsim [-j threads] [-z] [-b block_records] in out\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    ImportFormat format = IMPORT_NUM_FORMATS;
+    unsigned long threads = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+    unsigned long block_records = CTRACE_BLOCK_RECORDS;
+    int compressed = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "f:j:zb:")) != -1) {
+        switch (opt) {
+            case 'f': format = import_format(optarg); break;
+            case 'j': threads = strtoul(optarg, NULL, 10); break;
+            case 'z': compressed = 1; break;
+            case 'b': block_records = strtoul(optarg, NULL, 10); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (format == IMPORT_NUM_FORMATS || optind != argc - 2)
+        usage(argv[0]);
+
+    TraceImporter *importer = import_open(argv[optind], format, threads);
+    TraceWriter *raw = compressed ? NULL : trace_writer_open(argv[optind + 1]);
+    CTraceWriter *packed = compressed ? ctrace_writer_open(argv[optind + 1], block_records) : NULL;
+
+    const TraceRecord *records;
+    unsigned long count, total = 0;
+    while ((count = import_next(importer, &records)) > 0) {
+        for (unsigned long i = 0; i < count; i++) {
+            if (packed)
+                ctrace_write(packed, &records[i]);
+            else
+                trace_write_core(raw, records[i].core, records[i].vaddr, records[i].paddr, records[i].access_type,
+                                 records[i].op);
+        }
+        total += count;
+    }
+    import_close(importer);
+    trace_writer_close(raw);
+    ctrace_writer_close(packed);
+    fprintf(stderr, "imported %lu records from %s trace\n", total, import_format_name(format));
+    return 0;
+}
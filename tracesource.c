@@ -0,0 +1,49 @@
+#include "tracesource.h"
+#include "ctrace.h"
+
+#define RAW_BATCH_RECORDS 65536
+
+struct TraceSource {
+    TraceMap map;            // raw
+    unsigned long position;
+    CTraceReader *reader;    // compressed
+    TraceImporter *importer; // foreign
+};
+
+TraceSource *trace_source_open(const char *path, ImportFormat format, unsigned long threads) {
+    TraceSource *source = calloc(1, sizeof(TraceSource));
+    if (!source) { perror("calloc"); exit(1); }
+    if (format != IMPORT_NUM_FORMATS)
+        source->importer = import_open(path, format, threads);
+    else if (strcmp(path, "-") == 0 || ctrace_is_compressed(path))
+        source->reader = ctrace_open(path, threads);
+    else
+        trace_map(path, &source->map);
+    return source;
+}
+
+unsigned long trace_source_next(TraceSource *source, const TraceRecord **records) {
+    if (source->importer)
+        return import_next(source->importer, records);
+    if (source->reader)
+        return ctrace_next_block(source->reader, records);
+
+    unsigned long count = source->map.count - source->position;
+    if (count > RAW_BATCH_RECORDS)
+        count = RAW_BATCH_RECORDS;
+    *records = source->map.records + source->position;
+    source->position += count;
+    return count;
+}
+
+void trace_source_close(TraceSource *source) {
+    if (!source)
+        return;
+    if (source->importer)
+        import_close(source->importer);
+    else if (source->reader)
+        ctrace_close(source->reader);
+    else
+        trace_unmap(&source->map);
+    free(source);
+}
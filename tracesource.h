@@ -0,0 +1,18 @@
+#ifndef TRACESOURCE_H
+#define TRACESOURCE_H
+
+#include "import.h"
+
+// Any trace the tools accept, read as a sequence of record batches: raw traces are
+// memory-mapped and handed out in place, compressed traces are streamed through a
+// CTraceReader and foreign ones (format != IMPORT_NUM_FORMATS) through a TraceImporter.
+// threads is passed on to the decoder/parser. path "-" is a compressed trace on stdin
+// unless a foreign format is given.
+typedef struct TraceSource TraceSource;
+
+TraceSource *trace_source_open(const char *path, ImportFormat format, unsigned long threads);
+// next batch, valid until the next call; returns the record count, 0 at the end
+unsigned long trace_source_next(TraceSource *source, const TraceRecord **records);
+void trace_source_close(TraceSource *source);
+
+#endif
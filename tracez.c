@@ -0,0 +1,87 @@
+// Converts between raw (trace.h) and compressed (ctrace.h) traces.
+// build: gcc -O2 -o tracez tracez.c ctrace.c trace.c cache.c coherence.c waymatch.c kernels.c prefetch.c dram.c tlb.c interval.c -lpthread
+// usage: ./tracez [-b block_records] in.bin out.ctr    compress
+//        ./tracez -d [-j threads] in.ctr out.bin       decompress ("-" reads stdin)
+//        ./tracez -i in.ctr                            print the block index summary
+#include "ctrace.h"
+#include <unistd.h>
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-b block_records] in.bin out.ctr\n"
+                    "       %s -d [-j threads] in.ctr out.bin\n"
+                    "       %s -i in.ctr\n", prog, prog, prog);
+    exit(1);
+}
+
+static void compress(const char *in, const char *out, unsigned long block_records) {
+    TraceMap trace;
+    trace_map(in, &trace);
+    CTraceWriter *writer = ctrace_writer_open(out, block_records);
+    for (unsigned long i = 0; i < trace.count; i++)
+        ctrace_write(writer, &trace.records[i]);
+    ctrace_writer_close(writer);
+
+    FILE *fp = fopen(out, "rb");
+    if (!fp) { perror(out); exit(1); }
+    fseek(fp, 0, SEEK_END);
+    long bytes = ftell(fp);
+    fclose(fp);
+    fprintf(stderr, "%lu records, %zu -> %ld bytes (%.2f bytes/record)\n", trace.count, trace.length, bytes,
+            trace.count ? (double)bytes / trace.count : 0.0);
+    trace_unmap(&trace);
+}
+
+static void decompress(const char *in, const char *out, unsigned long threads) {
+    CTraceReader *reader = ctrace_open(in, threads);
+    TraceWriter *writer = trace_writer_open(out);
+    const TraceRecord *records;
+    unsigned long count;
+    while ((count = ctrace_next_block(reader, &records)) > 0) {
+        for (unsigned long i = 0; i < count; i++)
+            trace_write_core(writer, records[i].core, records[i].vaddr, records[i].paddr, records[i].access_type,
+                             records[i].op);
+    }
+    trace_writer_close(writer);
+    ctrace_close(reader);
+}
+
+static void info(const char *in) {
+    CTraceFooter footer;
+    CTraceIndexEntry *index;
+    ctrace_read_index(in, &footer, &index);
+    printf("%lu records in %lu blocks\n", (unsigned long)footer.record_count, (unsigned long)footer.block_count);
+    for (unsigned long i = 0; i < footer.block_count; i++) {
+        uint64_t end = i + 1 < footer.block_count ? index[i + 1].offset : footer.index_offset - sizeof(CTraceBlockHeader);
+        printf("block %lu: offset %lu, first record %lu, %lu bytes\n", i, (unsigned long)index[i].offset,
+               (unsigned long)index[i].first_record, (unsigned long)(end - index[i].offset));
+    }
+    free(index);
+}
+
+int main(int argc, char **argv) {
+    unsigned long block_records = CTRACE_BLOCK_RECORDS, threads = 1;
+    int mode = 'c';
+    int opt;
+    while ((opt = getopt(argc, argv, "b:dij:")) != -1) {
+        switch (opt) {
+            case 'b': block_records = strtoul(optarg, NULL, 10); break;
+            case 'd': mode = 'd'; break;
+            case 'i': mode = 'i'; break;
+            case 'j': threads = strtoul(optarg, NULL, 10); break;
+            default: usage(argv[0]);
+        }
+    }
+    if (mode == 'i') {
+        if (optind != argc - 1)
+            usage(argv[0]);
+        info(argv[optind]);
+        return 0;
+    }
+    if (optind != argc - 2)
+        usage(argv[0]);
+    if (mode == 'd')
+        decompress(argv[optind], argv[optind + 1], threads);
+    else
+        compress(argv[optind], argv[optind + 1], block_records);
+    return 0;
+}
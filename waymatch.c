@@ -0,0 +1,83 @@
+#include "cache.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+static uint64_t match_ways_scalar(const unsigned int *tags, unsigned long n, unsigned int tag) {
+    uint64_t mask = 0;
+    for (unsigned long i = 0; i < n; i++)
+        mask |= (uint64_t)(tags[i] == tag) << i;
+    return mask;
+}
+
+#ifdef HAVE_X86_SIMD
+
+__attribute__((target("sse2")))
+static uint64_t match_ways_sse2(const unsigned int *tags, unsigned long n, unsigned int tag) {
+    __m128i key = _mm_set1_epi32((int)tag);
+    uint64_t mask = 0;
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(tags + i)), key);
+        mask |= (uint64_t)_mm_movemask_ps(_mm_castsi128_ps(eq)) << i;
+    }
+    return mask | (match_ways_scalar(tags + i, n - i, tag) << i);
+}
+
+__attribute__((target("avx2")))
+static uint64_t match_ways_avx2(const unsigned int *tags, unsigned long n, unsigned int tag) {
+    __m256i key = _mm256_set1_epi32((int)tag);
+    uint64_t mask = 0;
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i eq = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)(tags + i)), key);
+        mask |= (uint64_t)_mm256_movemask_ps(_mm256_castsi256_ps(eq)) << i;
+    }
+    // the tail stays in this function: calling the legacy-SSE kernel with dirty
+    // upper ymm state costs an AVX/SSE transition stall on every lookup
+    for (; i < n; i++)
+        mask |= (uint64_t)(tags[i] == tag) << i;
+    return mask;
+}
+
+__attribute__((target("avx512f")))
+static uint64_t match_ways_avx512(const unsigned int *tags, unsigned long n, unsigned int tag) {
+    __m512i key = _mm512_set1_epi32((int)tag);
+    uint64_t mask = 0;
+    unsigned long i = 0;
+    for (; i + 16 <= n; i += 16)
+        mask |= (uint64_t)_mm512_cmpeq_epi32_mask(_mm512_loadu_si512(tags + i), key) << i;
+    if (i < n) // masked load for the tail, lanes past n are never read
+        mask |= (uint64_t)_mm512_mask_cmpeq_epi32_mask((__mmask16)((1u << (n - i)) - 1),
+                     _mm512_maskz_loadu_epi32((__mmask16)((1u << (n - i)) - 1), tags + i), key) << i;
+    return mask;
+}
+
+#endif
+
+// widest kernel whose vector fits in one set, sets narrower than 4 ways stay scalar
+WayMatchFn select_way_match(unsigned long associativity) {
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+    if (associativity >= 16 && __builtin_cpu_supports("avx512f"))
+        return match_ways_avx512;
+    if (associativity >= 8 && __builtin_cpu_supports("avx2"))
+        return match_ways_avx2;
+    if (associativity >= 4 && __builtin_cpu_supports("sse2"))
+        return match_ways_sse2;
+#endif
+    (void) associativity;
+    return match_ways_scalar;
+}
+
+const char *way_match_name(WayMatchFn fn) {
+#ifdef HAVE_X86_SIMD
+    if (fn == match_ways_avx512) return "AVX-512";
+    if (fn == match_ways_avx2)   return "AVX2";
+    if (fn == match_ways_sse2)   return "SSE2";
+#endif
+    (void) fn;
+    return "scalar";
+}